@@ -0,0 +1,173 @@
+#include "arena.hpp"
+#include "macros.hpp"
+#include "pages.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+void SegmentList::push_back(SegmentHeader* seg) {
+    seg->prev = head.prev;
+    seg->next = &head;
+    head.prev->next = seg;
+    head.prev = seg;
+}
+
+void SegmentList::splice(SegmentList& other) {
+    if (other.empty()) return;
+    other.head.next->prev = head.prev;
+    head.prev->next = other.head.next;
+    other.head.prev->next = &head;
+    head.prev = other.head.prev;
+    other.clear();
+}
+
+void SegmentList::split_after(SegmentHeader* seg, SegmentList& rest) {
+    if (seg == head.prev) return;
+    rest.head.next = seg->next;
+    rest.head.prev = head.prev;
+    seg->next->prev = &rest.head;
+    head.prev->next = &rest.head;
+    seg->next = &head;
+    head.prev = seg;
+}
+
+void SegmentList::unlink(SegmentHeader* seg) {
+    seg->prev->next = seg->next;
+    seg->next->prev = seg->prev;
+}
+
+void SegmentList::free_all() {
+    SegmentHeader* seg = head.next;
+    while (seg != &head) {
+        SegmentHeader* next = seg->next;
+        free(seg);
+        seg = next;
+    }
+    clear();
+}
+
+SlabArena::SlabArena() {
+    for (size_t i = 0; i < NB_CLASSES; i++) {
+        free_lists[i] = nullptr;
+        bump[i] = bump_end[i] = nullptr;
+    }
+}
+
+SlabArena::~SlabArena() {
+    for (void* slab : slabs) {
+        free(slab);
+    }
+}
+
+SegmentHeader* SlabArena::alloc(size_t bytes, size_t align, SlabSource* source, ZeroPool* pool) {
+    size_t size_class = 0;
+    while (block_size(size_class) < bytes) size_class++;
+
+    SegmentHeader* seg = free_lists[size_class];
+    if (likely(seg)) {
+        free_lists[size_class] = seg->next;
+        return seg;
+    }
+    if (pool) {
+        // Adopt every block the pool zeroed for this class
+        seg = pool->take(size_class);
+        if (seg) {
+            free_lists[size_class] = seg->next;
+            return seg;
+        }
+    }
+
+    size_t block = block_size(size_class);
+    if (unlikely(bump[size_class] == bump_end[size_class])) {
+        // Blocks are aligned on their size within the slab, so the slab only needs the larger of the two alignments
+        size_t slab_align = max(align, block);
+        size_t slab_size = max(SLAB_SIZE, block);
+        char* slab;
+        if (source) {
+            // Fresh out of a mapping, so already zeroed
+            slab = static_cast<char*>(source->take(slab_size, slab_align));
+            if (unlikely(!slab)) return nullptr;
+        } else {
+            slab = static_cast<char*>(aligned_alloc(slab_align, slab_size));
+            if (unlikely(!slab)) return nullptr;
+            // Zero the slab once, instead of every block when it is handed out
+            memset(slab, 0, slab_size);
+            slabs.push_back(slab);
+        }
+        bump[size_class] = slab;
+        bump_end[size_class] = slab + slab_size;
+    }
+    seg = reinterpret_cast<SegmentHeader*>(bump[size_class]);
+    bump[size_class] += block;
+    seg->size_class = size_class;
+    return seg;
+}
+
+void SlabArena::zero(SegmentHeader* seg) {
+    // The free lists only hold zeroed blocks
+    size_t block = block_size(seg->size_class);
+    memset(reinterpret_cast<char*>(seg) + sizeof(SegmentHeader), 0, block - sizeof(SegmentHeader));
+}
+
+ZeroPool::ZeroPool(): stopping{false} {
+    for (size_t i = 0; i < SlabArena::NB_CLASSES; i++) {
+        clean[i].store(nullptr, memory_order_relaxed);
+    }
+}
+
+bool ZeroPool::start() {
+    try {
+        worker = thread{&ZeroPool::run, this};
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+void ZeroPool::stop() {
+    if (!worker.joinable()) return;
+    {
+        lock_guard<mutex> guard{lock};
+        stopping = true;
+    }
+    wake.notify_one();
+    worker.join();
+}
+
+void ZeroPool::give(vector<SegmentHeader*> const& segs) {
+    {
+        lock_guard<mutex> guard{lock};
+        dirty.insert(dirty.end(), segs.begin(), segs.end());
+    }
+    wake.notify_one();
+}
+
+void ZeroPool::run() {
+    vector<SegmentHeader*> batch;
+    while (true) {
+        {
+            unique_lock<mutex> guard{lock};
+            wake.wait(guard, [this] { return stopping || !dirty.empty(); });
+            if (stopping) return;
+            batch.swap(dirty);
+        }
+        // Chain the zeroed blocks by class, then publish each chain with a single CAS
+        SegmentHeader* heads[SlabArena::NB_CLASSES] = {};
+        SegmentHeader* tails[SlabArena::NB_CLASSES] = {};
+        for (SegmentHeader* seg : batch) {
+            SlabArena::zero(seg);
+            size_t size_class = seg->size_class;
+            seg->next = heads[size_class];
+            if (!heads[size_class]) tails[size_class] = seg;
+            heads[size_class] = seg;
+        }
+        batch.clear();
+        for (size_t i = 0; i < SlabArena::NB_CLASSES; i++) {
+            if (!heads[i]) continue;
+            SegmentHeader* old = clean[i].load(memory_order_relaxed);
+            do {
+                tails[i]->next = old;
+            } while (!clean[i].compare_exchange_weak(old, heads[i], memory_order_release, memory_order_relaxed));
+        }
+    }
+}
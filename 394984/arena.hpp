@@ -0,0 +1,107 @@
+#pragma once
+
+// External headers
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Header placed in front of every segment returned by tm_alloc, linking it in the list of its transaction or region
+struct SegmentHeader {
+    SegmentHeader* prev;
+    SegmentHeader* next;
+    size_t size_class; // Class of the arena block holding the segment, LARGE_SEGMENT for a segment of its own
+};
+
+constexpr size_t LARGE_SEGMENT = SIZE_MAX;
+
+// Intrusive doubly linked list of segments, so that a freed segment can be unlinked without searching for it
+struct SegmentList {
+    SegmentHeader head; // Sentinel, the list is circular
+    SegmentList() { clear(); }
+    SegmentList(SegmentList const&) = delete;
+    SegmentList& operator=(SegmentList const&) = delete;
+    bool empty() const { return head.next == &head; }
+    // Forget every segment of the list, without touching them
+    void clear() { head.prev = head.next = &head; }
+    void push_back(SegmentHeader* seg);
+    // Move every segment of the other list to the end of this one
+    void splice(SegmentList& other);
+    // Move the segments after the given one (or every segment, given the sentinel) to the other list, which must be empty
+    void split_after(SegmentHeader* seg, SegmentList& rest);
+    static void unlink(SegmentHeader* seg);
+    // free() every segment of the list
+    void free_all();
+};
+
+struct SlabSource;
+struct ZeroPool;
+
+// Per-thread size-class allocator of a region. Blocks (header included) are powers of two between MIN_BLOCK and MAX_BLOCK bytes,
+// carved out of zeroed slabs that live as long as the region. Every block in a free list is zeroed, so allocating never has to clear memory.
+struct SlabArena {
+    static constexpr unsigned MIN_BLOCK_BITS = 6;
+    static constexpr size_t NB_CLASSES = 9;
+    static constexpr size_t MAX_BLOCK = size_t{1} << (MIN_BLOCK_BITS + NB_CLASSES - 1);
+    static constexpr size_t SLAB_SIZE = size_t{1} << 16;
+    SegmentHeader* free_lists[NB_CLASSES]; // Singly linked through 'next'
+    char* bump[NB_CLASSES];     // Next never used block of the current slab of each class
+    char* bump_end[NB_CLASSES];
+    vector<void*> slabs; // Slabs of the heap, the ones of a SlabSource belong to it
+    SlabArena();
+    SlabArena(SlabArena const&) = delete;
+    SlabArena& operator=(SlabArena const&) = delete;
+    ~SlabArena();
+    static size_t block_size(size_t size_class) { return size_t{1} << (size_class + MIN_BLOCK_BITS); }
+    // Zeroed block of at least 'bytes' bytes (header included) aligned on 'align', nullptr if out of memory.
+    // An empty free list is refilled from the zero pool if there is one, then new slabs come from the source if there is one, from the heap otherwise.
+    SegmentHeader* alloc(size_t bytes, size_t align, SlabSource* source, ZeroPool* pool);
+    // Take back a block that is still zeroed, e.g. allocated by a transaction that aborted
+    void recycle(SegmentHeader* seg) {
+        seg->next = free_lists[seg->size_class];
+        free_lists[seg->size_class] = seg;
+    }
+    // Take back a block whose data may have been written to
+    void recycle_dirty(SegmentHeader* seg) {
+        zero(seg);
+        recycle(seg);
+    }
+    // Zero the data of a block, i.e. everything past its header
+    static void zero(SegmentHeader* seg);
+};
+
+// Background zeroing of the arena blocks reclaimed in a region, so that neither reclaiming nor allocating pays for clearing them.
+// Reclaiming threads hand their dirty blocks over, a thread of the region zeroes them and publishes them in per-class lists
+// that arenas take whole when their own free list runs dry. Blocks move freely between arenas since every slab lives as long as the region.
+struct ZeroPool {
+    mutex lock; // Protects the dirty blocks and the stop flag
+    condition_variable wake;
+    vector<SegmentHeader*> dirty;
+    bool stopping;
+    atomic<SegmentHeader*> clean[SlabArena::NB_CLASSES]; // Singly linked through 'next', pushed as whole chains and taken whole, so there is no ABA
+    thread worker;
+    ZeroPool();
+    ZeroPool(ZeroPool const&) = delete;
+    ZeroPool& operator=(ZeroPool const&) = delete;
+    ~ZeroPool() { stop(); }
+    // Start the zeroing thread, returns false if it could not be created
+    bool start();
+    // Stop and join the zeroing thread, dropping the blocks it did not zero yet (they go with their slabs)
+    void stop();
+    bool running() const { return worker.joinable(); }
+    // Hand blocks whose data may have been written to over to the zeroing thread
+    void give(vector<SegmentHeader*> const& segs);
+    // Every zeroed block of the class, linked through 'next', nullptr if none
+    SegmentHeader* take(size_t size_class) {
+        // Checking first keeps the empty case to a plain load
+        if (clean[size_class].load(memory_order_relaxed) == nullptr) return nullptr;
+        return clean[size_class].exchange(nullptr, memory_order_acquire);
+    }
+private:
+    void run();
+};
@@ -0,0 +1,35 @@
+#include "cache.hpp"
+#include <cstdlib>
+
+RegionCache region_cache;
+
+RegionCache::~RegionCache() {
+    for (auto* list : {&locks, &starts}) {
+        for (CachedBlock& block : *list) {
+            if (block.mapped) {
+                unmap_pages(block.ptr, block.bytes, block.backing);
+            } else {
+                free(block.ptr);
+            }
+        }
+    }
+}
+
+bool RegionCache::take(vector<CachedBlock>& list, CachedBlock& block) {
+    lock_guard<mutex> guard{lock};
+    // The most recently cached block of the shape, its pages are the likeliest to still be in the cache
+    for (size_t i = list.size(); i-- > 0; ) {
+        if (!list[i].same_shape(block)) continue;
+        block = list[i];
+        list.erase(list.begin() + i);
+        return true;
+    }
+    return false;
+}
+
+bool RegionCache::put(vector<CachedBlock>& list, CachedBlock const& block, size_t limit) {
+    lock_guard<mutex> guard{lock};
+    if (list.size() >= limit) return false;
+    list.push_back(block);
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+// External headers
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Internal headers
+#include "clock.hpp"
+#include "numa.hpp"
+#include "pages.hpp"
+
+using namespace std;
+
+// Lock tables and first segments of destroyed regions, kept for the next regions of the same shape (see Config::region_cache).
+// A region created from them maps nothing and initializes no lock: the first segments are zeroed when they are put back,
+// and the lock tables keep the versions they had, which the clock of the next region starts after.
+
+// A cached block, and the shape it must match to be taken
+struct CachedBlock {
+    void* ptr;
+    size_t bytes;
+    size_t align;
+    bool mapped; // From map_pages, with the backing it got, otherwise from aligned_alloc
+    Backing backing;
+    PageMode pages;
+    NumaMode numa;
+    version top; // Lock tables: no stripe has a newer version
+    bool same_shape(CachedBlock const& other) const {
+        return bytes == other.bytes && align == other.align && mapped == other.mapped && pages == other.pages && numa == other.numa;
+    }
+};
+
+struct RegionCache {
+    mutex lock; // Only taken on tm_create and tm_destroy
+    vector<CachedBlock> locks;
+    vector<CachedBlock> starts;
+    RegionCache() = default;
+    RegionCache(RegionCache const&) = delete;
+    RegionCache& operator=(RegionCache const&) = delete;
+    ~RegionCache();
+    // Take a block of the same shape as the given one out of the list, which then gets its pointer, backing and top version, false if there is none
+    bool take(vector<CachedBlock>& list, CachedBlock& block);
+    // Keep a block, false if the list holds 'limit' blocks already: the caller frees it then
+    bool put(vector<CachedBlock>& list, CachedBlock const& block, size_t limit);
+};
+
+// Process-wide, so that a region can be recycled whatever thread created or destroyed it
+extern RegionCache region_cache;
@@ -0,0 +1,112 @@
+#include "data-structures.hpp"
+#include "stats.hpp"
+#include <cstring>
+
+VersionClock::VersionClock(): mode{ClockMode::gv1}, nb_shards{0}, hybrid{false} {}
+
+bool VersionClock::init(ClockMode mode_, size_t nb_shards_) {
+    mode = mode_;
+    if (mode == ClockMode::sharded) {
+        nb_shards = nb_shards_;
+        shards.reset(new(nothrow) ClockShard[nb_shards]);
+        if (unlikely(!shards)) return false;
+    }
+    return true;
+}
+
+// Raise an atomic to at least v
+static void raise_to(atomic<version>& clock, version v) {
+    version current = clock.load();
+    while (current < v && !clock.compare_exchange_weak(current, v));
+}
+
+version VersionClock::shards_max() {
+    version res = 0;
+    for (size_t i = 0; i < nb_shards; i++) {
+        res = max(res, shards[i].value.load());
+    }
+    return res;
+}
+
+version VersionClock::read() {
+    if (mode == ClockMode::sharded) return shards_max();
+    return global.value.load();
+}
+
+version VersionClock::tick(word owner, bool& exclusive) {
+    exclusive = false;
+    switch (mode) {
+    case ClockMode::gv1:
+        // Note: You need to add + 1 here! You would think it would return the incremented value but it doesn't. I think this one thing caused me up to 4 hours of debugging : (
+        exclusive = !hybrid;
+        STAT_INC(clock_ticks);
+        return global.value.fetch_add(1) + 1;
+    case ClockMode::gv4: {
+        // If the CAS fails, someone else committed at the value it left in 'current', and we can share it since we both hold our locks
+        version current = global.value.load();
+        if (global.value.compare_exchange_strong(current, current + 1)) {
+            STAT_INC(clock_ticks);
+            return current + 1;
+        }
+        return current;
+    }
+    case ClockMode::gv6: {
+        static thread_local unsigned commits = 0;
+        if (++commits % CLOCK_GV6_PERIOD == 0) {
+            version current = global.value.load();
+            if (global.value.compare_exchange_strong(current, current + 1)) {
+                STAT_INC(clock_ticks);
+                return current + 1;
+            }
+            return current;
+        }
+        return global.value.load() + 1;
+    }
+    case ClockMode::gv5:
+        return global.value.load() + 1;
+    case ClockMode::sharded:
+        // Reading every shard after taking the locks gives a version larger than any snapshot that could have missed our locks
+        (void) owner;
+        return shards_max() + 1;
+    }
+    return 0;
+}
+
+void VersionClock::publish(word owner, version wv) {
+    if (mode == ClockMode::sharded) {
+        STAT_INC(clock_ticks);
+        raise_to(shards[owner % nb_shards].value, wv);
+    }
+}
+
+void VersionClock::observe(version v) {
+    if (mode == ClockMode::gv5 || mode == ClockMode::gv6) raise_to(global.value, v);
+}
+
+void VersionClock::catch_up(word owner, version v) {
+    if (mode == ClockMode::sharded) {
+        raise_to(shards[owner % nb_shards].value, v);
+    } else {
+        raise_to(global.value, v);
+    }
+}
+
+bool parse_clock_mode(char const* name, size_t len, ClockMode& out) {
+    static struct {
+        char const* name;
+        ClockMode mode;
+    } const modes[] = {
+        {"gv1", ClockMode::gv1},
+        {"gv4", ClockMode::gv4},
+        {"gv5", ClockMode::gv5},
+        {"gv6", ClockMode::gv6},
+        {"sharded", ClockMode::sharded},
+    };
+    for (auto& entry : modes) {
+        if (strlen(entry.name) == len && strncmp(entry.name, name, len) == 0) {
+            out = entry.mode;
+            return true;
+        }
+    }
+    return false;
+}
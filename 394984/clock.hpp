@@ -0,0 +1,54 @@
+#pragma once
+
+// External headers
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+using namespace std;
+
+using word = uintptr_t;
+using version = uint64_t;
+
+// How committing transactions get their write version (see the TL2 paper for GV4/GV5/GV6)
+enum class ClockMode {
+    gv1,     // Every commit increments the clock
+    gv4,     // One CAS, on failure reuse the timestamp of the concurrent committer that won
+    gv5,     // Commits never write the clock, readers that see a newer version push it forward
+    gv6,     // gv5, with one commit in CLOCK_GV6_PERIOD doing a gv4 increment
+    sharded  // One clock per group of threads, the time is the largest of them
+};
+
+constexpr unsigned CLOCK_GV6_PERIOD = 32;
+
+struct alignas(64) ClockShard {
+    atomic<version> value{0};
+};
+
+// Global version clock of a shared memory region
+struct VersionClock {
+    ClockMode mode;
+    ClockShard global;
+    unique_ptr<ClockShard[]> shards;
+    size_t nb_shards;
+    bool hybrid; // Hardware transactions commit at a version they did not tick (see catch_up), so no version is ever exclusive
+    VersionClock();
+    bool init(ClockMode mode_, size_t nb_shards_);
+    // Snapshot for a beginning (or extending) transaction
+    version read();
+    // Write version of a committing transaction that holds its write locks.
+    // 'exclusive' tells whether no other commit can get the same version, i.e. whether rv + 1 == wv proves that nobody committed since the snapshot.
+    version tick(word owner, bool& exclusive);
+    // Called before releasing the write locks with the version they are set to
+    void publish(word owner, version wv);
+    // A read found version v newer than its snapshot, make sure later snapshots include it
+    void observe(version v);
+    // A hardware transaction committed at version v without ticking the clock, make sure later snapshots include it whatever the mode
+    void catch_up(word owner, version v);
+private:
+    version shards_max();
+};
+
+// ClockMode from its name, false if unknown
+bool parse_clock_mode(char const* name, size_t len, ClockMode& out);
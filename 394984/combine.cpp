@@ -0,0 +1,22 @@
+#include "combine.hpp"
+#include <algorithm>
+
+void CommitBatch::clear() {
+    // The vectors keep their buffers for the next pass, so the combiner allocates nothing while it holds the locks of a batch
+    members.clear();
+    locked.clear();
+    written.clear();
+}
+
+void CommitBatch::add_writes(vector<uint32_t> const& stripes) {
+    // Members write a handful of stripes each, so sorting them and merging them in is cheaper than keeping a hash set
+    size_t old_size = written.size();
+    written.insert(written.end(), stripes.begin(), stripes.end());
+    sort(written.begin() + old_size, written.end());
+    inplace_merge(written.begin(), written.begin() + old_size, written.end());
+    written.erase(unique(written.begin(), written.end()), written.end());
+}
+
+bool CommitBatch::writes(uint32_t stripe) const {
+    return binary_search(written.begin(), written.end(), stripe);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// External headers
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Flat-combining group commit (see Config::group_commit). A writing transaction that reaches its commit publishes itself in the slot of its thread,
+// and whichever committer gets the combiner role commits every published transaction at once: it takes all their stripe locks,
+// ticks the clock once for the whole batch, validates the members in order and writes back those that passed.
+// Hot stripes then see one lock round-trip per batch instead of one per transaction, and the clock one increment.
+
+struct Transaction;
+struct ThreadSlot;
+
+// What became of the commit a thread published
+enum class CommitState: uint8_t {
+    idle,      // Nothing published
+    pending,   // Waiting for a combiner
+    committed,
+    aborted,   // The combiner could not take one of its locks, or its validation failed: its locks are released already
+};
+
+// State of the combiner, only touched by the thread holding the role
+struct CommitBatch {
+    // Commits taken in one pass, the other ones wait for the next
+    static constexpr size_t MAX_MEMBERS = 64;
+    struct Member {
+        ThreadSlot* slot;
+        Transaction* txn;
+        bool ok; // Still bound to commit
+    };
+    vector<Member> members; // In the order they are serialized in
+    vector<uint32_t> locked; // Stripes locked for the batch, in locking order
+    // Stripes written by the members validated so far, sorted and deduplicated: a member that read one of them read the value from before the batch
+    vector<uint32_t> written;
+    void clear();
+    // Add the write set of a member that passed validation
+    void add_writes(vector<uint32_t> const& stripes);
+    bool writes(uint32_t stripe) const;
+};
+
+// Per-region combining state
+struct CommitCombiner {
+    atomic<bool> busy{false}; // Whether some thread holds the combiner role
+    CommitBatch batch;
+    bool try_acquire() { return !busy.load(memory_order_relaxed) && !busy.exchange(true, memory_order_acquire); }
+    void release() { busy.store(false, memory_order_release); }
+};
@@ -0,0 +1,109 @@
+#include "config.hpp"
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// Defaults baked into a variant of the library (see VARIANTS in the Makefile), applied before TM_OPTIONS
+#ifndef TM_DEFAULTS
+    #define TM_DEFAULTS ""
+#endif
+
+Config::Config(): locks{0}, lock_pad{false}, lock_grain{0}, segment_locks{0}, extend{false}, value_check{false}, clock{ClockMode::gv1}, clock_shards{4}, htm{false}, htm_retries{4}, cm{CmPolicy::none}, cm_spins{128}, cm_backoff_max{4096}, mvcc{false}, mvcc_depth{8}, mvcc_rings{0}, numa{NumaMode::off}, pages{PageMode::normal}, engine{EngineMode::tl2}, group_commit{false}, stream_writes{0}, ro_inline{false}, irrevocable_after{0}, region_cache{0}, zero_thread{false} {}
+
+// Parse a non-negative integer, with an optional k/m/g suffix, false if it does not fit in a size_t
+static bool parse_size(char const* value, size_t len, size_t& out) {
+    if (len == 0) return false;
+    size_t res = 0;
+    size_t i = 0;
+    for (; i < len && value[i] >= '0' && value[i] <= '9'; i++) {
+        size_t digit = value[i] - '0';
+        if (res > (SIZE_MAX - digit) / 10) return false;
+        res = res * 10 + digit;
+    }
+    unsigned shift = 0;
+    if (i + 1 == len && (value[i] == 'k' || value[i] == 'K')) {
+        shift = 10;
+    } else if (i + 1 == len && (value[i] == 'm' || value[i] == 'M')) {
+        shift = 20;
+    } else if (i + 1 == len && (value[i] == 'g' || value[i] == 'G')) {
+        shift = 30;
+    } else if (i != len) {
+        return false;
+    }
+    if (res > (SIZE_MAX >> shift)) return false;
+    out = res << shift;
+    return true;
+}
+
+// Same as parse_size, also false above 'max'
+static bool parse_size(char const* value, size_t len, size_t& out, size_t max) {
+    size_t res;
+    if (!parse_size(value, len, res) || res > max) return false;
+    out = res;
+    return true;
+}
+
+static bool parse_bool(char const* value, size_t len, bool& out) {
+    size_t res;
+    if (!parse_size(value, len, res) || res > 1) return false;
+    out = res == 1;
+    return true;
+}
+
+static bool is_key(char const* key, size_t len, char const* name) {
+    return strlen(name) == len && strncmp(key, name, len) == 0;
+}
+
+bool Config::set(char const* key, size_t key_len, char const* value, size_t value_len) {
+    if (is_key(key, key_len, "locks")) return parse_size(value, value_len, locks, CONFIG_MAX_LOCKS);
+    if (is_key(key, key_len, "lock_pad")) return parse_bool(value, value_len, lock_pad);
+    if (is_key(key, key_len, "lock_grain")) return parse_size(value, value_len, lock_grain) && (lock_grain & (lock_grain - 1)) == 0;
+    if (is_key(key, key_len, "segment_locks")) return parse_size(value, value_len, segment_locks, CONFIG_MAX_SEGMENT_LOCKS);
+    if (is_key(key, key_len, "extend")) return parse_bool(value, value_len, extend);
+    if (is_key(key, key_len, "value_check")) return parse_bool(value, value_len, value_check);
+    if (is_key(key, key_len, "clock")) return parse_clock_mode(value, value_len, clock);
+    if (is_key(key, key_len, "clock_shards")) return parse_size(value, value_len, clock_shards) && clock_shards > 0;
+    if (is_key(key, key_len, "htm")) return parse_bool(value, value_len, htm);
+    if (is_key(key, key_len, "htm_retries")) return parse_size(value, value_len, htm_retries);
+    if (is_key(key, key_len, "cm")) return parse_cm_policy(value, value_len, cm);
+    if (is_key(key, key_len, "cm_spins")) return parse_size(value, value_len, cm_spins);
+    if (is_key(key, key_len, "cm_backoff_max")) return parse_size(value, value_len, cm_backoff_max);
+    if (is_key(key, key_len, "mvcc")) return parse_bool(value, value_len, mvcc);
+    if (is_key(key, key_len, "mvcc_depth")) return parse_size(value, value_len, mvcc_depth, CONFIG_MAX_MVCC_DEPTH) && mvcc_depth > 0;
+    if (is_key(key, key_len, "mvcc_rings")) return parse_size(value, value_len, mvcc_rings, CONFIG_MAX_MVCC_RINGS);
+    if (is_key(key, key_len, "numa")) return parse_numa_mode(value, value_len, numa);
+    if (is_key(key, key_len, "pages")) return parse_page_mode(value, value_len, pages);
+    if (is_key(key, key_len, "engine")) return parse_engine_mode(value, value_len, engine);
+    if (is_key(key, key_len, "group_commit")) return parse_bool(value, value_len, group_commit);
+    if (is_key(key, key_len, "stream_writes")) return parse_size(value, value_len, stream_writes);
+    if (is_key(key, key_len, "ro_inline")) return parse_bool(value, value_len, ro_inline);
+    if (is_key(key, key_len, "irrevocable_after")) return parse_size(value, value_len, irrevocable_after);
+    if (is_key(key, key_len, "region_cache")) return parse_size(value, value_len, region_cache);
+    if (is_key(key, key_len, "zero_thread")) return parse_bool(value, value_len, zero_thread);
+    return false;
+}
+
+bool Config::parse(char const* options) {
+    char const* pos = options;
+    while (*pos) {
+        char const* end = strchr(pos, ',');
+        if (!end) end = pos + strlen(pos);
+        // Empty entries are allowed, e.g. a trailing comma
+        if (end != pos) {
+            char const* eq = static_cast<char const*>(memchr(pos, '=', end - pos));
+            if (!eq || !set(pos, eq - pos, eq + 1, end - eq - 1)) return false;
+        }
+        if (!*end) break;
+        pos = end + 1;
+    }
+    return true;
+}
+
+bool Config::load(Config& config, char const* options) {
+    config = Config();
+    if (!config.parse(TM_DEFAULTS)) return false;
+    char const* env = getenv("TM_OPTIONS");
+    if (env && !config.parse(env)) return false;
+    if (options && !config.parse(options)) return false;
+    return true;
+}
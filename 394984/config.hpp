@@ -0,0 +1,80 @@
+#pragma once
+
+// External headers
+#include <cstddef>
+
+// Internal headers
+#include "clock.hpp"
+#include "contention.hpp"
+#include "etl.hpp"
+#include "numa.hpp"
+#include "pages.hpp"
+
+using namespace std;
+
+// Largest values of the options that size the region, anything above is rejected as malformed.
+// Stripes are 32-bit in the read and write sets, and the segment-local locks number theirs after those of the table.
+constexpr size_t CONFIG_MAX_LOCKS = size_t{1} << 31;
+constexpr size_t CONFIG_MAX_MVCC_RINGS = size_t{1} << 31;
+constexpr size_t CONFIG_MAX_MVCC_DEPTH = size_t{1} << 16;
+constexpr size_t CONFIG_MAX_SEGMENT_LOCKS = size_t{1} << 46; // Bytes of address space, most of what a process can map
+
+// Tunables of a shared memory region.
+// They are read when the region is created, either from the TM_OPTIONS environment variable or from the string given to tm_create_ext.
+// The format is a comma-separated list of key=value pairs, e.g. "locks=65536,lock_pad=1".
+struct Config {
+    // Number of versioned locks, rounded up to a power of two (0 picks a count scaled from the size of the first segment)
+    size_t locks;
+    // Give every lock its own cache line so that hot stripes don't false-share
+    bool lock_pad;
+    // Bytes covered by one lock, a power of two (0 or anything below the alignment means one word), larger grains let multi-word reads validate once per stripe
+    size_t lock_grain;
+    // Bytes of address space reserved for the arena slabs, each of which then carries the locks of its own grains in front of it (0 keeps every lock in the table).
+    // Segments allocated by transactions that fit in an arena block find their locks by address arithmetic, next to their data and never shared with another segment.
+    size_t segment_locks;
+    // On a version newer than the snapshot, revalidate the read set and move the snapshot forward instead of aborting (read-only transactions then keep a read log)
+    bool extend;
+    // When a stripe is newer than the snapshot, compare the words read with their current values before giving up, so that commits to other words of a stripe (or of a stripe sharing its lock) do not abort us
+    bool value_check;
+    // How commits get their version, and the number of clocks of the sharded mode
+    ClockMode clock;
+    size_t clock_shards;
+    // Hybrid mode: first try every transaction as a hardware one, up to htm_retries times, on CPUs that support it (see htm.hpp)
+    bool htm;
+    size_t htm_retries;
+    // Contention manager, with the spin budget on a locked stripe and the longest backoff (both counted in pause instructions)
+    CmPolicy cm;
+    size_t cm_spins;
+    size_t cm_backoff_max;
+    // Multi-version read-only transactions: commits keep the values they overwrite, in mvcc_rings rings of mvcc_depth entries (both rounded up to powers of two, 0 rings scales with the locks)
+    bool mvcc;
+    size_t mvcc_depth;
+    size_t mvcc_rings;
+    // Placement of the lock table and first segment across NUMA nodes (see numa.hpp)
+    NumaMode numa;
+    // Page size of the lock table, first segment and arena slabs (see pages.hpp)
+    PageMode pages;
+    // Commit-time (redo log) or encounter-time (write-through, undo log) locking, see etl.hpp
+    EngineMode engine;
+    // Commit writing transactions in batches: the committer holding the combiner role locks, validates and writes back every published commit with a single clock tick (see combine.hpp)
+    bool group_commit;
+    // Write back the write sets of at least that many bytes with non-temporal stores, so that large commits do not flush the cache (0 never does)
+    size_t stream_writes;
+    // Hand out read-only transactions as their snapshot and owner tag packed in the tx_t, with no descriptor, whenever the region lets them live on their snapshot alone
+    bool ro_inline;
+    // Run a transaction irrevocably once its thread aborted that many attempts in a row (0 never does, see tm_begin_irrevocable)
+    size_t irrevocable_after;
+    // Keep the lock table and first segment of the region when it is destroyed, for the next region of the same size, alignment and layout,
+    // up to that many of each in the process (0 never does, see cache.hpp)
+    size_t region_cache;
+    // Zero the reclaimed arena blocks in a background thread of the region rather than in the reclaiming one (see ZeroPool)
+    bool zero_thread;
+
+    Config();
+    // Apply the options on top of the current values, returns false on an unknown key or a malformed value
+    bool parse(char const* options);
+    // Defaults overridden by TM_OPTIONS, then by the given options (may be null)
+    static bool load(Config& config, char const* options);
+private:
+    bool set(char const* key, size_t key_len, char const* value, size_t value_len);
+};
@@ -0,0 +1,73 @@
+#include "contention.hpp"
+#include "data-structures.hpp"
+#include <cstring>
+
+bool cm_wait(MemoryRegion* region, Transaction* txn, VersionedWriteLock* lock) {
+    switch (region->config.cm) {
+    case CmPolicy::none:
+        return false;
+    case CmPolicy::karma: {
+        // The holder just tries to commit, waiting for it only makes sense if we have at least as much to lose
+        ThreadSlot* holder = region->reclaimer.peek(lock->owner());
+        uint64_t ours = txn->slot->karma.load(memory_order_relaxed) + txn->read_set.stripes.size() + txn->write_set.size();
+        if (holder && ours < holder->karma.load(memory_order_relaxed)) return false;
+        break;
+    }
+    case CmPolicy::spin:
+    case CmPolicy::backoff:
+        break;
+    }
+    // Spin on reads only, so that waiting does not steal the line from the holder
+    for (size_t i = 0; i < region->config.cm_spins; i++) {
+        if (!lock->isLocked()) return true;
+        cpu_relax();
+    }
+    return !lock->isLocked();
+}
+
+void cm_aborted(MemoryRegion* region, Transaction* txn) {
+    ThreadSlot* slot = txn->slot;
+    // The work of this attempt counts for the next ones
+    if (region->config.cm == CmPolicy::karma) {
+        uint64_t work = txn->read_set.stripes.size() + txn->write_set.size();
+        slot->karma.store(slot->karma.load(memory_order_relaxed) + work, memory_order_relaxed);
+    }
+    if (region->config.cm != CmPolicy::backoff) return;
+
+    // Randomized exponential backoff: wait up to twice as long after each abort in a row, within cm_backoff_max pauses
+    size_t window = min(region->config.cm_backoff_max, size_t{1} << min(slot->aborts_in_row, 20u));
+    if (window == 0) return;
+    // xorshift64, seeded with the owner tag so that threads that conflicted together pick different delays
+    uint64_t x = slot->rng ? slot->rng : txn->owner * 0x9E3779B97F4A7C15ull;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    slot->rng = x;
+    for (size_t i = x % window; i > 0; i--) {
+        cpu_relax();
+    }
+}
+
+void cm_committed(Transaction* txn) {
+    ThreadSlot* slot = txn->slot;
+    if (slot->karma.load(memory_order_relaxed) != 0) slot->karma.store(0, memory_order_relaxed);
+}
+
+bool parse_cm_policy(char const* name, size_t len, CmPolicy& out) {
+    static struct {
+        char const* name;
+        CmPolicy policy;
+    } const policies[] = {
+        {"none", CmPolicy::none},
+        {"spin", CmPolicy::spin},
+        {"backoff", CmPolicy::backoff},
+        {"karma", CmPolicy::karma},
+    };
+    for (auto& entry : policies) {
+        if (strlen(entry.name) == len && strncmp(entry.name, name, len) == 0) {
+            out = entry.policy;
+            return true;
+        }
+    }
+    return false;
+}
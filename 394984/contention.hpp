@@ -0,0 +1,39 @@
+#pragma once
+
+// External headers
+#include <cstddef>
+#include <thread>
+
+using namespace std;
+
+// What a transaction does when it runs into a stripe locked by a committing one
+enum class CmPolicy {
+    none,    // Abort right away
+    spin,    // Spin on the lock for a bounded time, then abort
+    backoff, // spin, and wait a randomized, exponentially growing time after each abort before returning
+    karma    // spin, unless the lock holder did more work than us (counting its aborted attempts), then abort so that it finishes first
+};
+
+// The policies live in contention.cpp, so that only the conflict paths pay for them
+struct MemoryRegion;
+struct Transaction;
+struct VersionedWriteLock;
+
+// Give the lock holder time to finish, true if the lock was seen free, false if the transaction should abort
+bool cm_wait(MemoryRegion* region, Transaction* txn, VersionedWriteLock* lock);
+// Account for an aborted attempt, and back off if the policy wants it
+void cm_aborted(MemoryRegion* region, Transaction* txn);
+// Reset the state of the thread once its transaction committed (aborts_in_row is maintained by the engine, whatever the policy)
+void cm_committed(Transaction* txn);
+
+// Busy-wait hint for spin loops
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    this_thread::yield();
+#endif
+}
+
+// CmPolicy from its name, false if unknown
+bool parse_cm_policy(char const* name, size_t len, CmPolicy& out);
@@ -1,76 +1,578 @@
 #include "data-structures.hpp"
+#include "cache.hpp"
 #include <sstream>
 #include <iostream>
 #include <cstring>
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-Transaction::Transaction(version gvc, bool is_ro_): rv{gvc}, is_ro{is_ro_} {}
+Transaction::Transaction(version gvc, bool is_ro_, size_t word_size): rv{gvc}, slot{nullptr}, is_ro{is_ro_}, in_htm{false}, irrevocable{false}, htm_wv{0} {
+    read_values.reset(word_size);
+    write_set.reset(word_size);
+    undo.reset(word_size);
+}
 
 Transaction::~Transaction() {
-    // Free all of the segments so that they don't appear to the other transactions
-    for (auto& seg : seg_list) {
-        free(seg);
+    clear();
+}
+
+void Transaction::reset(version gvc, bool is_ro_, size_t word_size) {
+    rv = gvc;
+    is_ro = is_ro_;
+    in_htm = false;
+    irrevocable = false;
+    htm_wv = 0;
+    read_values.reset(word_size);
+    write_set.reset(word_size);
+    undo.reset(word_size);
+}
+
+ReadSet::ReadSet(): epoch{1} {}
+
+void ReadSet::reset(size_t nb_stripes) {
+    // A new region may have a different number of stripes
+    if (tags.size() != nb_stripes) {
+        tags.assign(nb_stripes, 0);
+        epoch = 1;
+    }
+}
+
+void ReadSet::clear() {
+    stripes.clear();
+    // Moving to the next epoch forgets every tag at once, we only wipe them when the counter wraps around
+    if (++epoch == 0) {
+        fill(tags.begin(), tags.end(), 0);
+        epoch = 1;
+    }
+}
+
+void ReadSet::truncate(size_t count) {
+    // The forgotten stripes may be read again, they must not look recorded
+    for (size_t i = count; i < stripes.size(); i++) {
+        if (stripes[i] < tags.size()) tags[stripes[i]] = 0;
+    }
+    stripes.resize(count);
+}
+
+void Transaction::clear() {
+    // Give back all of the segments so that they don't appear to the other transactions
+    // Writes only reach the memory on commit (encounter-time locking rolls them back before), so the arena blocks are still zeroed
+    for (SegmentHeader* seg = seg_list.head.next; seg != &seg_list.head; ) {
+        SegmentHeader* next = seg->next;
+        slot->arena.recycle(seg);
+        seg = next;
     }
     seg_list.clear();
+    large_segs.free_all();
+    frees.clear();
+    savepoint.held = false;
+    // clear() keeps the bucket arrays around for the next transaction
+    read_set.clear();
+    read_values.clear();
+    write_set.clear();
+    write_stripes.clear();
+    undo.clear();
 }
 
-MemoryRegion::MemoryRegion(size_t size_, size_t align_): size{size_}, align{align_}, locks{nullptr}, start{nullptr} {}
+Transaction* DescriptorPool::acquire(version gvc, bool is_ro, size_t word_size) {
+    if (cached.empty()) return new(nothrow) Transaction(gvc, is_ro, word_size);
+    Transaction* txn = cached.back();
+    cached.pop_back();
+    txn->reset(gvc, is_ro, word_size);
+    return txn;
+}
+
+void DescriptorPool::release(Transaction* txn) {
+    txn->clear();
+    // A thread normally runs one transaction at a time, so only keep a handful of descriptors around
+    if (cached.size() < MAX_CACHED) {
+        cached.push_back(txn);
+    } else {
+        delete txn;
+    }
+}
+
+DescriptorPool::~DescriptorPool() {
+    for (auto txn : cached) {
+        delete txn;
+    }
+}
+
+MemoryRegion::MemoryRegion(size_t size_, size_t align_): size{size_}, align{align_}, seg_header{(sizeof(SegmentHeader) + align_ - 1) & ~(align_ - 1)}, ops{nullptr}, htm{false}, locks{nullptr}, lock_mask{0}, lock_shift{0}, lock_stride_bits{0}, span_base{0}, span_range{0}, span_bits{0}, slab_grain_bits{0}, start{nullptr}, locks_mapped{0}, start_mapped{0}, locks_backing{Backing::heap}, start_backing{Backing::heap} {}
+
+// n is bounded by the options (see CONFIG_MAX_LOCKS), far below the 2^63 where the result would wrap around
+static size_t next_pow2(size_t n) {
+    size_t res = 1;
+    while (res < n) res <<= 1;
+    return res;
+}
+
+bool MemoryRegion::init_locks() {
+    // Every lock covers a grain of contiguous bytes, one word unless configured otherwise
+    size_t grain = max(align, config.lock_grain);
+
+    // By default we aim for one stripe per grain of the first segment, within reasonable bounds since more segments get allocated later
+    size_t count = config.locks;
+    if (count == 0) count = min(max(size / grain, MIN_LOCKS), MAX_LOCKS);
+    count = next_pow2(count);
+
+    lock_mask = count - 1;
+    lock_shift = __builtin_ctzl(grain);
+    lock_stride_bits = __builtin_ctzl(config.lock_pad ? CACHE_LINE : sizeof(VersionedWriteLock));
+
+    size_t bytes = count << lock_stride_bits;
+    if (config.region_cache) {
+        CachedBlock block{nullptr, bytes, CACHE_LINE, maps(bytes), Backing::heap, config.pages, config.numa, 0};
+        if (region_cache.take(region_cache.locks, block)) {
+            locks = static_cast<char*>(block.ptr);
+            locks_mapped = block.mapped ? bytes : 0;
+            locks_backing = block.backing;
+            // Every lock is free, at a version of the regions that used the table before: our snapshots start after them
+            clock.catch_up(0, block.top);
+            return true;
+        }
+    }
+    if (maps(bytes)) {
+        // A fresh mapping is already zeroed, i.e. every lock is free at version 0, and nothing touches it before the transactions do
+        locks = static_cast<char*>(map_pages(bytes, config.pages, config.numa, locks_backing));
+        if (unlikely(!locks)) return false;
+        locks_mapped = bytes;
+        return true;
+    }
+    locks = static_cast<char*>(aligned_alloc(CACHE_LINE, bytes));
+    if (unlikely(!locks)) return false;
+    // A zeroed lock is free at version 0, as in the mappings, so one memset does the work of constructing every lock
+    memset(locks, 0, bytes);
+    return true;
+}
+
+bool MemoryRegion::init_start() {
+    slab_source.pages = config.pages;
+    slab_source.numa = config.numa;
+    // Slabs hold the blocks, which are aligned on their size, so they cannot serve larger alignments
+    if (config.segment_locks && align <= SlabArena::SLAB_SIZE) {
+        unsigned slab_bits = __builtin_ctzl(SlabArena::SLAB_SIZE);
+        slab_grain_bits = slab_bits - lock_shift;
+        span_bits = max(slab_bits, slab_grain_bits + lock_stride_bits) + 1;
+        // Stripes are 32-bit in the read and write sets
+        size_t max_spans = ((size_t{1} << 32) - nb_locks()) >> slab_grain_bits;
+        size_t spans = min((config.segment_locks + (size_t{1} << span_bits) - 1) >> span_bits, max_spans);
+        if (unlikely(!slab_source.reserve(spans << span_bits, span_bits, SlabArena::SLAB_SIZE))) return false;
+        span_base = reinterpret_cast<word>(slab_source.range);
+        span_range = slab_source.range_bytes;
+    }
+    bool map = maps(size) && align <= page_size();
+    if (config.region_cache) {
+        CachedBlock block{nullptr, size, align, map, Backing::heap, config.pages, config.numa, 0};
+        if (region_cache.take(region_cache.starts, block)) {
+            // Zeroed when it was put back
+            start = block.ptr;
+            start_mapped = block.mapped ? size : 0;
+            start_backing = block.backing;
+            return true;
+        }
+    }
+    // Pages are larger than any sensible alignment, the heap takes the others
+    if (map) {
+        start = map_pages(size, config.pages, config.numa, start_backing);
+        if (unlikely(!start)) return false;
+        start_mapped = size;
+        return true;
+    }
+    // We allocate the shared memory buffer such that its words are correctly aligned.
+    start = aligned_alloc(align, size);
+    if (unlikely(!start)) return false;
+    // As required, we zero out the memory
+    memset(start, 0, size);
+    return true;
+}
+
+Backing MemoryRegion::backing() {
+    Backing res = min(locks_mapped ? locks_backing : Backing::heap, start_mapped ? start_backing : Backing::heap);
+    // Without huge pages or segment-local locks the arenas take their slabs from the heap
+    return min(res, config.pages != PageMode::normal || span_range ? slab_source.backing() : Backing::heap);
+}
+
+SegmentHeader* MemoryRegion::alloc_segment(size_t bytes, ThreadSlot* slot) {
+    size_t total = seg_header + bytes;
+    if (likely(total <= SlabArena::MAX_BLOCK)) {
+        // In huge page mode the slabs are carved from the chunks of the region, with segment-local locks from its reserved range
+        SlabSource* source = span_range || (config.pages != PageMode::normal && align <= SlabSource::MAX_SLAB) ? &slab_source : nullptr;
+        return slot->arena.alloc(total, align, source, zero_pool.running() ? &zero_pool : nullptr);
+    }
+
+    SegmentHeader* seg;
+    size_t seg_align = max(align, alignof(SegmentHeader));
+    if (seg_align <= alignof(max_align_t)) {
+        // calloc knows when its memory is fresh from the kernel (as every large block is), and only clears the recycled one
+        seg = static_cast<SegmentHeader*>(calloc(1, total));
+        if (unlikely(!seg)) return nullptr;
+    } else {
+        // aligned_alloc wants a size that is a multiple of the alignment
+        total = (total + seg_align - 1) & ~(seg_align - 1);
+        seg = static_cast<SegmentHeader*>(aligned_alloc(seg_align, total));
+        if (unlikely(!seg)) return nullptr;
+        memset(data(seg), 0, bytes);
+    }
+    seg->size_class = LARGE_SEGMENT;
+    return seg;
+}
+
+void MemoryRegion::reclaim(ThreadSlot* slot) {
+    uint64_t oldest = reclaimer.oldest_active();
+    vector<RetiredSegment>& limbo = slot->limbo;
+    // Epochs are increasing along the limbo list, so the reclaimable segments form a prefix of it
+    size_t count = 0;
+    while (count < limbo.size() && limbo[count].epoch <= oldest) count++;
+    if (count == 0) return;
+    // Arena blocks go back to the arena of this thread, whichever thread allocated them, or are handed over to the zeroing thread
+    bool large = false;
+    bool pooled = zero_pool.running();
+    for (size_t i = 0; i < count; i++) {
+        if (limbo[i].seg->size_class == LARGE_SEGMENT) {
+            large = true;
+        } else if (pooled) {
+            slot->to_zero.push_back(limbo[i].seg);
+        } else {
+            slot->arena.recycle_dirty(limbo[i].seg);
+        }
+    }
+    if (!slot->to_zero.empty()) {
+        zero_pool.give(slot->to_zero);
+        slot->to_zero.clear();
+    }
+    if (large) {
+        // One critical section for the whole batch
+        lock_guard<mutex> guard{list_lock};
+        for (size_t i = 0; i < count; i++) {
+            if (limbo[i].seg->size_class == LARGE_SEGMENT) SegmentList::unlink(limbo[i].seg);
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (limbo[i].seg->size_class == LARGE_SEGMENT) free(limbo[i].seg);
+    }
+    limbo.erase(limbo.begin(), limbo.begin() + count);
+}
+
+bool MemoryRegion::init_history() {
+    if (!config.mvcc) return true;
+    // Hashing stripes onto rings only needs a mask, so both sizes are powers of two
+    size_t rings = config.mvcc_rings;
+    if (rings == 0) rings = min(nb_locks(), MAX_HISTORY_RINGS);
+    return history.init(next_pow2(rings), next_pow2(config.mvcc_depth), align);
+}
 
 MemoryRegion::~MemoryRegion() {
+    // The zeroing thread holds blocks of the arena slabs, it goes first
+    zero_pool.stop();
     // Free all of the segments so when we destroy the TM object
-    for (auto& seg : seg_list) {
-        free(seg);
+    // Retired segments that were not reclaimed yet are still in the list, the arena blocks go with the slabs of the reclaimer
+    segments.free_all();
+    // Remove all of the locks (they are trivially destructible), unless the next region of the same shape can have them
+    // No transaction runs anymore, so every lock is free and no stripe is newer than the next version the clock would give
+    if (locks && config.region_cache) {
+        size_t bytes = nb_locks() << lock_stride_bits;
+        CachedBlock block{locks, bytes, CACHE_LINE, locks_mapped != 0, locks_backing, config.pages, config.numa, clock.read() + 1};
+        if (region_cache.put(region_cache.locks, block, config.region_cache)) {
+            locks = nullptr;
+            locks_mapped = 0;
+        }
+    }
+    if (locks_mapped) {
+        unmap_pages(locks, locks_mapped, locks_backing);
+    } else {
+        free(locks);
     }
-    seg_list.clear();
-    // Remove all of the locks
-    delete[] locks;
 
-    // Delete the initial memory segment
-    free(start);
+    // Delete the initial memory segment, or zero it for the next region
+    if (start && config.region_cache) {
+        bool zeroed = start_mapped && zero_pages(start, start_mapped, start_backing);
+        if (!zeroed) memset(start, 0, size);
+        CachedBlock block{start, size, align, start_mapped != 0, start_backing, config.pages, config.numa, 0};
+        if (region_cache.put(region_cache.starts, block, config.region_cache)) {
+            start = nullptr;
+            start_mapped = 0;
+        }
+    }
+    if (start_mapped) {
+        unmap_pages(start, start_mapped, start_backing);
+    } else {
+        free(start);
+    }
 }
 
-WriteOperation::WriteOperation(char* data, size_t word_size): val{aligned_alloc(word_size, word_size)} {
-    // val holds the data we want to write
-    memcpy(val, data, word_size);
+WriteSet::WriteSet(): word_size{0}, index_bits{0}, indexed{false} {
+    memset(bloom, 0, sizeof(bloom));
 }
 
-WriteOperation::~WriteOperation() {
-    free(val);
+void WriteSet::reset(size_t word_size_) {
+    // The region (and so the alignment) can change between two transactions of the same thread
+    word_size = word_size_;
+}
+
+void WriteSet::clear() {
+    addrs.clear();
+    values.clear();
+    memset(bloom, 0, sizeof(bloom));
+    // Only pay for wiping the index if this transaction was big enough to use it
+    if (indexed) {
+        fill(index.begin(), index.end(), 0);
+        indexed = false;
+    }
+}
+
+void WriteSet::plan() {
+    runs.clear();
+    size_t n = addrs.size();
+    char* const* targets = addrs.data();
+    char const* vals = values.data();
+    bool ascending = true;
+    for (size_t i = 1; ascending && i < n; i++) {
+        ascending = targets[i - 1] < targets[i];
+    }
+    if (!ascending && n >= SORT_MIN) {
+        // Gather the values in address order, so that every run is one copy
+        order.resize(n);
+        for (size_t i = 0; i < n; i++) order[i] = i;
+        sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return addrs[a] < addrs[b]; });
+        sorted_addrs.resize(n);
+        sorted_values.resize(n * word_size);
+        for (size_t k = 0; k < n; k++) {
+            sorted_addrs[k] = addrs[order[k]];
+            memcpy(sorted_values.data() + k * word_size, value(order[k]), word_size);
+        }
+        targets = sorted_addrs.data();
+        vals = sorted_values.data();
+    }
+    for (size_t i = 0; i < n;) {
+        size_t j = i + 1;
+        while (j < n && targets[j] == targets[j - 1] + word_size) j++;
+        runs.push_back({targets[i], vals + i * word_size, (j - i) * word_size});
+        i = j;
+    }
+}
+
+void stream_copy(char* dst, char const* src, size_t bytes) {
+#if defined(__SSE2__)
+    // Plain copy up to the first 16-byte boundary and of the tail, streamed 16-byte stores in between
+    size_t head = min(bytes, (16 - ((word)dst & 15)) & 15);
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    bytes -= head;
+    for (; bytes >= 16; bytes -= 16, dst += 16, src += 16) {
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst), _mm_loadu_si128(reinterpret_cast<__m128i const*>(src)));
+    }
+#endif
+    memcpy(dst, src, bytes);
+}
+
+void stream_fence() {
+#if defined(__SSE2__)
+    _mm_sfence();
+#endif
+}
+
+size_t WriteSet::slot(char* addr) const {
+    // Fibonacci hashing, the top bits are the best mixed ones
+    return ((word)addr * 0x9E3779B97F4A7C15ull) >> (64 - index_bits);
+}
+
+void WriteSet::rebuild() {
+    // Keep the table at most half full
+    size_t bits = max<size_t>(index_bits, 6);
+    while ((size_t{1} << bits) < 2 * addrs.size()) bits++;
+    if (bits != index_bits || !indexed) {
+        index_bits = bits;
+        index.assign(size_t{1} << bits, 0);
+    }
+    size_t mask = index.size() - 1;
+    for (size_t i = 0; i < addrs.size(); i++) {
+        size_t s = slot(addrs[i]);
+        while (index[s] != 0) s = (s + 1) & mask;
+        index[s] = i + 1;
+    }
+    indexed = true;
+}
+
+char* WriteSet::find(char* addr) {
+    if (!indexed) {
+        for (size_t i = 0; i < addrs.size(); i++) {
+            if (addrs[i] == addr) return value(i);
+        }
+        return nullptr;
+    }
+    size_t mask = index.size() - 1;
+    for (size_t s = slot(addr); index[s] != 0; s = (s + 1) & mask) {
+        size_t i = index[s] - 1;
+        if (addrs[i] == addr) return value(i);
+    }
+    return nullptr;
+}
+
+void WriteSet::add_bloom(char* addr) {
+    word h = bloom_hash(addr);
+    for (unsigned n = 0; n < 2; n++) {
+        size_t bit = bloom_bit(h, n);
+        bloom[bit / 64] |= uint64_t{1} << (bit % 64);
+    }
+}
+
+void WriteSet::restore(vector<char> const& saved) {
+    addrs.resize(saved.size() / word_size);
+    values.assign(saved.begin(), saved.end());
+    // Neither the filter nor the index can forget an address, both are built again from the entries left
+    memset(bloom, 0, sizeof(bloom));
+    for (char* addr : addrs) {
+        add_bloom(addr);
+    }
+    if (indexed) {
+        fill(index.begin(), index.end(), 0);
+        indexed = false;
+    }
+    if (addrs.size() > LINEAR_MAX) rebuild();
+}
+
+void WriteSet::push_addr(char* addr) {
+    size_t i = addrs.size();
+    addrs.push_back(addr);
+    add_bloom(addr);
+
+    if (addrs.size() <= LINEAR_MAX) return;
+    if (!indexed || 2 * addrs.size() > index.size()) {
+        rebuild();
+        return;
+    }
+    size_t mask = index.size() - 1;
+    size_t s = slot(addr);
+    while (index[s] != 0) s = (s + 1) & mask;
+    index[s] = i + 1;
+}
+
+Reclaimer::Reclaimer() {
+    for (auto& chunk : chunks) {
+        chunk.store(nullptr, memory_order_relaxed);
+    }
+}
+
+Reclaimer::~Reclaimer() {
+    for (auto& chunk : chunks) {
+        delete[] chunk.load(memory_order_relaxed);
+    }
+}
+
+ThreadSlot* Reclaimer::slot(word owner) {
+    size_t c = owner / CHUNK;
+    ThreadSlot* chunk = chunks[c].load(memory_order_acquire);
+    if (unlikely(!chunk)) {
+        // Several threads of the same chunk may race to allocate it, the losers drop their copy
+        ThreadSlot* fresh = new(nothrow) ThreadSlot[CHUNK];
+        if (unlikely(!fresh)) return nullptr;
+        if (chunks[c].compare_exchange_strong(chunk, fresh)) {
+            chunk = fresh;
+        } else {
+            delete[] fresh;
+        }
+        size_t used = nb_chunks.load();
+        while (used <= c && !nb_chunks.compare_exchange_weak(used, c + 1)) {}
+    }
+    return &chunk[owner % CHUNK];
+}
+
+void Reclaimer::retire(ThreadSlot* slot, vector<SegmentHeader*> const& segs) {
+    // Transactions that announce the new epoch began after this commit, so they cannot reach the freed segments
+    uint64_t e = epoch.fetch_add(1) + 1;
+    for (SegmentHeader* seg : segs) {
+        slot->limbo.push_back({seg, e});
+    }
+}
+
+uint64_t Reclaimer::oldest_active() const {
+    uint64_t oldest = UINT64_MAX;
+    size_t used = nb_chunks.load();
+    for (size_t c = 0; c < used; c++) {
+        ThreadSlot* chunk = chunks[c].load(memory_order_acquire);
+        if (!chunk) continue;
+        for (size_t i = 0; i < CHUNK; i++) {
+            uint64_t e = chunk[i].announce.load();
+            if (e != 0 && e < oldest) oldest = e;
+        }
+    }
+    return oldest;
+}
+
+void Reclaimer::drain_commits(ThreadSlot* self) const {
+    size_t used = nb_chunks.load();
+    for (size_t c = 0; c < used; c++) {
+        ThreadSlot* chunk = chunks[c].load(memory_order_acquire);
+        if (!chunk) continue;
+        for (size_t i = 0; i < CHUNK; i++) {
+            if (&chunk[i] == self) continue;
+            for (unsigned spins = 0; chunk[i].committing.load(); spins++) {
+                // Commits are short, only a preempted committer takes long
+                if (spins < 64) {
+                    cpu_relax();
+                } else {
+                    this_thread::yield();
+                }
+            }
+        }
+    }
 }
 
 VersionedWriteLock::VersionedWriteLock(): version_and_lock{0} {};
 
-bool VersionedWriteLock::lock() {
+bool VersionedWriteLock::lock(word owner) {
     // A possible optimization is to spin while continually checking the lock. I found that in our case it is better to just restart the transaction.
-    word expected, desired;
-    // We hope the lock bit is not set
-    expected = version_and_lock.load() & ~1;
-    // We want the same timestamp but with the lock bit set
-    desired = expected | 1;  
-
-    if (version_and_lock.compare_exchange_weak(expected, desired)) {
-        // Successfully took the lock
-        return true;
-    }
-    // We failed to take the lock, so exit
-    return false;
+    word expected = version_and_lock.load();
+    // If the lock bit is set we fail right away
+    if (expected & 1) return false;
+    // We want the same timestamp but with the lock bit and our tag set
+    word desired = expected | (owner << 1) | 1;
+
+    // Successfully took the lock, or failed to take it
+    return version_and_lock.compare_exchange_strong(expected, desired);
 }
 
 
 void VersionedWriteLock::unlock() {
     word current = version_and_lock.load();
-    word new_value = (current & ~1u);  // Clear the lock bit
+    word new_value = current & ~(OWNER_MASK | 1);  // Clear the lock bit and the owner
     version_and_lock.store(new_value);
 }
 
-word VersionedWriteLock::getVersion() {
-    return version_and_lock.load() >> 1;
+void VersionedWriteLock::setVersion(version v) {
+    word new_val = v << VERSION_SHIFT; // Set the version and unlock
+    version_and_lock.store(new_val);
 }
 
-bool VersionedWriteLock::isLocked() {
-    return version_and_lock.load() & 0x1;
-}
+// Tags of the threads that exited, handed out again before new ones
+static mutex owner_tags_lock;
+static vector<word> free_owner_tags;
+static word next_owner_tag = 1;
 
-void VersionedWriteLock::setVersion(version v) {
-    word new_val = v << 1 | 0; // Set the version and unlock
-    version_and_lock.store(new_val);
+// Holds the tag of a thread for its whole lifetime
+struct OwnerTag {
+    word tag;
+    OwnerTag(): tag{0} {
+        lock_guard<mutex> guard{owner_tags_lock};
+        if (!free_owner_tags.empty()) {
+            tag = free_owner_tags.back();
+            free_owner_tags.pop_back();
+        } else if (next_owner_tag <= MAX_OWNERS) {
+            tag = next_owner_tag++;
+        }
+    }
+    ~OwnerTag() {
+        if (tag == 0) return;
+        lock_guard<mutex> guard{owner_tags_lock};
+        free_owner_tags.push_back(tag);
+    }
+};
+
+word owner_tag() {
+    static thread_local OwnerTag tag;
+    return tag.tag;
 }
@@ -1,63 +1,377 @@
 #pragma once
 
 // External headers
-#include <unordered_set>
-#include <unordered_map>
-#include <map>
-#include <list>
 #include <atomic>
+#include <cstring>
 #include <mutex>
 #include <memory>
+#include <vector>
 
 // Internal headers
 #include <tm.hpp>
+#include "arena.hpp"
+#include "clock.hpp"
+#include "combine.hpp"
+#include "config.hpp"
+#include "mvcc.hpp"
 #include "macros.hpp"
 
 using namespace std;
 
-using word = uintptr_t;
+// Bounds of the lock count picked when the configuration leaves it to us
+constexpr size_t MIN_LOCKS = size_t{1} << 14;
+constexpr size_t MAX_LOCKS = size_t{1} << 20;
 
-using version = uint64_t;
+constexpr size_t CACHE_LINE = 64;
 
-constexpr size_t NUM_LOCKS = 10000;
+// Lock tables and first segments from this size on are mapped rather than cleared by hand: the kernel hands out zero pages, and only backs the ones that get touched
+constexpr size_t MAP_MIN = size_t{1} << 17;
+
+// Bound of the number of history rings picked when the configuration leaves it to us
+constexpr size_t MAX_HISTORY_RINGS = size_t{1} << 16;
+
+// Width of the write set signature, override with e.g. 'make BLOOM_BITS=256'
+#ifndef TM_BLOOM_BITS
+    #define TM_BLOOM_BITS 128
+#endif
+constexpr size_t BLOOM_BITS = TM_BLOOM_BITS;
+static_assert(BLOOM_BITS >= 64 && (BLOOM_BITS & (BLOOM_BITS - 1)) == 0, "BLOOM_BITS must be a power of two, at least 64");
+
+// Layout of a lock word: | version (48 bits) | owner (15 bits) | lock bit |
+// The owner is the tag of the thread holding the lock, which lets a committing transaction recognize its own locks without keeping a set of them.
+constexpr unsigned VERSION_SHIFT = 16;
+constexpr word OWNER_MASK = 0xfffe;
+constexpr word MAX_OWNERS = OWNER_MASK >> 1;
 
 //Our special spinlock which holds a version in addition to the lock bit
 struct VersionedWriteLock {
     atomic<word> version_and_lock;
     VersionedWriteLock();
-    bool lock();
+    bool lock(word owner);
     void unlock();
-    word getVersion();
+    // The accessors used by every read are inlined, so that validating a word is a plain load
+    word getVersion() { return version_and_lock.load() >> VERSION_SHIFT; }
     void setVersion(version v);
-    bool isLocked();
+    bool isLocked() { return version_and_lock.load() & 0x1; }
+    bool isLockedBy(word owner) { return (version_and_lock.load() & (OWNER_MASK | 1)) == ((owner << 1) | 1); }
+    // Tag of the last thread that held the lock
+    word owner() { return (version_and_lock.load() & OWNER_MASK) >> 1; }
+};
+
+// Owner tag of the calling thread (between 1 and MAX_OWNERS), 0 if every tag is taken by a live thread
+word owner_tag();
+
+// A segment freed by a committed transaction, that may only be reclaimed once the epoch it was retired in is over
+struct RetiredSegment {
+    SegmentHeader* seg;
+    uint64_t epoch;
 };
 
+// State of one thread in a region: its epoch-based reclamation state and its allocator.
+// Only the thread holding the owner tag of the slot writes to it, the other threads only read the announcement.
+struct alignas(CACHE_LINE) ThreadSlot {
+    atomic<uint64_t> announce{0}; // Epoch in which the running transaction of the thread began, 0 when it runs none
+    vector<RetiredSegment> limbo; // Segments freed by the thread and not reclaimed yet, in retirement order
+    SlabArena arena;
+    vector<SegmentHeader*> to_zero; // Blocks being handed over to the zero pool, only kept around for its buffer
+    // Contention management (see contention.hpp)
+    atomic<uint64_t> karma{0}; // Work done by the aborted attempts of the current transaction, read by the threads that conflict with it
+    unsigned aborts_in_row{0}; // Aborted attempts since the last commit of the thread
+    uint64_t rng{0};
+    // Set by a writing transaction from the moment it checked that no transaction is irrevocable until it is done committing (see MemoryRegion::irrevocable)
+    atomic<bool> committing{false};
+    // Group commit: the transaction the thread published for the combiner, nullptr once a combiner took it, and what became of it
+    atomic<Transaction*> commit_request{nullptr};
+    atomic<CommitState> commit_state{CommitState::idle};
+    void leave() {
+        announce.store(0, memory_order_release);
+        stop_committing();
+    }
+    void stop_committing() {
+        if (committing.load(memory_order_relaxed)) committing.store(false, memory_order_release);
+    }
+};
+
+// Epoch-based reclamation of the segments freed in a region.
+// Committing a free opens a new epoch, and the segment is reclaimed once no transaction that began in an older epoch is still running: only those could still hold a pointer to it.
+// There is one slot per owner tag, allocated by chunks on first use, so looking one up never takes a lock.
+// A slot outlives the thread that used it, the next thread given the same tag inherits its arena and limbo list.
+struct Reclaimer {
+    static constexpr size_t CHUNK = 64;
+    static constexpr size_t NB_CHUNKS = MAX_OWNERS / CHUNK + 1;
+    // Retired segments a thread lets pile up before trying to reclaim them
+    static constexpr size_t BATCH = 32;
+    atomic<uint64_t> epoch{1};
+    atomic<ThreadSlot*> chunks[NB_CHUNKS];
+    atomic<size_t> nb_chunks{0}; // One past the highest chunk ever allocated
+    Reclaimer();
+    ~Reclaimer();
+    // Slot of the given owner tag, nullptr if it could not be allocated
+    ThreadSlot* slot(word owner);
+    // Slot of the given owner tag if it was ever allocated, nullptr otherwise
+    ThreadSlot* peek(word owner) const {
+        ThreadSlot* chunk = chunks[owner / CHUNK].load(memory_order_acquire);
+        return chunk ? &chunk[owner % CHUNK] : nullptr;
+    }
+    void enter(ThreadSlot* slot) { slot->announce.store(epoch.load()); }
+    // Retire segments freed by a transaction that just committed
+    void retire(ThreadSlot* slot, vector<SegmentHeader*> const& segs);
+    // Oldest epoch of a running transaction, UINT64_MAX if none runs
+    uint64_t oldest_active() const;
+    // Wait until no slot but the given one is committing
+    void drain_commits(ThreadSlot* self) const;
+};
+
+// Word-size specialized read/write paths (see tm.cpp)
+struct WordOps;
+
 // Represents a shared memory region and the locks that protect it
 struct MemoryRegion {
-    list<void*> seg_list;
+    SegmentList segments; // Segments too large for the arenas, allocated by committed transactions
     mutex list_lock;
+    Reclaimer reclaimer;
     size_t size;
     size_t align;
-    VersionedWriteLock* locks;
+    size_t seg_header; // Bytes in front of a segment, a multiple of the alignment
+    Config config;
+    VersionClock clock;
+    WordOps const* ops; // Paths picked for the alignment when the region is created
+    bool htm; // Whether transactions first try to run in hardware
+    VersionHistory history; // Overwritten values, when read-only transactions are multi-version
+    // The lock table holds a power of two number of locks, one every (1 << lock_stride_bits) bytes
+    char* locks;
+    size_t lock_mask;
+    unsigned lock_shift; // Bits of the lock grain, the alignment bits at least (always zero in the addresses so dropped by the hash)
+    unsigned lock_stride_bits;
+    // Segment-local locks: the slabs of the arenas lie in [span_base, span_base + span_range), one at the end of every (1 << span_bits) bytes, behind the locks of its
+    // (1 << slab_grain_bits) grains. Their stripes come after those of the table. span_range is 0 when every lock is in the table.
+    word span_base;
+    size_t span_range;
+    unsigned span_bits;
+    unsigned slab_grain_bits;
     void* start;
+    // Bytes mapped for the lock table and the first segment in NUMA or huge page mode, 0 when they come from the heap
+    size_t locks_mapped;
+    size_t start_mapped;
+    Backing locks_backing;
+    Backing start_backing;
+    SlabSource slab_source; // Slabs of the arenas in huge page mode, from the heap otherwise
+    ZeroPool zero_pool; // Zeroes the reclaimed arena blocks when the region has a zeroing thread
+    // Owner tag of the irrevocable transaction running on the region, 0 if none. While one runs, no other transaction commits:
+    // writers wait for it at commit (or abort, with encounter-time locking, as they hold locks it may need), hardware ones abort.
+    atomic<word> irrevocable{0};
+    CommitCombiner combiner; // Group commit of the writing transactions, when the configuration asks for it
     MemoryRegion(size_t size, size_t align);
     ~MemoryRegion();
+    bool init_locks();
+    bool init_history();
+    bool init_start();
+    // Whether the lock table and the first segment get mappings of their own rather than heap allocations
+    bool mapped() const { return config.numa != NumaMode::off || config.pages != PageMode::normal; }
+    // Whether an allocation of that many bytes is mapped, either because the configuration wants mappings or because it is large enough
+    bool maps(size_t bytes) const { return mapped() || bytes >= MAP_MIN; }
+    // Weakest backing of the lock table, the first segment and the arena slabs
+    Backing backing();
+    // Allocate a zeroed segment of the given size from the arena of the calling thread, or on its own if it is too large, return its header
+    SegmentHeader* alloc_segment(size_t bytes, ThreadSlot* slot);
+    void* data(SegmentHeader* seg) const { return reinterpret_cast<char*>(seg) + seg_header; }
+    SegmentHeader* header(void* data) const { return reinterpret_cast<SegmentHeader*>(static_cast<char*>(data) - seg_header); }
+    // Unlink and free the retired segments of a thread that no running transaction can access anymore
+    void reclaim(ThreadSlot* slot);
+    size_t nb_locks() const { return lock_mask + 1; }
+    // Index of the lock stripe protecting the given address
+    size_t stripe(void const* addr) const {
+        word offset = (word)addr - span_base;
+        if (offset < span_range) return lock_mask + 1 + (((offset >> span_bits) << slab_grain_bits) | ((offset & (SlabArena::SLAB_SIZE - 1)) >> lock_shift));
+        return ((word)addr >> lock_shift) & lock_mask;
+    }
+    // First address past the grain of the given address, i.e. where the next stripe starts
+    char* stripe_end(char const* addr) const { return reinterpret_cast<char*>(((word)addr | ((word{1} << lock_shift) - 1)) + 1); }
+    VersionedWriteLock* lock(size_t stripe) const {
+        if (likely(stripe <= lock_mask)) return reinterpret_cast<VersionedWriteLock*>(locks + (stripe << lock_stride_bits));
+        size_t grain = stripe - lock_mask - 1;
+        return reinterpret_cast<VersionedWriteLock*>(span_base + ((grain >> slab_grain_bits) << span_bits) + ((grain & ((size_t{1} << slab_grain_bits) - 1)) << lock_stride_bits));
+    }
 };
 
-struct WriteOperation {
-    void* val;
-    WriteOperation(char* data, size_t word_size);
-    ~WriteOperation();
+// Copy one word. W is the word size when known at compile time, so that the copy becomes a single load and store, or 0 to use the runtime size.
+template<size_t W> inline void copy_word(void* dst, void const* src, size_t word_size) {
+    if constexpr (W == 0) {
+        memcpy(dst, src, word_size);
+    } else {
+        (void) word_size;
+        memcpy(dst, src, W);
+    }
+}
+
+// Copy with non-temporal stores where the CPU has them, for write-backs too large to be worth keeping in the cache.
+// The stores are weakly ordered: stream_fence must come before anything that publishes them, e.g. the versions of the stripes.
+void stream_copy(char* dst, char const* src, size_t bytes);
+void stream_fence();
+
+// Contiguous words of a write set, with their values
+struct WriteRun {
+    char* addr;
+    char const* values;
+    size_t bytes;
+};
+
+// Redo log of a transaction. The target addresses and the values (word_size bytes each, stored inline) live in two contiguous buffers.
+// Small sets are searched linearly, larger ones get an open-addressing index on top, so that neither lookups nor the commit write-back chase pointers.
+// A small Bloom filter over the addresses lets reads of words that were never written skip the lookup entirely.
+struct WriteSet {
+    static constexpr size_t LINEAR_MAX = 16;
+    // Sets written out of address order get sorted for the write-back from this size on
+    static constexpr size_t SORT_MIN = 32;
+    size_t word_size;
+    vector<char*> addrs;
+    vector<char> values;
+    vector<uint32_t> index; // Position + 1 of the entry in addrs, 0 for an empty slot
+    size_t index_bits;
+    bool indexed;
+    uint64_t bloom[BLOOM_BITS / 64];
+    // Write-back plan (see plan), and the words and values in address order when the set had to be sorted
+    vector<WriteRun> runs;
+    vector<uint32_t> order;
+    vector<char*> sorted_addrs;
+    vector<char> sorted_values;
+    WriteSet();
+    void reset(size_t word_size_);
+    void clear();
+    // False if the address is certainly not in the set
+    bool may_contain(char* addr) const {
+        word h = bloom_hash(addr);
+        return test_bit(bloom_bit(h, 0)) && test_bit(bloom_bit(h, 1));
+    }
+    char* find(char* addr);
+    // Split the set into maximal runs of contiguous words, in increasing address order if it is large enough to be worth sorting.
+    // Called before the commit takes its locks, so that the write-back under them is a handful of copies.
+    void plan();
+    // Add a word to the set, or overwrite its value if it is already in it (see copy_word for W)
+    template<size_t W> void insert(char* addr, char const* val) {
+        // Writing the same word twice only keeps the last value
+        char* existing = may_contain(addr) ? find(addr) : nullptr;
+        if (existing) {
+            copy_word<W>(existing, val, word_size);
+            return;
+        }
+        values.insert(values.end(), val, val + (W ? W : word_size));
+        push_addr(addr);
+    }
+    size_t size() const { return addrs.size(); }
+    bool empty() const { return addrs.empty(); }
+    char* value(size_t i) { return values.data() + i * word_size; }
+    // Go back to the first entries of the set, with the given values (see Savepoint::written)
+    void restore(vector<char> const& saved);
+private:
+    static constexpr unsigned BLOOM_LOG = __builtin_ctzl(BLOOM_BITS);
+    // The two filter bits of an address are the two top BLOOM_LOG-bit slices of its hash
+    static word bloom_hash(char* addr) { return ((word)addr * 0x9E3779B97F4A7C15ull) >> (64 - 2 * BLOOM_LOG); }
+    static size_t bloom_bit(word h, unsigned n) { return (h >> (n * BLOOM_LOG)) & (BLOOM_BITS - 1); }
+    bool test_bit(size_t bit) const { return bloom[bit / 64] >> (bit % 64) & 1; }
+    size_t slot(char* addr) const;
+    void add_bloom(char* addr);
+    void rebuild();
+    // Record the address of a new entry, whose value was just appended
+    void push_addr(char* addr);
+};
+
+// Read set of a transaction, recorded as the indices of the lock stripes that were read rather than the addresses themselves.
+// Every stripe of the lock table is appended once: tags[stripe] holds the epoch of the transaction that last recorded it, so clearing the set never has to wipe the tag array.
+struct ReadSet {
+    vector<uint32_t> stripes;
+    vector<uint32_t> tags;
+    uint32_t epoch;
+    ReadSet();
+    void reset(size_t nb_stripes);
+    void clear();
+    // Forget the stripes recorded after the first 'count' ones
+    void truncate(size_t count);
+    void insert(size_t stripe) {
+        // The stripes of the segment-local locks have no tags, only repeated reads of the same one are merged
+        if (unlikely(stripe >= tags.size())) {
+            if (stripes.empty() || stripes.back() != stripe) stripes.push_back(stripe);
+            return;
+        }
+        if (tags[stripe] == epoch) return;
+        tags[stripe] = epoch;
+        stripes.push_back(stripe);
+    }
+};
+
+// Words a transaction read from the shared memory, with the values it read, so that it can revalidate by value (see Config::value_check)
+struct ValueLog {
+    size_t word_size;
+    vector<char*> addrs;
+    vector<char> values;
+    ValueLog(): word_size{0} {}
+    void reset(size_t word_size_) {
+        word_size = word_size_;
+        clear();
+    }
+    void clear() {
+        addrs.clear();
+        values.clear();
+    }
+    size_t size() const { return addrs.size(); }
+    char* value(size_t i) { return values.data() + i * word_size; }
+    // Log a word and the value read from it (W is the word size when known at compile time, 0 otherwise)
+    template<size_t W> void push(char* addr, char const* val) {
+        values.insert(values.end(), val, val + (W ? W : word_size));
+        addrs.push_back(addr);
+    }
+    // Drop the words logged after the first 'count' ones
+    void truncate(size_t count) {
+        addrs.resize(count);
+        values.resize(count * word_size);
+    }
+};
+
+// Point a transaction can go back to instead of aborting as a whole (see tm_savepoint): the sizes of its logs when it was taken,
+// and the last segments it allocated before it (the list sentinels if none)
+struct Savepoint {
+    bool held;
+    size_t reads;
+    size_t values_read;
+    size_t frees;
+    SegmentHeader* segs;
+    SegmentHeader* large_segs;
+    vector<char> written; // Values of the write set, which later writes to the same words overwrite in place
+    Savepoint(): held{false}, reads{0}, values_read{0}, frees{0}, segs{nullptr}, large_segs{nullptr} {}
 };
 
 struct Transaction {
     version rv;
-    unordered_set<char*> read_set;
-    unordered_map<char*, unique_ptr<WriteOperation>> write_set;
-    list<void*> seg_list;
+    word owner;
+    ReadSet read_set;
+    ValueLog read_values; // Only kept when the region revalidates by value
+    WriteSet write_set;
+    // Commit-time locking: sorted, unique stripes of the write set, while committing.
+    // Encounter-time locking: the stripes locked so far, in locking order, with the previous values of the words written to them in the undo log.
+    vector<uint32_t> write_stripes;
+    UndoLog undo;
+    SegmentList seg_list; // Arena blocks allocated by the transaction, recycled if it aborts
+    SegmentList large_segs; // Segments allocated on their own by the transaction, freed if it aborts
+    vector<SegmentHeader*> frees; // Segments freed by the transaction, retired if it commits
+    Savepoint savepoint;
+    ThreadSlot* slot;
     bool is_ro;
-    Transaction(version gvc, bool is_ro_);
+    bool in_htm; // Running as a hardware transaction, with no read or write set
+    bool irrevocable; // Running alone, in place, and bound to commit: the stripes it wrote are in write_stripes, and the write set holds the values it overwrote when the region keeps a history
+    version htm_wv; // Version the hardware transaction gives the stripes it writes, 0 until its first write
+    Transaction(version gvc, bool is_ro_, size_t word_size);
     ~Transaction();
+    void reset(version gvc, bool is_ro_, size_t word_size);
+    void clear();
+};
+
+// Per-thread cache of transaction descriptors. Released descriptors are cleared but keep the capacity of their containers, so that the steady state does not go through the allocator on every tm_begin/tm_end.
+struct DescriptorPool {
+    static constexpr size_t MAX_CACHED = 8;
+    vector<Transaction*> cached;
+    Transaction* acquire(version gvc, bool is_ro, size_t word_size);
+    void release(Transaction* txn);
+    ~DescriptorPool();
 };
 
 
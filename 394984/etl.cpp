@@ -0,0 +1,27 @@
+#include "etl.hpp"
+
+bool parse_engine_mode(char const* name, size_t len, EngineMode& out) {
+    static struct {
+        char const* name;
+        EngineMode mode;
+    } const modes[] = {
+        {"tl2", EngineMode::tl2},
+        {"etl", EngineMode::etl},
+    };
+    for (auto& entry : modes) {
+        if (strlen(entry.name) == len && strncmp(entry.name, name, len) == 0) {
+            out = entry.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+void UndoLog::rollback() {
+    char const* val = values.data() + values.size();
+    for (size_t i = addrs.size(); i-- > 0; ) {
+        val -= word_size;
+        memcpy(addrs[i], val, word_size);
+    }
+    clear();
+}
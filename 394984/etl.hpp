@@ -0,0 +1,42 @@
+#pragma once
+
+// External headers
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// How writing transactions lock and update the shared memory
+enum class EngineMode {
+    tl2, // Commit-time locking: writes are buffered in a redo log, whose stripes are locked and written back at commit
+    etl, // Encounter-time locking: the first write to a stripe locks it, values are written in place and an undo log restores them on abort
+};
+
+// EngineMode from its name, false if unknown
+bool parse_engine_mode(char const* name, size_t len, EngineMode& out);
+
+// Undo log of an encounter-time locking transaction: the previous value of every word it wrote in place, in write order.
+// A word written several times is logged every time, rolling back newest first leaves it with its oldest value.
+struct UndoLog {
+    size_t word_size;
+    vector<char*> addrs;
+    vector<char> values;
+    UndoLog(): word_size{0} {}
+    void reset(size_t word_size_) {
+        word_size = word_size_;
+        clear();
+    }
+    void clear() {
+        addrs.clear();
+        values.clear();
+    }
+    size_t size() const { return addrs.size(); }
+    // Log the current value of a word, about to be overwritten (W is the word size when known at compile time, 0 otherwise)
+    template<size_t W> void push(char* addr) {
+        values.insert(values.end(), addr, addr + (W ? W : word_size));
+        addrs.push_back(addr);
+    }
+    // Write every logged value back, newest first
+    void rollback();
+};
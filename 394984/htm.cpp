@@ -0,0 +1,71 @@
+#include "htm.hpp"
+#include "macros.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+// Explicit abort codes
+constexpr unsigned HTM_CODE_CONFLICT = 1;
+constexpr unsigned HTM_CODE_FALLBACK = 2;
+
+bool htm_supported() {
+    // RTM is bit 11 of EBX in the structured extended feature leaf
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+    return ebx & (1u << 11);
+}
+
+// The RTM intrinsics need the target attribute, the rest of the library is built for the baseline ISA
+__attribute__((target("rtm"))) unsigned htm_begin() {
+    static_assert(_XBEGIN_STARTED == HTM_STARTED, "HTM_STARTED must match _XBEGIN_STARTED");
+    return _xbegin();
+}
+
+__attribute__((target("rtm"))) void htm_end() {
+    _xend();
+}
+
+__attribute__((target("rtm"))) void htm_abort_conflict() {
+    _xabort(HTM_CODE_CONFLICT);
+    __builtin_unreachable();
+}
+
+__attribute__((target("rtm"))) void htm_abort_fallback() {
+    _xabort(HTM_CODE_FALLBACK);
+    __builtin_unreachable();
+}
+
+bool htm_should_retry(unsigned status) {
+    if (status & _XABORT_EXPLICIT) return _XABORT_CODE(status) == HTM_CODE_CONFLICT;
+    // Capacity and other aborts without the retry hint would just fail again
+    return status & (_XABORT_RETRY | _XABORT_CONFLICT);
+}
+
+#else
+
+bool htm_supported() {
+    return false;
+}
+
+// Never called, since no region enables the hybrid mode without htm_supported()
+unsigned htm_begin() {
+    return 0;
+}
+
+void htm_end() {}
+
+void htm_abort_conflict() {
+    __builtin_unreachable();
+}
+
+void htm_abort_fallback() {
+    __builtin_unreachable();
+}
+
+bool htm_should_retry(unsigned unused(status)) {
+    return false;
+}
+
+#endif
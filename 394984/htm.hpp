@@ -0,0 +1,19 @@
+#pragma once
+
+// Restricted hardware transactional memory, used by the hybrid mode (htm=1).
+// Only Intel RTM is supported: everywhere else htm_supported() is false and the hybrid mode quietly runs every transaction in software.
+
+// Returned by htm_begin when the hardware transaction started, any other value is the abort status of the attempt
+constexpr unsigned HTM_STARTED = ~0u;
+
+// Whether the CPU runs hardware transactions
+bool htm_supported();
+// Start a hardware transaction. If it aborts, execution resumes here with the abort status, and every write done since (stack included) is rolled back.
+unsigned htm_begin();
+void htm_end();
+// Abort the running hardware transaction because of a conflict with a software one, worth retrying in hardware
+[[noreturn]] void htm_abort_conflict();
+// Abort the running hardware transaction because it does something hardware transactions can't, e.g. allocate
+[[noreturn]] void htm_abort_fallback();
+// Whether an attempt that aborted with the given status may succeed if retried in hardware
+bool htm_should_retry(unsigned status);
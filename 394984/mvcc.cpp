@@ -0,0 +1,56 @@
+#include "mvcc.hpp"
+#include <cstring>
+
+VersionHistory::VersionHistory(): ring_mask{0}, depth{0}, word_size{0} {}
+
+bool VersionHistory::init(size_t rings, size_t depth_, size_t word_size_) {
+    depth = depth_;
+    word_size = word_size_;
+    ring_mask = rings - 1;
+    entries.reset(new(nothrow) HistoryEntry[rings * depth]);
+    heads.reset(new(nothrow) atomic<uint32_t>[rings]);
+    values.reset(new(nothrow) char[rings * depth * word_size]);
+    if (!entries || !heads || !values) {
+        entries.reset();
+        return false;
+    }
+    for (size_t i = 0; i < rings; i++) {
+        heads[i].store(0, memory_order_relaxed);
+    }
+    return true;
+}
+
+void VersionHistory::record(size_t stripe, char* addr, char const* value, version from, version until) {
+    size_t ring = (stripe & ring_mask) * depth;
+    HistoryEntry* entry;
+    uint64_t seq;
+    // Claim the oldest entry that no other writer is filling in
+    for (;;) {
+        size_t i = ring + (heads[stripe & ring_mask].fetch_add(1, memory_order_relaxed) & (depth - 1));
+        entry = &entries[i];
+        seq = entry->seq.load(memory_order_relaxed);
+        if (!(seq & 1) && entry->seq.compare_exchange_weak(seq, seq + 1, memory_order_acquire)) break;
+    }
+    entry->addr.store(addr, memory_order_relaxed);
+    entry->from.store(from, memory_order_relaxed);
+    entry->until.store(until, memory_order_relaxed);
+    memcpy(&values[(entry - &entries[0]) * word_size], value, word_size);
+    entry->seq.store(seq + 2, memory_order_release);
+}
+
+bool VersionHistory::find(size_t stripe, char* addr, version rv, char* out) const {
+    size_t ring = (stripe & ring_mask) * depth;
+    for (size_t i = ring; i < ring + depth; i++) {
+        HistoryEntry const& entry = entries[i];
+        uint64_t seq = entry.seq.load(memory_order_acquire);
+        if (seq & 1) continue;
+        if (entry.addr.load(memory_order_relaxed) != addr) continue;
+        // The intervals of the entries of a word are disjoint, so at most one of them holds rv
+        if (entry.from.load(memory_order_relaxed) > rv || entry.until.load(memory_order_relaxed) <= rv) continue;
+        memcpy(out, &values[i * word_size], word_size);
+        // Seqlock check: the entry was not reused while we copied it
+        atomic_thread_fence(memory_order_acquire);
+        if (entry.seq.load(memory_order_relaxed) == seq) return true;
+    }
+    return false;
+}
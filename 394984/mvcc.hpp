@@ -0,0 +1,42 @@
+#pragma once
+
+// External headers
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Internal headers
+#include "clock.hpp"
+
+using namespace std;
+
+// One overwritten value of a word, which was current for the versions [from, until)
+struct HistoryEntry {
+    atomic<uint64_t> seq{0}; // Odd while a writer fills the entry in
+    atomic<char*> addr{nullptr};
+    atomic<version> from{0};
+    atomic<version> until{0};
+};
+
+// Bounded history of the values overwritten by commits, for the multi-version read-only transactions (mvcc=1).
+// Stripes share 'depth' entry rings by hashing, and a ring that is full overwrites its oldest entry: a reader whose snapshot is older than everything a ring holds can still miss.
+// Entries are written under the lock of the stripe of their word, but two stripes can hash to the same ring, so writers claim entries with a CAS on their sequence number.
+struct VersionHistory {
+    unique_ptr<HistoryEntry[]> entries;
+    unique_ptr<atomic<uint32_t>[]> heads; // Next entry to overwrite in each ring
+    unique_ptr<char[]> values; // word_size bytes per entry
+    size_t ring_mask;
+    size_t depth;
+    size_t word_size;
+    VersionHistory();
+    // 'rings' and 'depth' must be powers of two
+    bool init(size_t rings, size_t depth_, size_t word_size_);
+    bool enabled() const { return entries != nullptr; }
+    // Called by a committer holding the lock of the stripe, before it overwrites the word
+    void record(size_t stripe, char* addr, version from, version until) { record(stripe, addr, addr, from, until); }
+    // Same, for a word that was already overwritten, with the value it had before
+    void record(size_t stripe, char* addr, char const* value, version from, version until);
+    // Copy the value the word had at version rv to 'out', false if the history does not hold it anymore
+    bool find(size_t stripe, char* addr, version rv, char* out) const;
+};
@@ -0,0 +1,59 @@
+#include "numa.hpp"
+#include <cstdio>
+#include <cstring>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+bool parse_numa_mode(char const* name, size_t len, NumaMode& out) {
+    static struct {
+        char const* name;
+        NumaMode mode;
+    } const modes[] = {
+        {"off", NumaMode::off},
+        {"local", NumaMode::local},
+        {"interleave", NumaMode::interleave},
+    };
+    for (auto& entry : modes) {
+        if (strlen(entry.name) == len && strncmp(entry.name, name, len) == 0) {
+            out = entry.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Same value as MPOL_INTERLEAVE in <numaif.h>, which only comes with libnuma
+constexpr int NUMA_POLICY_INTERLEAVE = 3;
+constexpr size_t NUMA_MAX_NODES = 1024;
+constexpr size_t NUMA_MASK_WORDS = NUMA_MAX_NODES / (8 * sizeof(unsigned long));
+
+// Mask of the online nodes, from a list like "0-1,4" in sysfs, false if there is no such list or a single node
+static bool online_nodes(unsigned long (&mask)[NUMA_MASK_WORDS]) {
+    memset(mask, 0, sizeof(mask));
+    FILE* file = fopen("/sys/devices/system/node/online", "r");
+    if (!file) return false;
+    size_t count = 0;
+    unsigned first, last;
+    while (fscanf(file, "%u", &first) == 1) {
+        last = first;
+        int sep = fgetc(file);
+        if (sep == '-') {
+            if (fscanf(file, "%u", &last) != 1) break;
+            sep = fgetc(file);
+        }
+        for (unsigned node = first; node <= last && node < NUMA_MAX_NODES; node++) {
+            mask[node / (8 * sizeof(unsigned long))] |= 1ul << (node % (8 * sizeof(unsigned long)));
+            count++;
+        }
+        if (sep != ',') break;
+    }
+    fclose(file);
+    return count > 1;
+}
+
+void numa_place(void* ptr, size_t bytes, NumaMode mode) {
+    if (mode != NumaMode::interleave) return;
+    static unsigned long mask[NUMA_MASK_WORDS];
+    static bool const multi = online_nodes(mask);
+    if (multi) syscall(SYS_mbind, ptr, bytes, NUMA_POLICY_INTERLEAVE, mask, NUMA_MAX_NODES + 1, 0);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+// External headers
+#include <cstddef>
+
+// NUMA placement of the big allocations of a region: its lock table, first segment and the chunks its arenas carve slabs from (see pages.hpp).
+// Placement goes through the mbind system call directly, so the library doesn't depend on libnuma. Where it fails (single node, no NUMA support), the memory is still usable and just stays wherever the kernel puts it.
+enum class NumaMode {
+    off,        // Plain heap allocations, initialized by the creating thread (so they all land on its node)
+    local,      // Fresh mappings that nobody touches up front, every page lands on the node of the first thread that writes it
+    interleave, // Fresh mappings with their pages spread round-robin over every online node
+};
+
+// NumaMode from its name, false if unknown
+bool parse_numa_mode(char const* name, size_t len, NumaMode& out);
+
+// Apply the placement of the mode to a fresh mapping, before anything touches it (local needs nothing, first touch is the default policy)
+void numa_place(void* ptr, size_t bytes, NumaMode mode);
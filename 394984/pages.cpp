@@ -0,0 +1,171 @@
+#include "pages.hpp"
+#include "macros.hpp"
+#include <cstdio>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+
+bool parse_page_mode(char const* name, size_t len, PageMode& out) {
+    static struct {
+        char const* name;
+        PageMode mode;
+    } const modes[] = {
+        {"normal", PageMode::normal},
+        {"thp", PageMode::thp},
+        {"huge", PageMode::huge},
+    };
+    for (auto& entry : modes) {
+        if (strlen(entry.name) == len && strncmp(entry.name, name, len) == 0) {
+            out = entry.mode;
+            return true;
+        }
+    }
+    return false;
+}
+
+char const* backing_name(Backing backing) {
+    switch (backing) {
+    case Backing::heap:
+        return "heap";
+    case Backing::pages:
+        return "pages";
+    case Backing::thp:
+        return "thp";
+    case Backing::hugetlb:
+        return "hugetlb";
+    }
+    return "unknown";
+}
+
+size_t page_size() {
+    static size_t const page = sysconf(_SC_PAGESIZE);
+    return page;
+}
+
+static size_t round_up(size_t bytes, size_t unit) {
+    return (bytes + unit - 1) & ~(unit - 1);
+}
+
+// Whether madvise(MADV_HUGEPAGE) can get transparent huge pages, i.e. they are not disabled system-wide
+static bool thp_available() {
+    static bool const available = [] {
+        FILE* file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+        if (!file) return false;
+        char buf[64] = {};
+        bool res = fgets(buf, sizeof(buf), file) && !strstr(buf, "[never]");
+        fclose(file);
+        return res;
+    }();
+    return available;
+}
+
+void* map_pages(size_t bytes, PageMode mode, NumaMode numa, Backing& backing) {
+    void* ptr = MAP_FAILED;
+    size_t len = round_up(bytes, HUGE_PAGE_SIZE);
+    // Less than a huge page would waste most of one, and faulting it in costs more than the normal pages it replaces
+    if (bytes < HUGE_PAGE_SIZE) mode = PageMode::normal;
+    if (mode == PageMode::huge) {
+        ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) backing = Backing::hugetlb;
+    }
+    if (ptr == MAP_FAILED && mode != PageMode::normal && thp_available()) {
+        // Map one huge page more, and trim both ends so that the mapping starts on a huge page
+        char* raw = static_cast<char*>(mmap(nullptr, len + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (unlikely(raw == MAP_FAILED)) return nullptr;
+        char* aligned = reinterpret_cast<char*>(round_up(reinterpret_cast<size_t>(raw), HUGE_PAGE_SIZE));
+        if (aligned > raw) munmap(raw, aligned - raw);
+        munmap(aligned + len, raw + HUGE_PAGE_SIZE - aligned);
+        madvise(aligned, len, MADV_HUGEPAGE);
+        ptr = aligned;
+        backing = Backing::thp;
+    }
+    if (ptr == MAP_FAILED) {
+        len = round_up(bytes, page_size());
+        ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (unlikely(ptr == MAP_FAILED)) return nullptr;
+        backing = Backing::pages;
+    }
+    // Anonymous mappings are zeroed, and their pages are only backed (and so placed) when first written
+    numa_place(ptr, len, numa);
+    return ptr;
+}
+
+void unmap_pages(void* ptr, size_t bytes, Backing backing) {
+    munmap(ptr, round_up(bytes, backing == Backing::pages ? page_size() : HUGE_PAGE_SIZE));
+}
+
+bool zero_pages(void* ptr, size_t bytes, Backing backing) {
+    // Private anonymous pages come back zeroed on their next touch, placed by the policy of the mapping
+    return madvise(ptr, round_up(bytes, backing == Backing::pages ? page_size() : HUGE_PAGE_SIZE), MADV_DONTNEED) == 0;
+}
+
+void* reserve_pages(size_t bytes, size_t align, PageMode mode, NumaMode numa, Backing& backing) {
+    // Nothing is committed, so asking for more than the memory of the machine is fine
+    char* raw = static_cast<char*>(mmap(nullptr, bytes + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+    if (unlikely(raw == MAP_FAILED)) return nullptr;
+    char* aligned = reinterpret_cast<char*>(round_up(reinterpret_cast<size_t>(raw), align));
+    if (aligned > raw) munmap(raw, aligned - raw);
+    munmap(aligned + bytes, raw + align - aligned);
+    backing = Backing::pages;
+    if (mode != PageMode::normal && thp_available() && madvise(aligned, bytes, MADV_HUGEPAGE) == 0) backing = Backing::thp;
+    numa_place(aligned, bytes, numa);
+    return aligned;
+}
+
+SlabSource::SlabSource(): pages{PageMode::normal}, numa{NumaMode::off}, bump{nullptr}, bump_end{nullptr}, range{nullptr}, range_bytes{0}, span_slab{0}, span_bits{0}, range_backing{Backing::pages} {}
+
+SlabSource::~SlabSource() {
+    for (Chunk& chunk : chunks) {
+        munmap(chunk.ptr, chunk.bytes);
+    }
+    if (range) munmap(range, range_bytes);
+}
+
+bool SlabSource::reserve(size_t bytes, unsigned span_bits_, size_t slab_bytes) {
+    size_t span = size_t{1} << span_bits_;
+    bytes = round_up(bytes, span);
+    // Spans are aligned on their size, so the slab at their end is aligned on its own size too
+    range = static_cast<char*>(reserve_pages(bytes, span, pages, numa, range_backing));
+    if (unlikely(!range)) return false;
+    range_bytes = bytes;
+    span_slab = slab_bytes;
+    span_bits = span_bits_;
+    bump = range;
+    bump_end = range + bytes;
+    return true;
+}
+
+void* SlabSource::take(size_t bytes, size_t align) {
+    lock_guard<mutex> guard{lock};
+    if (span_bits) {
+        // Every slab has its span, the locks in front of it are zeroed like the slab, i.e. free at version 0
+        size_t span = size_t{1} << span_bits;
+        if (unlikely(bytes > span_slab || align > span_slab || bump + span > bump_end)) return nullptr;
+        char* slab = bump + span - span_slab;
+        bump += span;
+        return slab;
+    }
+    char* slab = reinterpret_cast<char*>(round_up(reinterpret_cast<size_t>(bump), align));
+    if (unlikely(!bump || slab + bytes > bump_end)) {
+        // The rest of the current chunk is wasted, at most a slab
+        // Chunks are reserved rather than mapped, so that a new one costs a single mmap and its huge pages are only backed as slabs get used
+        Backing backing;
+        char* chunk = static_cast<char*>(reserve_pages(CHUNK_SIZE, MAX_SLAB, pages, numa, backing));
+        if (unlikely(!chunk)) return nullptr;
+        chunks.push_back({chunk, CHUNK_SIZE, backing});
+        slab = chunk;
+        bump_end = chunk + CHUNK_SIZE;
+    }
+    bump = slab + bytes;
+    return slab;
+}
+
+Backing SlabSource::backing() {
+    lock_guard<mutex> guard{lock};
+    if (span_bits) return range_backing;
+    Backing res = Backing::hugetlb;
+    for (Chunk& chunk : chunks) {
+        res = min(res, chunk.backing);
+    }
+    return res;
+}
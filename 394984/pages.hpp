@@ -0,0 +1,79 @@
+#pragma once
+
+// External headers
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Internal headers
+#include "numa.hpp"
+
+using namespace std;
+
+// Page size of the big allocations of a region: its lock table, first segment and arena slabs.
+enum class PageMode {
+    normal, // Heap allocations, unless the NUMA mode wants mappings
+    thp,    // Mappings aligned on huge pages, with the transparent huge page hint
+    huge,   // Mappings from the huge page pool (MAP_HUGETLB), falling back to thp then to normal pages when the pool is empty
+};
+
+// What a mapping actually got, from the weakest to the strongest
+enum class Backing {
+    heap,    // The heap allocator
+    pages,   // Anonymous mapping of normal pages
+    thp,     // Anonymous mapping the kernel may back with transparent huge pages
+    hugetlb, // Huge pages of the pool
+};
+
+constexpr size_t HUGE_PAGE_SIZE = size_t{1} << 21;
+
+// PageMode from its name, false if unknown
+bool parse_page_mode(char const* name, size_t len, PageMode& out);
+char const* backing_name(Backing backing);
+size_t page_size();
+
+// Zeroed mapping of at least 'bytes' bytes, aligned on a page (on a huge page unless it fell back to normal pages), placed as the NUMA mode says.
+// Sets the backing it got, returns nullptr if out of memory.
+void* map_pages(size_t bytes, PageMode mode, NumaMode numa, Backing& backing);
+// Unmap what map_pages returned, given the same size and the backing it got
+void unmap_pages(void* ptr, size_t bytes, Backing backing);
+// Give back the pages of what map_pages returned, which then reads as zeroes again, false if the kernel would not
+bool zero_pages(void* ptr, size_t bytes, Backing backing);
+// Zeroed range of address space aligned on 'align' (a power of two), whose pages are only backed when first written, or nullptr.
+// Huge pages come from transparent huge pages only (the pool cannot be reserved lazily), and the range goes back with munmap(ptr, bytes).
+void* reserve_pages(size_t bytes, size_t align, PageMode mode, NumaMode numa, Backing& backing);
+
+// Shared source of arena slabs, carved out of large chunks of address space reserved with reserve_pages, so that segments allocated by transactions share the TLB entries of their huge pages.
+// Slabs live as long as the region, like the slabs of the heap.
+struct SlabSource {
+    static constexpr size_t MAX_SLAB = HUGE_PAGE_SIZE; // Largest slab size and alignment, chunks are aligned on it
+    static constexpr size_t CHUNK_SIZE = size_t{1} << 30;
+    struct Chunk {
+        void* ptr;
+        size_t bytes;
+        Backing backing;
+    };
+    PageMode pages;
+    NumaMode numa;
+    mutex lock; // Slabs are only taken once every few hundred allocations of a thread, a lock is enough
+    char* bump; // Next free byte of the current chunk
+    char* bump_end;
+    vector<Chunk> chunks;
+    // Segment-local locks (see Config::segment_locks): slabs are carved out of one range reserved up front instead, each at the end of a span
+    // of (1 << span_bits) bytes whose front holds the locks of its grains. span_bits is 0 otherwise.
+    char* range;
+    size_t range_bytes;
+    size_t span_slab; // Bytes of the slab of every span
+    unsigned span_bits;
+    Backing range_backing;
+    SlabSource();
+    SlabSource(SlabSource const&) = delete;
+    SlabSource& operator=(SlabSource const&) = delete;
+    ~SlabSource();
+    // Zeroed slab of the given size and alignment (both at most MAX_SLAB), nullptr if out of memory
+    void* take(size_t bytes, size_t align);
+    // Switch to a range of spans of the given size holding slabs of the given size at their end, false if it could not be reserved
+    bool reserve(size_t bytes, unsigned span_bits_, size_t slab_bytes);
+    // Weakest backing among the chunks, Backing::hugetlb if there is none yet
+    Backing backing();
+};
@@ -0,0 +1,136 @@
+#include "stats.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Every thread's counters, kept after the thread exits so that the totals stay exact
+static mutex registry_lock;
+static vector<unique_ptr<ThreadCounters>> registry;
+
+ThreadCounters& thread_counters() {
+    static thread_local ThreadCounters* counters = nullptr;
+    if (unlikely(!counters)) {
+        lock_guard<mutex> guard{registry_lock};
+        registry.push_back(make_unique<ThreadCounters>());
+        counters = registry.back().get();
+    }
+    return *counters;
+}
+
+// Name to member mapping of the counters
+static struct {
+    char const* name;
+    Counter ThreadCounters::* counter;
+} const counter_names[] = {
+    {"commits", &ThreadCounters::commits},
+    {"commits.ro", &ThreadCounters::commits_ro},
+    {"aborts", &ThreadCounters::aborts},
+    {"aborts.read.locked", &ThreadCounters::aborts_read_locked},
+    {"aborts.read.stale", &ThreadCounters::aborts_read_stale},
+    {"aborts.read.changed", &ThreadCounters::aborts_read_changed},
+    {"aborts.read.history", &ThreadCounters::aborts_read_history},
+    {"aborts.write.locked", &ThreadCounters::aborts_write_locked},
+    {"aborts.write.stale", &ThreadCounters::aborts_write_stale},
+    {"aborts.commit.lock", &ThreadCounters::aborts_commit_lock},
+    {"aborts.commit.validate", &ThreadCounters::aborts_commit_validate},
+    {"group.batches", &ThreadCounters::group_batches},
+    {"group.members", &ThreadCounters::group_members},
+    {"clock.ticks", &ThreadCounters::clock_ticks},
+    {"irrevocable", &ThreadCounters::irrevocable},
+    {"irrevocable.waits", &ThreadCounters::irrevocable_waits},
+    {"bloom.probes", &ThreadCounters::bloom_probes},
+    {"bloom.hits", &ThreadCounters::bloom_hits},
+    {"bloom.false_positives", &ThreadCounters::bloom_false_positives},
+    {"extensions", &ThreadCounters::extensions},
+    {"extension_failures", &ThreadCounters::extension_failures},
+    {"value_checks", &ThreadCounters::value_checks},
+    {"value_check_failures", &ThreadCounters::value_check_failures},
+    {"htm.commits", &ThreadCounters::htm_commits},
+    {"htm.aborts", &ThreadCounters::htm_aborts},
+    {"htm.fallbacks", &ThreadCounters::htm_fallbacks},
+    {"mvcc.history_reads", &ThreadCounters::mvcc_history_reads},
+    {"mvcc.misses", &ThreadCounters::mvcc_misses},
+    {"savepoints", &ThreadCounters::savepoints},
+    {"savepoint.rollbacks", &ThreadCounters::savepoint_rollbacks},
+    {"savepoint.failures", &ThreadCounters::savepoint_failures},
+};
+
+static struct {
+    char const* name;
+    Histogram ThreadCounters::* histogram;
+} const histogram_names[] = {
+    {"read_set.size", &ThreadCounters::read_set_sizes},
+    {"write_set.size", &ThreadCounters::write_set_sizes},
+};
+
+// Callers hold registry_lock
+static uint64_t sum_locked(Counter ThreadCounters::* counter) {
+    uint64_t sum = 0;
+    for (auto& counters : registry) {
+        sum += ((*counters).*counter).get();
+    }
+    return sum;
+}
+
+static uint64_t sum_locked(Histogram ThreadCounters::* histogram, size_t bucket) {
+    uint64_t sum = 0;
+    for (auto& counters : registry) {
+        sum += ((*counters).*histogram).buckets[bucket].get();
+    }
+    return sum;
+}
+
+bool sum_counter(char const* name, uint64_t& out) {
+    for (auto& entry : counter_names) {
+        if (strcmp(entry.name, name) != 0) continue;
+        lock_guard<mutex> guard{registry_lock};
+        out = sum_locked(entry.counter);
+        return true;
+    }
+    for (auto& entry : histogram_names) {
+        size_t len = strlen(entry.name);
+        if (strncmp(entry.name, name, len) != 0 || name[len] != '.') continue;
+        char* end;
+        unsigned long bound = strtoul(name + len + 1, &end, 10);
+        if (*end != '\0') return false;
+        for (size_t bucket = 0; bucket < Histogram::BUCKETS; bucket++) {
+            if (Histogram::lower_bound(bucket) != bound) continue;
+            lock_guard<mutex> guard{registry_lock};
+            out = sum_locked(entry.histogram, bucket);
+            return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+string format_counters() {
+    string res;
+    char line[128];
+    lock_guard<mutex> guard{registry_lock};
+    for (auto& entry : counter_names) {
+        snprintf(line, sizeof(line), "%s %llu\n", entry.name, (unsigned long long) sum_locked(entry.counter));
+        res += line;
+    }
+    for (auto& entry : histogram_names) {
+        for (size_t bucket = 0; bucket < Histogram::BUCKETS; bucket++) {
+            uint64_t sum = sum_locked(entry.histogram, bucket);
+            if (sum == 0) continue;
+            snprintf(line, sizeof(line), "%s.%zu %llu\n", entry.name, Histogram::lower_bound(bucket), (unsigned long long) sum);
+            res += line;
+        }
+    }
+    return res;
+}
+
+void dump_counters(char const* path) {
+    string dump = format_counters();
+    bool to_stderr = strcmp(path, "stderr") == 0 || strcmp(path, "1") == 0;
+    FILE* out = to_stderr ? stderr : fopen(path, "a");
+    if (!out) return;
+    fputs(dump.c_str(), out);
+    if (!to_stderr) fclose(out);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+// External headers
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Internal headers
+#include "macros.hpp"
+
+using namespace std;
+
+// Counters are only maintained in builds with TM_STATS defined (make STATS=1), otherwise every STAT_* macro compiles to nothing.
+
+// Single-writer counter: only the owning thread updates it, so a plain load/store pair is enough and other threads can still read it safely
+struct Counter {
+    atomic<uint64_t> value{0};
+    void add(uint64_t n) { value.store(value.load(memory_order_relaxed) + n, memory_order_relaxed); }
+    uint64_t get() const { return value.load(memory_order_relaxed); }
+};
+
+// Power-of-two histogram: bucket 0 counts zeros, bucket i > 0 the values in [2^(i-1), 2^i), the last one everything above
+struct Histogram {
+    static constexpr size_t BUCKETS = 17;
+    Counter buckets[BUCKETS];
+    static size_t bucket(size_t value) { return value == 0 ? 0 : min<size_t>(64 - __builtin_clzl(value), BUCKETS - 1); }
+    static size_t lower_bound(size_t bucket) { return bucket == 0 ? 0 : size_t{1} << (bucket - 1); }
+    void add(size_t value) { buckets[bucket(value)].add(1); }
+};
+
+// Counters of one thread. They live on their own cache lines so that threads never write to a shared line.
+struct alignas(64) ThreadCounters {
+    Counter commits;               // Writing transactions committed in software
+    Counter commits_ro;            // Read-only ones
+    Counter aborts;
+    // Aborts by site and cause
+    Counter aborts_read_locked;    // A read found its stripe locked by a committer
+    Counter aborts_read_stale;     // ... or newer than the snapshot, and the snapshot could not be extended
+    Counter aborts_read_changed;   // ... or changed while it was being copied
+    Counter aborts_read_history;   // A multi-version read found the history overwritten
+    Counter aborts_write_locked;   // An encounter-time write found its stripe locked by another transaction
+    Counter aborts_write_stale;    // ... or newer than the snapshot, and the snapshot could not be extended
+    Counter aborts_commit_lock;    // The commit could not take one of its write locks
+    Counter aborts_commit_validate; // ... or a stripe of its read set changed since the snapshot
+    Counter group_batches;         // Combiner passes that committed a batch of transactions
+    Counter group_members;         // ... and the transactions they committed
+    Counter clock_ticks;           // Commits that wrote the global clock
+    Counter irrevocable;           // Transactions that ran irrevocably
+    Counter irrevocable_waits;     // Commits that had to wait for an irrevocable transaction (or aborted, with encounter-time locking)
+    Counter bloom_probes;          // Reads of a writing transaction that consulted the write set filter
+    Counter bloom_hits;            // ... for which the filter could not rule the address out
+    Counter bloom_false_positives; // ... and the write set did not hold the address after all
+    Counter extensions;            // Snapshots successfully moved forward
+    Counter extension_failures;    // ... or not, because the read set had changed
+    Counter value_checks;          // Value-based revalidations that let a transaction go on (or commit) despite newer stripes
+    Counter value_check_failures;  // ... or not, because a word read had really changed
+    Counter htm_commits;           // Transactions committed in hardware
+    Counter htm_aborts;            // Hardware attempts that aborted
+    Counter htm_fallbacks;         // Transactions that gave up on hardware and ran in software
+    Counter mvcc_history_reads;    // Words a multi-version read-only transaction found in the history
+    Counter mvcc_misses;           // ... or not, because the history had been overwritten since
+    Counter savepoints;            // Savepoints taken
+    Counter savepoint_rollbacks;   // Failed operations after which a transaction restarted from its savepoint
+    Counter savepoint_failures;    // ... or aborted as a whole, because a read before the savepoint had changed
+    Histogram read_set_sizes;      // Stripes read by committed writing transactions
+    Histogram write_set_sizes;     // Words written by committed writing transactions
+};
+
+// Counters of the calling thread, registered on first use
+ThreadCounters& thread_counters();
+
+// Sum of a counter over every thread that ever registered, false if the name is unknown.
+// Histogram buckets are named after the histogram and their lower bound, e.g. "write_set.size.4" for the sets of 4 to 7 words.
+bool sum_counter(char const* name, uint64_t& out);
+
+// Every counter as "name value" lines, skipping the empty histogram buckets
+string format_counters();
+
+// Append format_counters() to the given file, "stderr" or "1" for the standard error
+void dump_counters(char const* path);
+
+#ifdef TM_STATS
+    #define STAT_ADD(name, n) thread_counters().name.add(n)
+    #define STAT_HIST(name, value) thread_counters().name.add(value)
+#else
+    #define STAT_ADD(name, n) do {} while (0)
+    #define STAT_HIST(name, value) do {} while (0)
+#endif
+#define STAT_INC(name) STAT_ADD(name, 1)
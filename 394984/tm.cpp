@@ -23,21 +23,741 @@
 // External headers
 #include <unordered_set>
 #include <unordered_map>
+#include <climits>
+#include <cstdint>
 #include <cstdlib>
 #include <list>
 #include <atomic>
 #include <thread>
 #include <mutex>
 #include <cstring>
+#include <algorithm>
+#include <vector>
 
 // Internal headers
 #include <tm.hpp>
+#include <tm-ext.hpp>
 #include "data-structures.hpp"
+#include "htm.hpp"
 #include "macros.hpp"
+#include "stats.hpp"
 
 // Global variables
-// This is our global version clock.
-atomic<version> gvc{0};
+// Recycled transaction descriptors of the calling thread
+static thread_local DescriptorPool pool;
+
+// Read-only transactions that live on their snapshot alone get no descriptor (see Config::ro_inline): their handle is laid out like a lock word,
+// | rv (48 bits) | owner (15 bits) | 1 |, and the low bit tells it from a descriptor pointer, which is always aligned
+static tx_t inline_tx(version rv, word owner) { return (rv << VERSION_SHIFT) | (owner << 1) | 1; }
+static bool is_inline(tx_t tx) { return tx & 1; }
+static version inline_rv(tx_t tx) { return tx >> VERSION_SHIFT; }
+static ThreadSlot* inline_slot(MemoryRegion* region, tx_t tx) { return region->reclaimer.peek((tx & OWNER_MASK) >> 1); }
+
+// Abort of a transaction held in its handle, there is nothing to release but its epoch
+static bool inline_abort(MemoryRegion* region, tx_t tx) {
+    STAT_INC(aborts);
+    ThreadSlot* slot = inline_slot(region, tx);
+    if (slot->aborts_in_row < UINT_MAX) slot->aborts_in_row++;
+    slot->leave();
+    return false;
+}
+
+// Release the first 'count' locks of a set of stripes, without touching their versions
+static void release_locks(MemoryRegion* region, vector<uint32_t> const& stripes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        region->lock(stripes[i])->unlock();
+    }
+}
+
+// Snapshot extension: instead of aborting on a version newer than rv, sample the clock again and check that nothing we read has changed since.
+// On success the transaction carries on with the new snapshot, and every version read so far is still valid in it.
+static bool txn_extend(MemoryRegion* region, Transaction* txn) {
+    version now = region->clock.read();
+    for (uint32_t stripe : txn->read_set.stripes) {
+        VersionedWriteLock* lock = region->lock(stripe);
+        if ((lock->isLocked() && !lock->isLockedBy(txn->owner)) || lock->getVersion() > txn->rv) {
+            STAT_INC(extension_failures);
+            return false;
+        }
+    }
+    STAT_INC(extensions);
+    txn->rv = now;
+    return true;
+}
+
+// Value-based validation: whether every word the transaction read still holds the value it read, whatever the versions of their stripes.
+// Lock striping maps unrelated words onto the same lock, and a commit to one of them only makes the others look changed.
+// 'taking' is a stripe an encounter-time transaction just locked, and did not write to yet.
+static bool txn_validate_values(MemoryRegion* region, Transaction* txn, size_t taking = SIZE_MAX) {
+    ValueLog& log = txn->read_values;
+    for (size_t i = 0; i < log.size(); i++) {
+        char* addr = log.addrs[i];
+        size_t stripe = region->stripe(addr);
+        VersionedWriteLock* lock = region->lock(stripe);
+        if (lock->isLockedBy(txn->owner)) {
+            // Encounter-time locking wrote over the words of its stripes, which were validated when it took them.
+            // Commit-time locking did not write back yet, and nobody else can change them anymore.
+            if (region->config.engine == EngineMode::etl && stripe != taking) continue;
+            if (memcmp(addr, log.value(i), log.word_size) != 0) return false;
+            continue;
+        }
+        // The comparison only counts if no commit wrote the stripe meanwhile
+        word version = lock->getVersion();
+        if (lock->isLocked() || memcmp(addr, log.value(i), log.word_size) != 0) return false;
+        if (lock->isLocked() || lock->getVersion() != version) return false;
+    }
+    return true;
+}
+
+// Snapshot extension by value: like txn_extend, but the stripes that moved since the snapshot are fine as long as the words we read in them did not change
+static bool txn_extend_values(MemoryRegion* region, Transaction* txn, size_t taking) {
+    version now = region->clock.read();
+    if (!txn_validate_values(region, txn, taking)) {
+        STAT_INC(value_check_failures);
+        return false;
+    }
+    STAT_INC(value_checks);
+    txn->rv = now;
+    return true;
+}
+
+// Whether a version seen by a read (or by the write taking stripe 'taking') fits the snapshot of the transaction, extending it if the region allows
+static bool txn_check_version(MemoryRegion* region, Transaction* txn, version v, size_t taking = SIZE_MAX) {
+    if (likely(v <= txn->rv)) return true;
+    region->clock.observe(v);
+    if (region->config.extend && txn_extend(region, txn) && v <= txn->rv) return true;
+    return region->config.value_check && txn_extend_values(region, txn, taking) && v <= txn->rv;
+}
+
+// Commit-time validation of the read set: every stripe read must be unlocked (or ours) and no newer than the snapshot,
+// or, when the region revalidates by value, every word read must still hold the value read
+static bool txn_validate_reads(MemoryRegion* region, Transaction* txn) {
+    for (uint32_t stripe : txn->read_set.stripes) {
+        VersionedWriteLock* lock = region->lock(stripe);
+        if ((lock->isLocked() && !lock->isLockedBy(txn->owner)) || lock->getVersion() > txn->rv) {
+            region->clock.observe(lock->getVersion());
+            if (!region->config.value_check) return false;
+            // The stripes we hold cannot change anymore, and every other one is checked again now
+            if (!txn_validate_values(region, txn)) {
+                STAT_INC(value_check_failures);
+                return false;
+            }
+            STAT_INC(value_checks);
+            return true;
+        }
+    }
+    return true;
+}
+
+// Encounter-time locking: restore the words written in place and release their stripes at version wv (0 to tick the clock for one).
+// The stripes must get a version newer than before: a reader that validated one before we locked it may have copied the values we wrote since,
+// and only a version change tells it so.
+// The clock is then raised to that version even under gv5 and gv6: hot stripes would otherwise stay ahead of every new snapshot and abort whoever reads them.
+static void etl_rollback(MemoryRegion* region, Transaction* txn, version wv) {
+    txn->undo.rollback();
+    if (wv == 0) {
+        bool exclusive;
+        wv = region->clock.tick(txn->owner, exclusive);
+    }
+    region->clock.publish(txn->owner, wv);
+    region->clock.observe(wv);
+    for (uint32_t stripe : txn->write_stripes) {
+        region->lock(stripe)->setVersion(wv);
+    }
+    txn->write_stripes.clear();
+}
+
+// Give the descriptor of an aborted transaction back, so the caller can just 'return txn_abort(region, txn);'
+static bool txn_abort(MemoryRegion* region, Transaction* txn) {
+    STAT_INC(aborts);
+    if (txn->slot->aborts_in_row < UINT_MAX) txn->slot->aborts_in_row++;
+    // A transaction holding a savepoint stays alive, for tm_rollback to restart it from there
+    if (txn->savepoint.held) {
+        txn->slot->stop_committing();
+        if (region->config.cm != CmPolicy::none) cm_aborted(region, txn);
+        return false;
+    }
+    // Commit-time locking releases its locks itself, encounter-time locking may hold some wherever it aborts
+    if (region->config.engine == EngineMode::etl && !txn->write_stripes.empty()) etl_rollback(region, txn, 0);
+    txn->slot->leave();
+    // Backing off happens before the caller retries, and outside of the epoch so that it doesn't hold back reclamation
+    if (region->config.cm != CmPolicy::none) cm_aborted(region, txn);
+    pool.release(txn);
+    return false;
+}
+
+// Pre-validation of a read, returns the version of the stripe if it is unlocked and fits the snapshot
+static bool txn_pre_validate(MemoryRegion* region, Transaction* txn, VersionedWriteLock* lock, word& version) {
+    version = lock->getVersion();
+    if (unlikely(lock->isLocked())) {
+        // Someone is committing to the stripe, the contention manager may let us wait for it rather than abort
+        bool waited = cm_wait(region, txn, lock);
+        version = lock->getVersion();
+        if (!waited || lock->isLocked()) {
+            STAT_INC(aborts_read_locked);
+            return false;
+        }
+    }
+    if (unlikely(!txn_check_version(region, txn, version))) {
+        STAT_INC(aborts_read_stale);
+        return false;
+    }
+    return true;
+}
+
+// Wait until no one else holds a lock
+static void wait_unlocked(VersionedWriteLock* lock) {
+    for (unsigned spins = 0; lock->isLocked(); spins++) {
+        if (spins < 64) {
+            cpu_relax();
+        } else {
+            this_thread::yield();
+        }
+    }
+}
+
+// Called by a writing transaction before it takes its first commit lock, false if it must abort instead.
+// The committing flag and the token are checked in opposite orders by committers and by an irrevocable transaction (see txn_become_irrevocable),
+// so that either the committer sees the token or the irrevocable transaction waits for the commit to end.
+static bool txn_enter_commit(MemoryRegion* region, Transaction* txn) {
+    ThreadSlot* slot = txn->slot;
+    for (;;) {
+        slot->committing.store(true);
+        if (likely(region->irrevocable.load() == 0)) return true;
+        slot->committing.store(false);
+        STAT_INC(irrevocable_waits);
+        // Encounter-time locking holds locks the irrevocable transaction may be waiting for, it rolls back instead
+        if (region->config.engine == EngineMode::etl) return false;
+        for (unsigned spins = 0; region->irrevocable.load() != 0; spins++) {
+            if (spins < 64) {
+                cpu_relax();
+            } else {
+                this_thread::yield();
+            }
+        }
+    }
+}
+
+// Take the irrevocable token of the region, then wait for the commits that did not see it to end
+static void txn_become_irrevocable(MemoryRegion* region, Transaction* txn) {
+    word expected = 0;
+    for (unsigned spins = 0; !region->irrevocable.compare_exchange_weak(expected, txn->owner); spins++) {
+        expected = 0;
+        if (spins < 64) {
+            cpu_relax();
+        } else {
+            this_thread::yield();
+        }
+    }
+    region->reclaimer.drain_commits(txn->slot);
+    STAT_INC(irrevocable);
+    txn->irrevocable = true;
+    txn->is_ro = false;
+}
+
+// Irrevocable transactions read in place without validating: nothing commits while they run, and the only stripes that can still be locked
+// are the ones written in place by encounter-time locking transactions, which are bound to roll back.
+template<size_t W> static void irrevocable_read(MemoryRegion* region, Transaction* txn, char* source_start, size_t size, char* target_start) {
+    char* source_end = source_start + size;
+    while (source_start < source_end) {
+        char* run_end = min(source_end, region->stripe_end(source_start));
+        VersionedWriteLock* lock = region->lock(region->stripe(source_start));
+        if (!lock->isLockedBy(txn->owner)) wait_unlocked(lock);
+        memcpy(target_start, source_start, run_end - source_start);
+        target_start += run_end - source_start;
+        source_start = run_end;
+    }
+}
+
+// Irrevocable transactions write in place, under the locks of their stripes so that the running transactions notice
+template<size_t W> static void irrevocable_write(MemoryRegion* region, Transaction* txn, char* source_start, size_t size, char* target_start) {
+    size_t word_size = W ? W : region->align;
+    for (size_t i = 0; i < size; i += word_size) {
+        char* target_addr = target_start + i;
+        size_t stripe = region->stripe(target_addr);
+        VersionedWriteLock* lock = region->lock(stripe);
+        if (!lock->isLockedBy(txn->owner)) {
+            while (!lock->lock(txn->owner)) wait_unlocked(lock);
+            txn->write_stripes.push_back(stripe);
+        }
+        // Multi-version readers need the value the word had before the transaction, i.e. before its first write to it
+        if (region->history.enabled() && !(txn->write_set.may_contain(target_addr) && txn->write_set.find(target_addr))) {
+            txn->write_set.insert<W>(target_addr, target_addr);
+        }
+        copy_word<W>(target_addr, source_start + i, word_size);
+    }
+}
+
+// Commit of an irrevocable transaction: its writes are in place under its locks, it releases them at a new version
+static void irrevocable_commit(MemoryRegion* region, Transaction* txn) {
+    vector<uint32_t>& stripes = txn->write_stripes;
+    if (stripes.empty()) return;
+    bool exclusive;
+    version wv = region->clock.tick(txn->owner, exclusive);
+    if (region->history.enabled()) {
+        WriteSet& write_set = txn->write_set;
+        for (size_t i = 0; i < write_set.size(); i++) {
+            size_t stripe = region->stripe(write_set.addrs[i]);
+            region->history.record(stripe, write_set.addrs[i], write_set.value(i), region->lock(stripe)->getVersion(), wv);
+        }
+    }
+    region->clock.publish(txn->owner, wv);
+    for (uint32_t stripe : stripes) {
+        region->lock(stripe)->setVersion(wv);
+    }
+}
+
+// Word-size specialized paths: W is the alignment of the region for the common sizes, so that word copies compile to plain loads and stores,
+// or 0 for the generic paths that use the alignment given at runtime. tm_create_ext picks the instantiation once per region.
+
+// Multi-version read-only read: every word is read as of rv, from the history if a commit overwrote it since, so there is nothing to validate.
+// Returns false if the history has wrapped around since rv, the only way left is then retrying with a newer snapshot.
+template<size_t W> static bool read_snapshot(MemoryRegion* region, version rv, char* source_start, size_t size, char* target_start) {
+    size_t word_size = W ? W : region->align;
+    for (size_t i = 0; i < size; i += word_size) {
+        char* source_addr = source_start + i;
+        size_t stripe = region->stripe(source_addr);
+        VersionedWriteLock* lock = region->lock(stripe);
+        for (unsigned spins = 0;; spins++) {
+            word version = lock->getVersion();
+            if (lock->isLocked()) {
+                // The committer records the old values before writing back, and may commit at a version we must see, so wait for it to finish
+                if (spins < 64) {
+                    cpu_relax();
+                } else {
+                    this_thread::yield();
+                }
+                continue;
+            }
+            if (version <= rv) {
+                copy_word<W>(target_start + i, source_addr, word_size);
+                if (!lock->isLocked() && lock->getVersion() == version) break;
+                continue;
+            }
+            if (region->history.find(stripe, source_addr, rv, target_start + i)) {
+                STAT_INC(mvcc_history_reads);
+                break;
+            }
+            STAT_INC(mvcc_misses);
+            STAT_INC(aborts_read_history);
+            region->clock.observe(version);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Body of tm_read, ETL tells whether the region locks stripes on their first write (see etl.hpp)
+template<size_t W, bool ETL> static bool read_words(MemoryRegion* region, Transaction* txn, char* source_start, size_t size, char* target_start) {
+    char* source_end = source_start + size;
+    size_t word_size = W ? W : region->align;
+
+    if (unlikely(txn->irrevocable)) {
+        irrevocable_read<W>(region, txn, source_start, size, target_start);
+        return true;
+    }
+
+    if (txn->in_htm) {
+        // The hardware keeps the reads atomic, we only have to stay off the stripes a software transaction is committing.
+        // Reading the lock also subscribes to it: if a software commit takes it later, the hardware transaction aborts.
+        while (source_start < source_end) {
+            char* run_end = min(source_end, region->stripe_end(source_start));
+            if (region->lock(region->stripe(source_start))->isLocked()) htm_abort_conflict();
+            memcpy(target_start, source_start, run_end - source_start);
+            target_start += run_end - source_start;
+            source_start = run_end;
+        }
+        return true;
+    }
+
+    if (txn->is_ro && region->history.enabled()) {
+        if (!read_snapshot<W>(region, txn->rv, source_start, size, target_start)) return txn_abort(region, txn);
+        return true;
+    }
+
+    // The range is read one stripe at a time: every run of words sharing a lock is validated once before and once after copying all of them
+    WriteSet& write_set = txn->write_set;
+    // Low-Cost Read-Only Transaction (2), and writing ones that did not write yet, read straight from the shared memory
+    // Encounter-time locking writes in place, so its transactions never have anything in the write set either
+    bool own_writes = !ETL && !txn->is_ro && !write_set.empty();
+    bool value_check = region->config.value_check;
+    while (source_start < source_end) {
+        char* run_end = min(source_end, region->stripe_end(source_start));
+        size_t run = run_end - source_start;
+
+        // Get the lock which protects the run we want to read from.
+        size_t stripe = region->stripe(source_start);
+        VersionedWriteLock* lock = region->lock(stripe);
+
+        if constexpr (ETL) {
+            // A stripe we locked holds our own writes, and nobody else can change it
+            if (lock->isLockedBy(txn->owner)) {
+                memcpy(target_start, source_start, run);
+                source_start = run_end;
+                target_start += run;
+                continue;
+            }
+        }
+
+        // Pre validate read
+        word version;
+        if (!txn_pre_validate(region, txn, lock, version)) {
+            return txn_abort(region, txn);
+        }
+
+        // We also copy the values directly. This technically breaks isolation, but we don't care since the values will be ignored if we later find out that the transaction must abort
+        if (run == word_size) {
+            // The common single-word run
+            copy_word<W>(target_start, source_start, word_size);
+        } else {
+            memcpy(target_start, source_start, run);
+        }
+        // The values read from the shared memory, before our own writes replace some of them
+        size_t logged = txn->read_values.size();
+        if (value_check) {
+            for (size_t i = 0; i < run; i += word_size) {
+                txn->read_values.push<W>(source_start + i, target_start + i);
+            }
+        }
+
+        // Words written previously by the transaction must be read from the write set instead
+        // Most words read were never written, the write set filter lets us skip the lookup for them
+        if (own_writes) {
+            for (char* addr = source_start; addr < run_end; addr += word_size) {
+                STAT_INC(bloom_probes);
+                if (likely(!write_set.may_contain(addr))) continue;
+                STAT_INC(bloom_hits);
+                char* val_addr = write_set.find(addr);
+                if (val_addr) {
+                    copy_word<W>(target_start + (addr - source_start), val_addr, word_size);
+                } else {
+                    STAT_INC(bloom_false_positives);
+                }
+            }
+        }
+
+        // Post validate read
+        word new_version = lock->getVersion();
+        if (lock->isLocked() || new_version != version) {
+            // Revalidating by value, the run is read again: the new version then goes through the value check, which only fails if a word we read changed
+            if (value_check) {
+                txn->read_values.truncate(logged);
+                continue;
+            }
+            STAT_INC(aborts_read_changed);
+            return txn_abort(region, txn);
+        }
+
+        // Keep track of all of the stripes we read from
+        // The read log of read-only transactions is only needed to validate an extension of the snapshot
+        if (!txn->is_ro || region->config.extend) txn->read_set.insert(stripe);
+
+        source_start = run_end;
+        target_start += run;
+    }
+    return true;
+}
+
+// Body of tm_read for the transactions held in their handle: a read-only snapshot that can neither wait, extend nor revalidate, so any conflict aborts it
+template<size_t W> static bool read_words_inline(MemoryRegion* region, tx_t tx, char* source_start, size_t size, char* target_start) {
+    version rv = inline_rv(tx);
+    if (region->history.enabled()) {
+        if (!read_snapshot<W>(region, rv, source_start, size, target_start)) return inline_abort(region, tx);
+        return true;
+    }
+    char* source_end = source_start + size;
+    size_t word_size = W ? W : region->align;
+    while (source_start < source_end) {
+        char* run_end = min(source_end, region->stripe_end(source_start));
+        size_t run = run_end - source_start;
+        VersionedWriteLock* lock = region->lock(region->stripe(source_start));
+        word version = lock->getVersion();
+        if (unlikely(lock->isLocked())) {
+            STAT_INC(aborts_read_locked);
+            return inline_abort(region, tx);
+        }
+        if (unlikely(version > rv)) {
+            region->clock.observe(version);
+            STAT_INC(aborts_read_stale);
+            return inline_abort(region, tx);
+        }
+        if (run == word_size) {
+            copy_word<W>(target_start, source_start, word_size);
+        } else {
+            memcpy(target_start, source_start, run);
+        }
+        if (lock->isLocked() || lock->getVersion() != version) {
+            STAT_INC(aborts_read_changed);
+            return inline_abort(region, tx);
+        }
+        source_start = run_end;
+        target_start += run;
+    }
+    return true;
+}
+
+// Body of tm_write
+template<size_t W> static bool write_words(MemoryRegion* region, Transaction* txn, char* source_start, size_t size, char* target_start) {
+    size_t word_size = W ? W : region->align;
+
+    if (unlikely(txn->irrevocable)) {
+        irrevocable_write<W>(region, txn, source_start, size, target_start);
+        return true;
+    }
+
+    if (txn->in_htm) {
+        // Hardware transactions write in place, and give the stripes a version newer than the clock so that software readers notice.
+        // Reading the clock keeps it in the read set of the transaction, so the version stays newer than any software commit until ours.
+        if (txn->htm_wv == 0) txn->htm_wv = region->clock.read() + 1;
+        for (size_t i = 0; i < size; i += word_size) {
+            VersionedWriteLock* lock = region->lock(region->stripe(target_start + i));
+            if (lock->isLocked()) htm_abort_conflict();
+            copy_word<W>(target_start + i, source_start + i, word_size);
+            lock->setVersion(txn->htm_wv);
+        }
+        return true;
+    }
+
+    // Go through every word we want to write to and add it to the write set
+    for (size_t i = 0; i < size; i += word_size) {
+        // Keep track of all of the places we will need to write to
+        // The value is copied inline into the write set, which was sized for this region's alignment in tm_begin.
+        txn->write_set.insert<W>(target_start + i, source_start + i);
+    }
+    return true;
+}
+
+// Body of tm_write with encounter-time locking: lock every stripe on its first write, log the old values and write in place
+template<size_t W> static bool etl_write_words(MemoryRegion* region, Transaction* txn, char* source_start, size_t size, char* target_start) {
+    if (unlikely(txn->irrevocable)) {
+        irrevocable_write<W>(region, txn, source_start, size, target_start);
+        return true;
+    }
+    size_t word_size = W ? W : region->align;
+    for (size_t i = 0; i < size; i += word_size) {
+        char* target_addr = target_start + i;
+        size_t stripe = region->stripe(target_addr);
+        VersionedWriteLock* lock = region->lock(stripe);
+        if (!lock->isLockedBy(txn->owner)) {
+            // Conflicting writers find out now rather than at commit, the contention manager may let us wait once for the holder
+            if (!lock->lock(txn->owner) && !(cm_wait(region, txn, lock) && lock->lock(txn->owner))) {
+                STAT_INC(aborts_write_locked);
+                return txn_abort(region, txn);
+            }
+            txn->write_stripes.push_back(stripe);
+            // Commit does not validate the stripes it holds, so their version must fit the snapshot when we take them, as for a read
+            if (unlikely(!txn_check_version(region, txn, lock->getVersion(), stripe))) {
+                STAT_INC(aborts_write_stale);
+                return txn_abort(region, txn);
+            }
+        }
+        txn->undo.push<W>(target_addr);
+        copy_word<W>(target_addr, source_start + i, word_size);
+    }
+    return true;
+}
+
+// Commit of an encounter-time locking transaction: its writes are in place under its locks already, it only validates its reads and releases the locks at a new version.
+// Aborts (and gives the descriptor back) on a failed validation.
+static bool etl_commit(MemoryRegion* region, Transaction* txn) {
+    vector<uint32_t>& stripes = txn->write_stripes;
+    // Nothing written, every read fit the snapshot already
+    if (stripes.empty()) return true;
+
+    if (unlikely(!txn_enter_commit(region, txn))) return txn_abort(region, txn);
+    bool exclusive;
+    version wv = region->clock.tick(txn->owner, exclusive);
+    if (!exclusive || txn->rv + 1 != wv) {
+        // Our own stripes were checked against the snapshot when we locked them, and kept their version since
+        if (!txn_validate_reads(region, txn)) {
+            etl_rollback(region, txn, wv);
+            STAT_INC(aborts_commit_validate);
+            return txn_abort(region, txn);
+        }
+    }
+
+    region->clock.publish(txn->owner, wv);
+    for (uint32_t stripe : stripes) {
+        region->lock(stripe)->setVersion(wv);
+    }
+    return true;
+}
+
+// Apply the redo log of a committing transaction, along the runs its write set planned
+template<size_t W> static void write_back(MemoryRegion* region, Transaction* txn) {
+    size_t word_size = W ? W : region->align;
+    WriteSet& write_set = txn->write_set;
+    bool stream = region->config.stream_writes != 0 && write_set.values.size() >= region->config.stream_writes;
+    for (WriteRun const& run : write_set.runs) {
+        if (run.bytes == word_size) {
+            copy_word<W>(run.addr, run.values, word_size);
+        } else if (stream) {
+            stream_copy(run.addr, run.values, run.bytes);
+        } else {
+            memcpy(run.addr, run.values, run.bytes);
+        }
+    }
+    // The new versions of the stripes must not become visible before the streamed values
+    if (stream) stream_fence();
+}
+
+struct WordOps {
+    bool (*read)(MemoryRegion*, Transaction*, char*, size_t, char*);
+    bool (*read_inline)(MemoryRegion*, tx_t, char*, size_t, char*);
+    bool (*write)(MemoryRegion*, Transaction*, char*, size_t, char*);
+    void (*write_back)(MemoryRegion*, Transaction*); // Unused with encounter-time locking, whose writes are in place already
+};
+
+template<size_t W> static constexpr WordOps word_ops = {read_words<W, false>, read_words_inline<W>, write_words<W>, write_back<W>};
+template<size_t W> static constexpr WordOps etl_word_ops = {read_words<W, true>, read_words_inline<W>, etl_write_words<W>, nullptr};
+
+// Group commit: one combiner pass over the commits published in the thread slots (see combine.hpp).
+// 'owner' is the tag of the combiner, the locks of the batch are taken in its name.
+static void combine_commits(MemoryRegion* region, word owner) {
+    CommitBatch& batch = region->combiner.batch;
+    batch.clear();
+    Reclaimer& reclaimer = region->reclaimer;
+    size_t used = reclaimer.nb_chunks.load();
+    for (size_t c = 0; c < used && batch.members.size() < CommitBatch::MAX_MEMBERS; c++) {
+        ThreadSlot* chunk = reclaimer.chunks[c].load(memory_order_acquire);
+        if (!chunk) continue;
+        for (size_t i = 0; i < Reclaimer::CHUNK && batch.members.size() < CommitBatch::MAX_MEMBERS; i++) {
+            Transaction* txn = chunk[i].commit_request.load(memory_order_acquire);
+            if (!txn) continue;
+            chunk[i].commit_request.store(nullptr, memory_order_relaxed);
+            batch.members.push_back({&chunk[i], txn, true});
+        }
+    }
+    if (batch.members.empty()) return;
+
+    // Lock the write sets, member by member. A member that cannot have one of its stripes gives back those it took, and aborts.
+    for (auto& member : batch.members) {
+        size_t first = batch.locked.size();
+        for (uint32_t stripe : member.txn->write_stripes) {
+            VersionedWriteLock* lock = region->lock(stripe);
+            // Taken for an earlier member already
+            if (lock->isLockedBy(owner)) continue;
+            if (!lock->lock(owner)) {
+                for (size_t k = first; k < batch.locked.size(); k++) {
+                    region->lock(batch.locked[k])->unlock();
+                }
+                batch.locked.resize(first);
+                member.ok = false;
+                STAT_INC(aborts_commit_lock);
+                break;
+            }
+            batch.locked.push_back(stripe);
+        }
+    }
+
+    // One clock tick for the whole batch
+    bool exclusive;
+    version wv = region->clock.tick(owner, exclusive);
+
+    // Validate the members in order: each one is serialized after those before it, so it must not have read a stripe they write
+    for (auto& member : batch.members) {
+        if (!member.ok) continue;
+        Transaction* txn = member.txn;
+        // As for a commit of its own, nothing to check if no one committed since the transaction started
+        bool alone = exclusive && txn->rv + 1 == wv;
+        for (uint32_t stripe : txn->read_set.stripes) {
+            VersionedWriteLock* lock = region->lock(stripe);
+            bool ours = lock->isLockedBy(owner);
+            if ((ours && batch.writes(stripe)) || (!alone && ((lock->isLocked() && !ours) || lock->getVersion() > txn->rv))) {
+                region->clock.observe(lock->getVersion());
+                member.ok = false;
+                STAT_INC(aborts_commit_validate);
+                break;
+            }
+        }
+        if (!member.ok) continue;
+        batch.add_writes(txn->write_stripes);
+    }
+
+    // Write back in serialization order, so that the last member writing a word has the last word
+    size_t committed = 0;
+    for (auto& member : batch.members) {
+        if (!member.ok) continue;
+        region->ops->write_back(region, member.txn);
+        committed++;
+    }
+    region->clock.publish(owner, wv);
+    for (uint32_t stripe : batch.locked) {
+        // Stripes only aborted members meant to write keep their version
+        if (batch.writes(stripe)) {
+            region->lock(stripe)->setVersion(wv);
+        } else {
+            region->lock(stripe)->unlock();
+        }
+    }
+    STAT_INC(group_batches);
+    STAT_ADD(group_members, committed);
+
+    // The members own their descriptors again from here on
+    for (auto& member : batch.members) {
+        member.slot->commit_state.store(member.ok ? CommitState::committed : CommitState::aborted, memory_order_release);
+    }
+}
+
+// Group commit of a writing transaction, whose write stripes are sorted already: publish it, and take the combiner role whenever it is free,
+// until some combiner committed or aborted it. Its locks are all released when this returns.
+static bool txn_group_commit(MemoryRegion* region, Transaction* txn) {
+    ThreadSlot* slot = txn->slot;
+    slot->commit_state.store(CommitState::pending, memory_order_relaxed);
+    slot->commit_request.store(txn, memory_order_release);
+    for (unsigned spins = 0;; spins++) {
+        CommitState state = slot->commit_state.load(memory_order_acquire);
+        if (state != CommitState::pending) {
+            slot->commit_state.store(CommitState::idle, memory_order_relaxed);
+            return state == CommitState::committed;
+        }
+        if (region->combiner.try_acquire()) {
+            combine_commits(region, txn->owner);
+            region->combiner.release();
+            continue;
+        }
+        if (spins < 64) {
+            cpu_relax();
+        } else {
+            this_thread::yield();
+        }
+    }
+}
+
+// Hybrid mode: try to run the transaction in hardware first. An abort rolls everything back to the htm_begin in here, whatever the caller did since,
+// so the loop retries a few times and then lets the transaction run in software.
+static bool txn_try_hardware(MemoryRegion* region, Transaction* txn) {
+    for (size_t attempt = 0; attempt < region->config.htm_retries; attempt++) {
+        unsigned status = htm_begin();
+        if (status == HTM_STARTED) {
+            // Reading the token subscribes to it, so that an irrevocable transaction starting later aborts us
+            if (region->irrevocable.load(memory_order_relaxed) != 0) htm_abort_conflict();
+            txn->in_htm = true;
+            return true;
+        }
+        STAT_INC(htm_aborts);
+        if (!htm_should_retry(status)) break;
+    }
+    STAT_INC(htm_fallbacks);
+    return false;
+}
+
+static WordOps const* pick_word_ops(size_t align, EngineMode engine) {
+    if (engine == EngineMode::etl) {
+        switch (align) {
+            case 4: return &etl_word_ops<4>;
+            case 8: return &etl_word_ops<8>;
+            case 16: return &etl_word_ops<16>;
+            default: return &etl_word_ops<0>;
+        }
+    }
+    switch (align) {
+        case 4: return &word_ops<4>;
+        case 8: return &word_ops<8>;
+        case 16: return &word_ops<16>;
+        default: return &word_ops<0>;
+    }
+}
 
 using namespace std;
 /** Create (i.e. allocate + init) a new shared memory region, with one first non-free-able allocated segment of the requested size and alignment.
@@ -46,26 +766,68 @@ using namespace std;
  * @return Opaque shared memory region handle, 'invalid_shared' on failure
 **/
 shared_t tm_create(size_t size, size_t align) noexcept {
+    return tm_create_ext(size, align, nullptr);
+}
+
+/** Same as tm_create, with tunables for this region.
+ * @param size    Size of the first shared segment of memory to allocate (in bytes), must be a positive multiple of the alignment
+ * @param align   Alignment (in bytes, must be a power of 2) that the shared memory region must support
+ * @param options Comma-separated "key=value" tunables applied on top of TM_OPTIONS (see config.hpp), may be null
+ * @return Opaque shared memory region handle, 'invalid_shared' on failure
+**/
+shared_t tm_create_ext(size_t size, size_t align, char const* options) noexcept {
     MemoryRegion* region = new(std::nothrow) MemoryRegion(size,align);
     if (unlikely(!region)) return invalid_shared;
 
-    // We will just allocate a large fixed number of locks, rather then locking each individual word to reduce the amount of time it takes to initialize the library.
-    region->locks = new(std::nothrow) VersionedWriteLock[NUM_LOCKS];
-    if (unlikely(!region->locks)) {
+    if (unlikely(!Config::load(region->config, options))) {
         delete region;
         return invalid_shared;
     }
 
-    // We allocate the shared memory buffer such that its words are correctly
-    // aligned.
-    region->start = aligned_alloc(align, size);
-    if (unlikely(!region->start)) {
-        delete[] region->locks;
+    // Encounter-time locking overwrites the values in place before commit, so there is nothing left for it to record in the history
+    if (region->config.engine == EngineMode::etl) region->config.mvcc = false;
+    // Nor can read-only snapshots be served from it when commits do not move the clock: a commit that finished before the snapshot was taken may still be newer than it
+    if (region->config.clock == ClockMode::gv5 || region->config.clock == ClockMode::gv6) region->config.mvcc = false;
+    // The combiner locks stripes for transactions that write back at commit, and only keeps one version per stripe for a whole batch
+    if (region->config.engine == EngineMode::etl || region->config.mvcc) region->config.group_commit = false;
+    region->ops = pick_word_ops(align, region->config.engine);
+    // The hybrid mode quietly turns itself off on CPUs without hardware transactions
+    // Hardware commits write in place without recording the history, so multi-version regions stay in software
+    // Nor do they know about the undo logs, so encounter-time locking stays in software as well
+    region->htm = region->config.htm && !region->config.mvcc && region->config.engine == EngineMode::tl2 && htm_supported();
+    region->clock.hybrid = region->htm;
+    // A transaction without a descriptor has no read log to extend or revalidate its snapshot with, nor anything for the contention manager to weigh,
+    // and hardware attempts need one to fall back to software with
+    if (region->config.value_check || (region->config.extend && !region->config.mvcc) || region->htm || region->config.cm != CmPolicy::none) {
+        region->config.ro_inline = false;
+    }
+
+    if (unlikely(!region->clock.init(region->config.clock, region->config.clock_shards))) {
+        delete region;
+        return invalid_shared;
+    }
+
+    // We use a fixed number of locks shared by stripes of words, rather then locking each individual word to reduce the amount of time it takes to initialize the library.
+    if (unlikely(!region->init_locks())) {
+        delete region;
+        return invalid_shared;
+    }
+
+    if (unlikely(!region->init_history())) {
+        delete region;
+        return invalid_shared;
+    }
+
+    // The first segment is zeroed as required, and placed across the nodes in NUMA mode
+    if (unlikely(!region->init_start())) {
+        delete region;
+        return invalid_shared;
+    }
+
+    if (region->config.zero_thread && unlikely(!region->zero_pool.start())) {
         delete region;
         return invalid_shared;
     }
-    // As required, we zero out the memory
-    memset(region->start, 0, size);
     return region;
 }
 
@@ -75,6 +837,12 @@ shared_t tm_create(size_t size, size_t align) noexcept {
 void tm_destroy(shared_t shared) noexcept {
     MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
 
+#ifdef TM_STATS
+    // The counters are process-wide, so this is a dump of everything that ran up to now, not only on this region
+    char const* dump = getenv("TM_STATS_DUMP");
+    if (dump && *dump) dump_counters(dump);
+#endif
+
     //destructor will do most of the work here
     delete region; 
 }
@@ -106,17 +874,58 @@ size_t tm_align(shared_t shared) noexcept {
     return region->align;
 }
 
+// Body of tm_begin and tm_begin_irrevocable
+static tx_t txn_begin(MemoryRegion* region, bool is_ro, bool irrevocable) {
+    // Write Transaction (1) 
+    word owner = owner_tag();
+    if (unlikely(owner == 0)) return invalid_tx;
+    ThreadSlot* slot = region->reclaimer.slot(owner);
+    if (unlikely(!slot)) return invalid_tx;
+    // Announce the transaction before taking its snapshot, so that nothing it can reach gets reclaimed under it
+    region->reclaimer.enter(slot);
+    // A thread that keeps aborting must get a descriptor to become irrevocable with
+    if (is_ro && region->config.ro_inline && (region->config.irrevocable_after == 0 || slot->aborts_in_row < region->config.irrevocable_after)) {
+        return inline_tx(region->clock.read(), owner);
+    }
+    Transaction* txn = pool.acquire(region->clock.read(),is_ro,region->align);
+    if (!txn) {
+        slot->leave();
+        return invalid_tx;
+    }
+    txn->owner = owner;
+    txn->slot = slot;
+    // A thread that keeps aborting gets to run alone
+    if (irrevocable || (region->config.irrevocable_after != 0 && slot->aborts_in_row >= region->config.irrevocable_after)) {
+        txn_become_irrevocable(region, txn);
+        return reinterpret_cast<tx_t>(txn);
+    }
+    if (region->htm) {
+        if (txn_try_hardware(region, txn)) return reinterpret_cast<tx_t>(txn);
+        // The software run gets a fresh snapshot, the hardware attempts may have taken a while
+        txn->rv = region->clock.read();
+    }
+    // Only writing transactions keep a read set, unless read-only ones need it to extend their snapshot
+    if (!is_ro || (region->config.extend && !region->history.enabled())) txn->read_set.reset(region->nb_locks());
+
+    return reinterpret_cast<tx_t>(txn);
+}
+
 /** [thread-safe] Begin a new transaction on the given shared memory region.
  * @param shared Shared memory region to start a transaction on
  * @param is_ro  Whether the transaction is read-only
  * @return Opaque transaction ID, 'invalid_tx' on failure
 **/
-tx_t tm_begin(shared_t unused(shared), bool is_ro) noexcept {
-    // Write Transaction (1) 
-    Transaction* txn = new(nothrow) Transaction(gvc.load(),is_ro);
-    if (!txn) return invalid_tx;
+tx_t tm_begin(shared_t shared, bool is_ro) noexcept {
+    return txn_begin(reinterpret_cast<MemoryRegion*>(shared), is_ro, false);
+}
 
-    return reinterpret_cast<tx_t>(txn);
+/** [thread-safe] Begin a new irrevocable transaction on the given shared memory region: it waits for the running commits, then runs alone and in place.
+ * Other writing transactions wait for it at commit, so it never aborts, at the cost of the concurrency of the region while it runs.
+ * @param shared Shared memory region to start a transaction on
+ * @return Opaque transaction ID, 'invalid_tx' on failure
+**/
+tx_t tm_begin_irrevocable(shared_t shared) noexcept {
+    return txn_begin(reinterpret_cast<MemoryRegion*>(shared), false, true);
 }
 
 /** [thread-safe] End the given transaction.
@@ -127,75 +936,128 @@ tx_t tm_begin(shared_t unused(shared), bool is_ro) noexcept {
 bool tm_end(shared_t unused(shared), tx_t tx) noexcept {
     // dprint("[CALL] tm_end(",shared,",",tx,")");
     MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
+    if (is_inline(tx)) {
+        // Every read was validated against the snapshot already
+        STAT_INC(commits_ro);
+        ThreadSlot* slot = inline_slot(region, tx);
+        slot->aborts_in_row = 0;
+        slot->leave();
+        return true;
+    }
     Transaction *txn = reinterpret_cast<Transaction*>(tx);
 
-    // Keep track of all the locks we are currently holding
-    unordered_set<VersionedWriteLock*> locks_held;
+    if (txn->in_htm) {
+        htm_end();
+        // Our stripes carry a version the clock never handed out, make sure the next snapshots include it
+        if (txn->htm_wv != 0) region->clock.catch_up(txn->owner, txn->htm_wv);
+        STAT_INC(htm_commits);
+        txn->slot->leave();
+        pool.release(txn);
+        return true;
+    }
 
     // A possible optimization is to move onto the next lock if we fail to acquire the current one. But we won't do that here.
 
     // We can skip most of the work if it is a readonly transaction
     if (!txn->is_ro) {
-        // (3) Lock the write-set
-        for (auto& keyval : txn->write_set) {
-            char* target_addr = keyval.first;
-            VersionedWriteLock* lock = &region->locks[(word)target_addr % NUM_LOCKS];
-            if (!lock->lock() && locks_held.find(lock) == locks_held.end()) {
-                // Here we must delete all previously held locks and cleanup
-                for (auto lock : locks_held) {
-                    lock->unlock();
-                }
-                delete txn;
-                return false;
+        if (unlikely(txn->irrevocable)) {
+            irrevocable_commit(region, txn);
+            STAT_HIST(write_set_sizes, txn->write_stripes.size());
+        } else if (region->config.engine == EngineMode::etl) {
+            // The writes are in place already
+            if (!etl_commit(region, txn)) return false;
+            STAT_HIST(write_set_sizes, txn->undo.size());
+        } else {
+            // Irrevocable transactions must not see commits they did not wait for
+            if (unlikely(!txn_enter_commit(region, txn))) return txn_abort(region, txn);
+
+            // (3) Lock the write-set
+            // Several written words can share a stripe, so we take each stripe once, in increasing order
+            vector<uint32_t>& stripes = txn->write_stripes;
+            stripes.clear();
+            for (char* target_addr : txn->write_set.addrs) {
+                stripes.push_back(region->stripe(target_addr));
             }
-            locks_held.insert(lock);
-        }
-        // Now we have every lock we need
-
-        // (4) Increment the global version-clock
-        // Note: You need to add + 1 here! You would think it would return the incremented value but it doesn't. I think this one thing caused me up to 4 hours of debugging : (
-        version wv = gvc.fetch_add(1) + 1;
-
-        // (5) Validate the read-set (only if someone has touched the gvc since the transaction started)
-        if (txn->rv + 1 != wv) {
-            for (auto& read : txn->read_set) {
-                // Get the lock which protects the address we want to read from.
-                VersionedWriteLock* lock = &region->locks[(word)read % NUM_LOCKS];
-                bool lock_owned = (locks_held.find(lock) != locks_held.end());
-
-                // If the lock is owned, it must be owned by us.
-                if ((!lock_owned && lock->isLocked()) || lock->getVersion() > txn->rv) {
-                    // Here we must delete all previously held locks and cleanup
-                    for (auto lock : locks_held) {
-                        lock->unlock();
+            sort(stripes.begin(), stripes.end());
+            stripes.erase(unique(stripes.begin(), stripes.end()), stripes.end());
+            // Sorting and merging the writes happens before the locks are taken, not while they are held
+            txn->write_set.plan();
+
+            if (region->config.group_commit) {
+                // A combiner locks, validates and writes back for us, along with the other commits published meanwhile
+                if (!txn_group_commit(region, txn)) return txn_abort(region, txn);
+            } else {
+                for (size_t i = 0; i < stripes.size(); i++) {
+                    VersionedWriteLock* lock = region->lock(stripes[i]);
+                    // The contention manager may let us wait once for the holder to release it
+                    if (!lock->lock(txn->owner) && !(cm_wait(region, txn, lock) && lock->lock(txn->owner))) {
+                        // Here we must release all previously held locks and cleanup
+                        release_locks(region, stripes, i);
+                        STAT_INC(aborts_commit_lock);
+                        return txn_abort(region, txn);
                     }
-                    delete txn;
-                    return false;
                 }
-            }   
-        }
+                // Now we have every lock we need
 
-        size_t word_size = tm_align(shared);
-        
-        // (6) Commit and release the locks
-        for (auto& keyval : txn->write_set) {
-            void* target_addr = keyval.first;
-            void* val = keyval.second->val;
+                // (4) Increment the global version-clock
+                bool exclusive;
+                version wv = region->clock.tick(txn->owner, exclusive);
 
-            memcpy(target_addr,val,word_size);
-            VersionedWriteLock* lock = &region->locks[(word)target_addr % NUM_LOCKS];
-            // setVersion also unlocks the lock
-            lock->setVersion(wv);
+                // (5) Validate the read-set (only if someone may have committed since the transaction started)
+                if (!exclusive || txn->rv + 1 != wv) {
+                    // Every stripe we read from is recorded once, so each lock is only checked once
+                    if (!txn_validate_reads(region, txn)) {
+                        // Here we must release all previously held locks and cleanup
+                        release_locks(region, stripes, stripes.size());
+                        STAT_INC(aborts_commit_validate);
+                        return txn_abort(region, txn);
+                    }
+                }
+
+                // (6) Commit and release the locks
+                // Multi-version readers may still need the values we overwrite, stripes hold their previous version until we release them
+                if (region->history.enabled()) {
+                    for (char* target_addr : txn->write_set.addrs) {
+                        size_t stripe = region->stripe(target_addr);
+                        region->history.record(stripe, target_addr, region->lock(stripe)->getVersion(), wv);
+                    }
+                }
+                region->ops->write_back(region, txn);
+                region->clock.publish(txn->owner, wv);
+                for (uint32_t stripe : stripes) {
+                    // setVersion also unlocks the lock
+                    region->lock(stripe)->setVersion(wv);
+                }
+            }
+            STAT_HIST(write_set_sizes, txn->write_set.addrs.size());
         }
 
-        // Finally add the allocations from this transaction to the shared segment_list
-        region->list_lock.lock();
-        region->seg_list.splice(region->seg_list.end(), txn->seg_list);
-        region->list_lock.unlock(); 
+        // Finally publish the allocations from this transaction: arena blocks belong to the region already, only large segments join the shared list
+        txn->seg_list.clear();
+        if (unlikely(!txn->large_segs.empty())) {
+            region->list_lock.lock();
+            region->segments.splice(txn->large_segs);
+            region->list_lock.unlock();
+        }
+        STAT_INC(commits);
+        STAT_HIST(read_set_sizes, txn->read_set.stripes.size());
+    } else {
+        STAT_INC(commits_ro);
+    }
+
+    // Every write of an irrevocable transaction is published, the other ones can commit again
+    if (unlikely(txn->irrevocable)) region->irrevocable.store(0);
+    txn->slot->aborts_in_row = 0;
+    txn->slot->leave();
+    // Segments freed by the transaction can only be reclaimed once the transactions that may still read them are over
+    if (!txn->frees.empty()) {
+        region->reclaimer.retire(txn->slot, txn->frees);
+        if (txn->slot->limbo.size() >= Reclaimer::BATCH) region->reclaim(txn->slot);
     }
 
     // Transaction successful, cleanup and return
-    delete txn;
+    if (region->config.cm != CmPolicy::none) cm_committed(txn);
+    pool.release(txn);
     return true;
 }
 
@@ -208,83 +1070,9 @@ bool tm_end(shared_t unused(shared), tx_t tx) noexcept {
  * @return Whether the whole transaction can continue
 **/
 bool tm_read(shared_t shared, tx_t tx, void const* source, size_t size, void* target) noexcept {
-    Transaction *txn = reinterpret_cast<Transaction*>(tx);
     MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
-
-    // Convert void* to char* for bytewise manipulation
-    char* target_start = (char*)(target);
-    char* source_start = (char*)(source);
-
-    // Invariant: size is a multiple of the alignment
-    size_t word_size = tm_align(shared);
-
-    if (txn->is_ro) {
-        // Low-Cost Read-Only Transaction
-        // (2) Run through a speculative execution
-        for (size_t i = 0; i < size; i += word_size) {
-            char* source_addr = source_start + i;
-            char* target_addr = target_start + i;
-
-            // Pre validate read
-            VersionedWriteLock* lock = &region->locks[(word)source_addr % NUM_LOCKS];
-            word version = lock->getVersion();
-            if (lock->isLocked() || version > txn->rv) {
-                delete txn;
-                return false;
-            }
-
-            memcpy(target_addr,source_addr,word_size);
-
-            // Post validate read
-            word new_version = lock->getVersion();
-            if (lock->isLocked() || new_version != version || new_version > txn->rv) {
-                delete txn;
-                return false;
-            }
-        }
-    } else {
-        // Write Transaction (2)
-
-        // Go through every word we want to read from and pre/post validate it
-        for (size_t i = 0; i < size; i += word_size) {
-            char* source_addr = source_start + i;
-            char* target_addr = target_start + i;
-
-            // Get the lock which protects the address we want to read from.
-            VersionedWriteLock* lock = &region->locks[(word)source_addr % NUM_LOCKS];
-
-            // Pre validate read
-            word version = lock->getVersion();
-            if (lock->isLocked() || version > txn->rv) {
-                //dprint2("Failed prevalidate HERE");
-                delete txn;
-                return false;
-            }
-
-            
-            // Check if the address was written to previously.
-            // This will determine if we need to read from the write set or the shared memory region
-            char* val_addr = nullptr;
-            auto it = txn->write_set.find(source_addr);
-            if (it != txn->write_set.end()) val_addr = (char*)it->second->val;
-            else val_addr = source_addr;
-
-            // We also copy the value directly. This technically breaks isolation, but we don't care since the value will be ignored if we later find out that the transaction must abort
-            memcpy(target_addr,val_addr,word_size);
-
-            // Post validate read
-            word new_version = lock->getVersion();
-            if (lock->isLocked() || new_version != version) {
-                //dprint2("Failed postvalidate HERE");
-                delete txn;
-                return false;
-            }
-
-            // Keep track of all of the places we read from
-            txn->read_set.insert(source_addr);
-        }
-    }
-    return true;
+    if (is_inline(tx)) return region->ops->read_inline(region, tx, (char*)(source), size, (char*)(target));
+    return region->ops->read(region, reinterpret_cast<Transaction*>(tx), (char*)(source), size, (char*)(target));
 }
 
 /** [thread-safe] Write operation in the given transaction, source in a private region and target in the shared region.
@@ -296,27 +1084,9 @@ bool tm_read(shared_t shared, tx_t tx, void const* source, size_t size, void* ta
  * @return Whether the whole transaction can continue
 **/
 bool tm_write(shared_t shared, tx_t tx, void const* source, size_t size, void* target) noexcept {
-
     // Write Transaction (2)
-    Transaction *txn = reinterpret_cast<Transaction*>(tx);
-
-    // Convert to char* for easy bytewise manipulation
-    char* target_start = (char*)(target);
-    char* source_start = (char*)(source);
-
-    // Invariant: size is a multiple of the alignment
-    size_t word_size = tm_align(shared);
-
-    // Go through every word we want to write to and add it to the write set
-    for (size_t i = 0; i < size; i += word_size) {
-        char* source_addr = source_start + i;
-        char* target_addr = target_start + i;
-
-        // Keep track of all of the places we will need to write to
-        // This WriteOperation implicitly stores the value we want to write in dynamic memory, as we don't know how big it will be until the alignment is given.
-        txn->write_set.insert_or_assign(target_addr,make_unique<WriteOperation>(source_addr,word_size));
-    }
-    return true;
+    MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
+    return region->ops->write(region, reinterpret_cast<Transaction*>(tx), (char*)(source), size, (char*)(target));
 }
 
 /** [thread-safe] Memory allocation in the given transaction.
@@ -328,19 +1098,24 @@ bool tm_write(shared_t shared, tx_t tx, void const* source, size_t size, void* t
 **/
 Alloc tm_alloc(shared_t shared, tx_t tx, size_t size, void** target) noexcept {
     Transaction *txn = reinterpret_cast<Transaction*>(tx);
+    MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
 
+    // Allocating may have to go to the system, which hardware transactions can't do
+    if (txn->in_htm) htm_abort_fallback();
 
-    void* new_seg = aligned_alloc(tm_align(shared), size);
-    if (unlikely(!new_seg)) return Alloc::nomem;
-
-    // Zero out the new allocation, as required
-    memset(new_seg, 0, size);
+    // The segment comes zeroed, as required
+    SegmentHeader* seg = region->alloc_segment(size, txn->slot);
+    if (unlikely(!seg)) return Alloc::nomem;
 
     // Add the segment to the local transaction seg
-    // This means if the transaction aborts we can free it without any other transactions seeing it.
-    txn->seg_list.push_back(new_seg);
+    // This means if the transaction aborts we can give it back without any other transactions seeing it.
+    if (likely(seg->size_class != LARGE_SEGMENT)) {
+        txn->seg_list.push_back(seg);
+    } else {
+        txn->large_segs.push_back(seg);
+    }
 
-    *target = new_seg;
+    *target = region->data(seg);
 
     return Alloc::success;
 }
@@ -351,8 +1126,145 @@ Alloc tm_alloc(shared_t shared, tx_t tx, size_t size, void** target) noexcept {
  * @param target Address of the first byte of the previously allocated segment to deallocate
  * @return Whether the whole transaction can continue
 **/
-bool tm_free(shared_t unused(shared), tx_t unused(tx), void* unused(target)) noexcept {
-    // We just keep tm_free as a dummy function in this implementation. The result is that successful transactions slowly build up memory until we call tm_destroy.
-    // I did try other implementations where we would keep track of everything and have full open memory, but it slowed the implementation down a ton by having to lock global data structures.
+bool tm_free(shared_t shared, tx_t tx, void* target) noexcept {
+    Transaction *txn = reinterpret_cast<Transaction*>(tx);
+    MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
+
+    // The first segment is not free-able
+    if (unlikely(target == region->start)) return true;
+
+    // Freeing goes through the epochs, it is left to the software path
+    if (txn->in_htm) htm_abort_fallback();
+
+    // Nothing happens before commit: an aborted transaction must leave the segment alone, and a committed one retires it (see Reclaimer)
+    // The owner tags and epochs keep this free of global locks, the region list is only locked once per batch of reclaimed segments.
+    txn->frees.push_back(region->header(target));
     return true;
 }
+
+/** [thread-safe] Take a savepoint in the given transaction: from then on, an operation that fails leaves the transaction alive, and tm_rollback
+ * restarts it from the savepoint rather than from its beginning, keeping the reads, writes, allocations and frees done until then.
+ * A later savepoint replaces the earlier one.
+ * @param shared Shared memory region associated with the transaction
+ * @param tx     Transaction to use
+ * @return Whether the savepoint was taken, otherwise the transaction goes on as if nothing happened
+**/
+bool tm_savepoint(shared_t shared, tx_t tx) noexcept {
+    if (is_inline(tx)) return false;
+    Transaction* txn = reinterpret_cast<Transaction*>(tx);
+    MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
+
+    // Only software transactions that log their reads and write back at commit can restart from the middle:
+    // the prefix is revalidated from the read set, and encounter-time locking would have to undo part of its writes in place
+    if (txn->in_htm || txn->irrevocable || region->config.engine == EngineMode::etl) return false;
+    if (txn->is_ro && (!region->config.extend || region->history.enabled())) return false;
+
+    // Every read so far was validated against the snapshot already, the prefix only has to be checked again when rolling back to it
+    Savepoint& savepoint = txn->savepoint;
+    savepoint.held = true;
+    savepoint.reads = txn->read_set.stripes.size();
+    savepoint.values_read = txn->read_values.size();
+    savepoint.frees = txn->frees.size();
+    savepoint.segs = txn->seg_list.head.prev;
+    savepoint.large_segs = txn->large_segs.head.prev;
+    savepoint.written.assign(txn->write_set.values.begin(), txn->write_set.values.end());
+    STAT_INC(savepoints);
+    return true;
+}
+
+/** [thread-safe] Roll the given transaction back to its savepoint, after one of its operations failed.
+ * Everything done since the savepoint is undone, and the transaction moves on to a newer snapshot if nothing it read before the savepoint changed.
+ * The transaction must hold a savepoint: without one, the failed operation aborted it already and its handle is no longer valid.
+ * Handles without a descriptor never hold one, so they are turned down before being looked at.
+ * @param shared Shared memory region associated with the transaction
+ * @param tx     Transaction to roll back
+ * @return Whether the transaction can go on from its savepoint, otherwise it aborted as a whole
+**/
+bool tm_rollback(shared_t shared, tx_t tx) noexcept {
+    if (is_inline(tx)) return false;
+    Transaction* txn = reinterpret_cast<Transaction*>(tx);
+    MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
+    Savepoint& savepoint = txn->savepoint;
+    // Precondition violation: the descriptor went back to the pool with the abort, there is nothing left to release
+    if (unlikely(!savepoint.held)) return false;
+
+    // Forget what the transaction did since the savepoint, the segments it allocated meanwhile are still unpublished
+    txn->read_set.truncate(savepoint.reads);
+    txn->read_values.truncate(savepoint.values_read);
+    txn->write_set.restore(savepoint.written);
+    txn->frees.resize(savepoint.frees);
+    SegmentList rest;
+    txn->seg_list.split_after(savepoint.segs, rest);
+    for (SegmentHeader* seg = rest.head.next; seg != &rest.head; ) {
+        SegmentHeader* next = seg->next;
+        txn->slot->arena.recycle(seg);
+        seg = next;
+    }
+    rest.clear();
+    txn->large_segs.split_after(savepoint.large_segs, rest);
+    rest.free_all();
+
+    // The prefix is still consistent on a newer snapshot if nothing it read changed since the old one
+    if (txn_extend(region, txn) || (region->config.value_check && txn_extend_values(region, txn, SIZE_MAX))) {
+        STAT_INC(savepoint_rollbacks);
+        return true;
+    }
+    STAT_INC(savepoint_failures);
+    // The attempt that failed after the savepoint already counted as an abort
+    savepoint.held = false;
+    txn->slot->leave();
+    pool.release(txn);
+    return false;
+}
+
+/** Read one of the library counters, summed over all threads. They are only maintained in builds with TM_STATS defined.
+ * @param shared Shared memory region (unused, counters are process-wide)
+ * @param name   Counter name (see stats.cpp for the list)
+ * @param value  Receives the counter value
+ * @return Whether the counter exists in this build
+**/
+bool tm_counter(shared_t unused(shared), char const* name, uint64_t* value) noexcept {
+#ifdef TM_STATS
+    return sum_counter(name, *value);
+#else
+    (void) name;
+    (void) value;
+    return false;
+#endif
+}
+
+/** [thread-safe] Tell which memory backs the region, to check what the pages option really got.
+ * @param shared Shared memory region to query
+ * @return Weakest backing of the lock table, first segment and arena slabs allocated so far: "heap", "pages", "thp" or "hugetlb"
+**/
+char const* tm_backing(shared_t shared) noexcept {
+    MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
+    return backing_name(region->backing());
+}
+
+/** Write every library counter, summed over all threads, as "name value" lines. They are only maintained in builds with TM_STATS defined.
+ * @param shared Shared memory region (unused, counters are process-wide)
+ * @param buffer Receives the text, always null-terminated if size > 0
+ * @param size   Size of the buffer, in bytes
+ * @return Length of the whole text (it was truncated if >= size), 0 if this build keeps no counters
+**/
+size_t tm_stats(shared_t unused(shared), char* buffer, size_t size) noexcept {
+#ifdef TM_STATS
+    string text;
+    try {
+        text = format_counters();
+    } catch (...) {
+        return 0;
+    }
+    if (size > 0) {
+        size_t len = min(text.size(), size - 1);
+        memcpy(buffer, text.data(), len);
+        buffer[len] = '\0';
+    }
+    return text.size();
+#else
+    (void) buffer;
+    (void) size;
+    return 0;
+#endif
+}
@@ -0,0 +1,111 @@
+/**
+ * @file   affinity.hpp
+ * @author Ryan Maxin
+ *
+ * @section DESCRIPTION
+ *
+ * Pinning of the worker threads to cores or NUMA nodes.
+**/
+
+#pragma once
+
+// External headers
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+extern "C" {
+#include <pthread.h>
+#include <sched.h>
+}
+
+// -------------------------------------------------------------------------- //
+
+/** Thread pinning policy.
+**/
+enum class Pinning {
+    none,   // Leave the placement to the OS (default)
+    cores,  // Worker i runs on the i-th usable CPU only, round-robin
+    sockets // Worker i runs on any CPU of the (i mod #nodes)-th NUMA node, i.e. workers are spread over the nodes
+};
+
+/** CPU topology, as far as pinning is concerned.
+**/
+class Topology final {
+private:
+    ::std::vector<int> cpus;                // Usable CPUs, in increasing order
+    ::std::vector<::std::vector<int>> nodes; // Usable CPUs of every NUMA node that has some
+private:
+    /** Parse a sysfs CPU list (e.g. "0-3,8-11").
+     * @param path Path of the list
+     * @return CPUs of the list, empty if it cannot be read
+    **/
+    static ::std::vector<int> read_cpu_list(::std::string const& path) {
+        ::std::vector<int> res;
+        auto file = ::std::fopen(path.c_str(), "r");
+        if (!file)
+            return res;
+        int first, last;
+        while (::std::fscanf(file, "%d", &first) == 1) {
+            last = first;
+            auto sep = ::std::fgetc(file);
+            if (sep == '-') {
+                if (::std::fscanf(file, "%d", &last) != 1)
+                    break;
+                sep = ::std::fgetc(file);
+            }
+            for (auto cpu = first; cpu <= last; ++cpu)
+                res.push_back(cpu);
+            if (sep != ',')
+                break;
+        }
+        ::std::fclose(file);
+        return res;
+    }
+public:
+    /** Discovery constructor, restricted to the CPUs the process may run on.
+    **/
+    Topology() {
+        ::cpu_set_t set;
+        CPU_ZERO(&set);
+        if (::sched_getaffinity(0, sizeof(set), &set) != 0)
+            return;
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set))
+                cpus.push_back(cpu);
+        }
+        for (auto node: read_cpu_list("/sys/devices/system/node/online")) {
+            ::std::vector<int> usable;
+            for (auto cpu: read_cpu_list("/sys/devices/system/node/node" + ::std::to_string(node) + "/cpulist")) {
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &set))
+                    usable.push_back(cpu);
+            }
+            if (!usable.empty())
+                nodes.push_back(::std::move(usable));
+        }
+        if (nodes.empty()) // No NUMA information, a single node then
+            nodes.push_back(cpus);
+    }
+public:
+    /** Pin a worker thread.
+     * @param thread Thread to pin
+     * @param index  Index of the worker
+     * @param policy Pinning policy
+     * @return Whether the thread was pinned (always true for 'Pinning::none')
+    **/
+    bool pin(::std::thread& thread, size_t index, Pinning policy) const {
+        if (policy == Pinning::none)
+            return true;
+        if (cpus.empty())
+            return false;
+        ::cpu_set_t set;
+        CPU_ZERO(&set);
+        if (policy == Pinning::cores) {
+            CPU_SET(cpus[index % cpus.size()], &set);
+        } else {
+            for (auto cpu: nodes[index % nodes.size()])
+                CPU_SET(cpu, &set);
+        }
+        return ::pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+    }
+};
@@ -0,0 +1,26 @@
+#!/bin/sh
+# Compare the version clock policies of the 394984 library on the bank workload, across thread counts.
+# Usage: ./bench-clocks.sh [seed] [thread count]...
+# Extra region options can be passed through TM_OPTIONS, the clock is appended to them.
+
+SEED=${1:-453}
+[ $# -gt 0 ] && shift
+THREADS=${*:-"1 2 4 8 16"}
+CLOCKS="gv1 gv4 gv5 gv6 sharded"
+
+cd "$(dirname "$0")" || exit 1
+printf "%-8s %-8s %12s %8s\n" threads clock "time (ms)" speedup
+for NB in $THREADS; do
+    for CLOCK in $CLOCKS; do
+        RES=$(GRADING_WORKERS=$NB TM_OPTIONS="${TM_OPTIONS:+$TM_OPTIONS,}clock=$CLOCK" ./grading "$SEED" ../reference.so ../394984.so 2>&1)
+        # The second timing line is the one of the tested library
+        LINE=$(echo "$RES" | grep "Total user execution time" | sed -n 2p)
+        if [ -z "$LINE" ]; then
+            printf "%-8s %-8s %12s %8s\n" "$NB" "$CLOCK" failed -
+            continue
+        fi
+        TIME=$(echo "$LINE" | sed 's/.*time: \([0-9.]*\) ms.*/\1/')
+        SPEEDUP=$(echo "$LINE" | sed 's/.*-> \([0-9.]*\) speedup.*/\1/')
+        printf "%-8s %-8s %12s %8s\n" "$NB" "$CLOCK" "$TIME" "$SPEEDUP"
+    done
+done
@@ -0,0 +1,32 @@
+#!/bin/sh
+# Run the grading checks of the 394984 library under the option combinations that once broke them.
+# Usage: ./check-options.sh [seed]
+# Every line of CASES is the TM_OPTIONS of a run followed by the workloads to run it on. Exits with 1 if any run fails.
+
+SEED=${1:-454}
+CASES="
+mvcc=1,clock=gv5 bank map queue
+mvcc=1,clock=gv6 bank map queue
+engine=etl,clock=gv5 bank map queue
+engine=etl,clock=gv6 bank map queue
+pages=thp bank map queue
+"
+
+cd "$(dirname "$0")" || exit 1
+STATUS=0
+while read -r OPTIONS WORKLOADS; do
+    [ -z "$OPTIONS" ] && continue
+    for WORKLOAD in $WORKLOADS; do
+        RES=$(TM_OPTIONS="$OPTIONS" ./grading --workload="$WORKLOAD" --threads=8 --txs=40000 --repeats=2 "$SEED" ../reference.so ../394984.so 2>&1)
+        # Both libraries print their timing when nothing went wrong
+        if [ "$(echo "$RES" | grep -c "Total user execution time")" -eq 2 ]; then
+            printf "%-24s %-8s ok\n" "$OPTIONS" "$WORKLOAD"
+        else
+            printf "%-24s %-8s failed: %s\n" "$OPTIONS" "$WORKLOAD" "$(echo "$RES" | tail -n 1 | sed 's/^[^A-Za-z]*//')"
+            STATUS=1
+        fi
+    done
+done <<END
+$CASES
+END
+exit $STATUS
@@ -24,13 +24,23 @@
 // External headers
 #include <algorithm>
 #include <atomic>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <random>
+#include <stdexcept>
+#include <string>
 #include <variant>
+#include <vector>
 
 // Internal headers
+#include "affinity.hpp"
 #include "common.hpp"
+#include "perf.hpp"
 #include "transactional.hpp"
 #include "workload.hpp"
 
@@ -146,9 +156,13 @@ public:
  * @param maxtick_init Timeout for (re)initialization ('Chrono::invalid_tick' for none)
  * @param maxtick_perf Timeout for performance measurements ('Chrono::invalid_tick' for none)
  * @param maxtick_chck Timeout for correctness check ('Chrono::invalid_tick' for none)
- * @return Error constant null-terminated string ('nullptr' for none), execution times (in ns) (undefined if inconsistency detected)
+ * @param profiles     Profile of each thread, recording the transactions of the performance measurements ('nullptr' for none)
+ * @param pinning      Placement of the threads on the CPUs
+ * @param perfs        Hardware counters of each thread, counting during the performance measurements ('nullptr' for none)
+ * @return Error constant null-terminated string ('nullptr' for none), execution times (in ns) of the initialization, median repetition, check, fastest and slowest repetitions (undefined if inconsistency detected)
 **/
-static auto measure(Workload& workload, unsigned int const nbthreads, unsigned int const nbrepeats, Seed seed, Chrono::Tick maxtick_init, Chrono::Tick maxtick_perf, Chrono::Tick maxtick_chck) {
+static auto measure(Workload& workload, unsigned int const nbthreads, unsigned int const nbrepeats, Seed seed, Chrono::Tick maxtick_init, Chrono::Tick maxtick_perf, Chrono::Tick maxtick_chck, TxProfile* profiles = nullptr, Pinning pinning = Pinning::none, PerfCounters* perfs = nullptr) {
+    static Topology const topology;
     ::std::vector<::std::thread> threads(nbthreads);
     ::std::mutex  cerrlock;        // To avoid interleaving writes to 'cerr' in case more than one thread throw
     Sync          sync{nbthreads}; // "As-synchronized-as-possible" starts so that threads interfere "as-much-as-possible"
@@ -166,10 +180,21 @@ static auto measure(Workload& workload, unsigned int const nbthreads, unsigned i
                     sync.worker_notify(workload.init()); // Runs the test and tells the master about errors
 
                     // 2. Performance measurements
+                    TxProfile::current = profiles ? &profiles[i] : nullptr;
+                    if (perfs)
+                        perfs[i].open();
                     for (unsigned int count = 0; count < nbrepeats; ++count) {
                         if (!sync.worker_wait()) return;
-                        sync.worker_notify(workload.run(i, seed + nbthreads * count + i));
+                        if (perfs)
+                            perfs[i].start();
+                        auto error = workload.run(i, seed + nbthreads * count + i);
+                        if (perfs)
+                            perfs[i].stop(); // Before the master gets notified, so that the waits between repetitions are not counted
+                        sync.worker_notify(error);
                     }
+                    TxProfile::current = nullptr;
+                    if (perfs)
+                        perfs[i].collect();
 
                     // 3. Correctness check
                     if (!sync.worker_wait()) return;
@@ -187,6 +212,10 @@ static auto measure(Workload& workload, unsigned int const nbthreads, unsigned i
                     return;
                 }
             }, i};
+            if (unlikely(!topology.pin(threads[i], i, pinning))) {
+                ::std::unique_lock<decltype(cerrlock)> guard{cerrlock};
+                ::std::cerr << "⎪ Could not pin worker " << i << ", leaving it where the OS puts it" << ::std::endl;
+            }
         } catch (...) {
             for (unsigned int j = 0; j < i; ++j) // Detach threads to avoid termination due to attached thread going out of scope
                 threads[j].detach();
@@ -203,6 +232,8 @@ static auto measure(Workload& workload, unsigned int const nbthreads, unsigned i
         Chrono::Tick time_init = Chrono::invalid_tick;
         Chrono::Tick times[nbrepeats];
         Chrono::Tick time_chck = Chrono::invalid_tick;
+        Chrono::Tick time_min  = Chrono::invalid_tick;
+        Chrono::Tick time_max  = Chrono::invalid_tick;
         auto const posmedian = nbrepeats / 2;
         { // Initialization (with cheap correctness test)
             sync.master_notify(); // We tell workers to start working.
@@ -223,6 +254,9 @@ static auto measure(Workload& workload, unsigned int const nbthreads, unsigned i
                 }
                 times[i] = ::std::get<Chrono>(res).get_tick();
             }
+            auto minmax = ::std::minmax_element(times, times + nbrepeats);
+            time_min = *minmax.first;
+            time_max = *minmax.second;
             ::std::nth_element(times, times + posmedian, times + nbrepeats); // Partition times around the median
         }
         { // Correctness check
@@ -239,7 +273,7 @@ static auto measure(Workload& workload, unsigned int const nbthreads, unsigned i
             for (unsigned int i = 0; i < nbthreads; ++i)
                 threads[i].join();
         }
-        return ::std::make_tuple(error, time_init, times[posmedian], time_chck);
+        return ::std::make_tuple(error, time_init, times[posmedian], time_chck, time_min, time_max);
     } catch (...) {
         for (unsigned int i = 0; i < nbthreads; ++i) // Detach threads to avoid termination due to attached thread going out of scope
             threads[i].detach();
@@ -249,6 +283,346 @@ static auto measure(Workload& workload, unsigned int const nbthreads, unsigned i
 
 // -------------------------------------------------------------------------- //
 
+/** Output format of the results.
+**/
+enum class Format {
+    Text, // Human-readable report (default)
+    Csv,  // One line per library and configuration, after a header line
+    Json  // One object per library and configuration, in an array
+};
+
+/** Run parameters, given as '--name=value' options before the positional arguments.
+ * The thread counts and long transaction probabilities are lists, every combination of them is measured.
+**/
+struct Parameters {
+    ::std::vector<::std::string> workloads; // Workload names, see 'make_workload'
+    ::std::vector<size_t> threads;    // Worker thread counts
+    ::std::vector<float>  prob_longs; // Probabilities of running a long, read-only transaction, i.e. the read/write mixes
+    size_t nbtxs      = 200000ul;     // Transactions per repetition, shared among the workers
+    size_t nbaccounts = 32;           // Initial accounts per worker (8 times as many are expected)
+    float  prob_alloc = 0.01f;        // Probability of running an allocation transaction
+    unsigned int nbrepeats = 7;       // Repetitions, the median one is kept
+    Format format     = Format::Text;
+    bool   latency    = false;        // Whether to profile the latency and retries of each kind of transaction
+    bool   perf       = false;        // Whether to count hardware events during the performance measurements
+    Pinning pinning   = Pinning::none; // Placement of the workers on the CPUs
+};
+
+/** Build a workload by name.
+ * The set workloads draw their keys among the initial number of accounts of the bank, or the expected one for the hash map, and the queue starts half that long.
+ * @param name          Workload name: bank, map, list, skiplist or queue
+ * @param tl            Transactional library to use
+ * @param nbworkers     Total number of concurrent threads
+ * @param nbtxperwrk    Number of transactions per worker
+ * @param nbaccounts    Initial number of accounts of the bank
+ * @param expnbaccounts Expected total number of accounts of the bank
+ * @param init_balance  Initial account balance of the bank
+ * @param prob_long     Probability of running a long, read-only transaction
+ * @param prob_alloc    Probability of running an allocation/deallocation transaction in the bank
+ * @return Workload, 'nullptr' if the name is unknown
+**/
+static ::std::unique_ptr<Workload> make_workload(::std::string const& name, TransactionalLibrary const& tl, size_t nbworkers, size_t nbtxperwrk, size_t nbaccounts, size_t expnbaccounts, WorkloadBank::Balance init_balance, float prob_long, float prob_alloc) {
+    if (name == "bank")
+        return ::std::make_unique<WorkloadBank>(tl, nbworkers, nbtxperwrk, nbaccounts, expnbaccounts, init_balance, prob_long, prob_alloc);
+    if (name == "map")
+        return ::std::make_unique<WorkloadHashMap>(tl, nbworkers, nbtxperwrk, expnbaccounts, prob_long);
+    if (name == "list")
+        return ::std::make_unique<WorkloadSortedList>(tl, nbworkers, nbtxperwrk, nbaccounts, prob_long);
+    if (name == "skiplist")
+        return ::std::make_unique<WorkloadSkipList>(tl, nbworkers, nbtxperwrk, nbaccounts, prob_long);
+    if (name == "queue")
+        return ::std::make_unique<WorkloadQueue>(tl, nbworkers, nbtxperwrk, nbaccounts / 2, prob_long);
+    return nullptr;
+}
+
+/** Split a comma-separated list of values.
+ * @param list  List to parse
+ * @param parse Conversion of one element
+ * @return Parsed values
+**/
+template<class Type, class Parse> static ::std::vector<Type> parse_list(::std::string const& list, Parse parse) {
+    ::std::vector<Type> res;
+    size_t pos = 0;
+    while (true) {
+        auto end = list.find(',', pos);
+        res.push_back(parse(list.substr(pos, end == ::std::string::npos ? ::std::string::npos : end - pos)));
+        if (end == ::std::string::npos)
+            return res;
+        pos = end + 1;
+    }
+}
+
+/** Parse one '--name=value' option.
+ * @param params Parameters to update
+ * @param option Option, without the leading dashes
+ * @return Whether the option is known and its value well-formed and in range
+**/
+static bool parse_option(Parameters& params, ::std::string const& option) try {
+    if (option == "latency") {
+        params.latency = true;
+        return true;
+    }
+    if (option == "perf") {
+        params.perf = true;
+        return true;
+    }
+    auto equal = option.find('=');
+    if (equal == ::std::string::npos)
+        return false;
+    auto name  = option.substr(0, equal);
+    auto value = option.substr(equal + 1);
+    // 'stoul' would wrap negative numbers around, and both conversions accept trailing garbage
+    auto to_size = [](::std::string const& str) {
+        size_t end;
+        auto res = ::std::stoul(str, &end);
+        if (str.find('-') != ::std::string::npos || end != str.size())
+            throw ::std::invalid_argument{"malformed count"};
+        return static_cast<size_t>(res);
+    };
+    auto to_float = [](::std::string const& str) {
+        size_t end;
+        auto res = ::std::stof(str, &end);
+        if (end != str.size())
+            throw ::std::invalid_argument{"malformed probability"};
+        return res;
+    };
+    auto is_prob = [](float p) { return p >= 0.f && p <= 1.f; }; // False for NaN too
+    if (name == "workload") {
+        params.workloads = parse_list<::std::string>(value, [](::std::string const& str) { return str; });
+        for (auto const& workload: params.workloads) {
+            if (workload != "bank" && workload != "map" && workload != "list" && workload != "skiplist" && workload != "queue")
+                return false;
+        }
+    } else if (name == "threads") {
+        params.threads = parse_list<size_t>(value, to_size);
+        for (auto nbworkers: params.threads) {
+            if (nbworkers == 0)
+                return false;
+        }
+    } else if (name == "long") {
+        params.prob_longs = parse_list<float>(value, to_float);
+        for (auto prob: params.prob_longs) {
+            if (!is_prob(prob))
+                return false;
+        }
+    } else if (name == "txs") {
+        params.nbtxs = to_size(value);
+        if (params.nbtxs == 0)
+            return false;
+    } else if (name == "accounts") {
+        params.nbaccounts = to_size(value);
+    } else if (name == "alloc") {
+        params.prob_alloc = to_float(value);
+        if (!is_prob(params.prob_alloc))
+            return false;
+    } else if (name == "repeats") {
+        auto nbrepeats = to_size(value);
+        if (nbrepeats == 0 || nbrepeats > ::std::numeric_limits<unsigned int>::max())
+            return false;
+        params.nbrepeats = static_cast<unsigned int>(nbrepeats);
+    } else if (name == "pin") {
+        if (value == "none") {
+            params.pinning = Pinning::none;
+        } else if (value == "cores") {
+            params.pinning = Pinning::cores;
+        } else if (value == "sockets") {
+            params.pinning = Pinning::sockets;
+        } else {
+            return false;
+        }
+    } else if (name == "format") {
+        if (value == "text") {
+            params.format = Format::Text;
+        } else if (value == "csv") {
+            params.format = Format::Csv;
+        } else if (value == "json") {
+            params.format = Format::Json;
+        } else {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    return true;
+} catch (::std::logic_error const&) { // Malformed or out-of-range number, from the conversions
+    return false;
+}
+
+/** Result of one library on one configuration.
+**/
+struct Record {
+    char const* library;
+    char const* workload;
+    size_t nbworkers;
+    size_t nbtxperwrk;
+    size_t nbaccounts;
+    float  prob_long;
+    float  prob_alloc;
+    unsigned int nbrepeats;
+    double median;     // Execution times, in ns
+    double fastest;
+    double slowest;
+    double speedup;    // Against the reference on the same configuration, 0 for the reference itself
+    char const* error; // Error message, 'nullptr' for none
+    TxProfile const* profile; // Merged profile of the workers, 'nullptr' if not profiling
+    PerfSample const* perf;   // Hardware counts summed over the workers, per repetition, 'nullptr' if not counting
+};
+
+constexpr static double percentiles[] = {0.5, 0.9, 0.99, 0.999}; // Reported latency percentiles
+constexpr static char const* percentile_names[] = {"p50", "p90", "p99", "p999"};
+
+/** Print the latency and retries of each kind of transaction in the human-readable format.
+ * @param profile Merged profile of the workers
+**/
+static void print_profile(TxProfile const& profile) {
+    for (size_t k = 0; k < static_cast<size_t>(TxKind::count); ++k) {
+        auto const kind = static_cast<TxKind>(k);
+        auto const& stats = profile.get(kind);
+        if (stats.latency.get_count() == 0)
+            continue;
+        ::std::cout << "⎪ " << tx_kind_name(kind) << " TX latency (ns):";
+        for (size_t i = 0; i < ::std::size(percentiles); ++i)
+            ::std::cout << " " << percentile_names[i] << " " << stats.latency.percentile(percentiles[i]);
+        ::std::cout << ", retries: p50 " << stats.retries.percentile(0.5) << " p99 " << stats.retries.percentile(0.99) << " max " << stats.retries.get_max() << " (" << stats.latency.get_count() << " TX)" << ::std::endl;
+    }
+}
+
+/** Print the hardware counts in the human-readable format.
+ * @param perf Counts summed over the workers, per repetition
+**/
+static void print_perf(PerfSample const& perf) {
+    ::std::cout << "⎪ Perf counters (per repetition):";
+    for (size_t e = 0; e < static_cast<size_t>(PerfEvent::count); ++e) {
+        auto const event = static_cast<PerfEvent>(e);
+        ::std::cout << (e > 0 ? ", " : " ") << perf_event_name(event) << " ";
+        if (perf.has(event)) {
+            ::std::cout << perf.get(event);
+        } else {
+            ::std::cout << "n/a";
+        }
+        if (event == PerfEvent::instructions && perf.has(PerfEvent::cycles) && perf.has(PerfEvent::instructions) && perf.get(PerfEvent::cycles) > 0)
+            ::std::cout << " (IPC " << static_cast<double>(perf.get(PerfEvent::instructions)) / static_cast<double>(perf.get(PerfEvent::cycles)) << ")";
+    }
+    ::std::cout << ::std::endl;
+}
+
+/** Print a string as a JSON string literal, quotes included.
+ * @param str Null-terminated string to print
+**/
+static void print_json_string(char const* str) {
+    ::std::cout << '"';
+    for (; *str; ++str) {
+        auto const c = static_cast<unsigned char>(*str);
+        if (c == '"' || c == '\\') {
+            ::std::cout << '\\' << *str;
+        } else if (c < 0x20) { // Control characters must be escaped, as \u00XX
+            char buf[7];
+            ::std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            ::std::cout << buf;
+        } else {
+            ::std::cout << *str;
+        }
+    }
+    ::std::cout << '"';
+}
+
+/** Print one record in a machine-readable format.
+ * @param format Csv or Json
+ * @param record Record to print
+ * @param first  Whether this is the first record of the run
+ * @param latency Whether the run profiles the transactions, i.e. the CSV header has the latency columns
+ * @param perf    Whether the run counts hardware events, i.e. the CSV header has their columns
+**/
+static void print_record(Format format, Record const& record, bool first, bool latency, bool perf) {
+    auto const ms = [](double ns) { return ns / 1000000.; };
+    auto const throughput = record.error ? 0. : static_cast<double>(record.nbworkers * record.nbtxperwrk) / (record.median / 1000000000.);
+    if (format == Format::Csv) {
+        if (first) {
+            ::std::cout << "library,workload,threads,txs_per_thread,accounts,prob_long,prob_alloc,repeats,median_ms,min_ms,max_ms,throughput_tps,speedup";
+            if (latency) {
+                for (size_t k = 0; k < static_cast<size_t>(TxKind::count); ++k) {
+                    auto const name = tx_kind_name(static_cast<TxKind>(k));
+                    ::std::cout << "," << name << "_txs";
+                    for (auto percentile: percentile_names)
+                        ::std::cout << "," << name << "_" << percentile << "_ns";
+                    ::std::cout << "," << name << "_retries_p99," << name << "_retries_max";
+                }
+            }
+            if (perf) {
+                for (size_t e = 0; e < static_cast<size_t>(PerfEvent::count); ++e)
+                    ::std::cout << "," << perf_event_name(static_cast<PerfEvent>(e));
+            }
+            ::std::cout << ",error" << ::std::endl;
+        }
+        ::std::cout << record.library << "," << record.workload << "," << record.nbworkers << "," << record.nbtxperwrk << "," << record.nbaccounts << "," << record.prob_long << "," << record.prob_alloc << "," << record.nbrepeats << ",";
+        if (record.error) {
+            ::std::cout << ",,,,"; // The profile and counter columns are left empty as well, so that the error lands under its header
+            if (latency)
+                ::std::cout << ::std::string(static_cast<size_t>(TxKind::count) * (::std::size(percentiles) + 3), ',');
+            if (perf)
+                ::std::cout << ::std::string(static_cast<size_t>(PerfEvent::count), ',');
+        } else {
+            ::std::cout << ms(record.median) << "," << ms(record.fastest) << "," << ms(record.slowest) << "," << throughput << "," << record.speedup;
+            if (record.profile) {
+                for (size_t k = 0; k < static_cast<size_t>(TxKind::count); ++k) {
+                    auto const& stats = record.profile->get(static_cast<TxKind>(k));
+                    ::std::cout << "," << stats.latency.get_count();
+                    for (auto percentile: percentiles)
+                        ::std::cout << "," << stats.latency.percentile(percentile);
+                    ::std::cout << "," << stats.retries.percentile(0.99) << "," << stats.retries.get_max();
+                }
+            }
+            if (record.perf) {
+                for (size_t e = 0; e < static_cast<size_t>(PerfEvent::count); ++e) {
+                    ::std::cout << ",";
+                    if (record.perf->has(static_cast<PerfEvent>(e)))
+                        ::std::cout << record.perf->get(static_cast<PerfEvent>(e)); // Unavailable counts are left empty
+                }
+            }
+        }
+        ::std::cout << "," << (record.error ? record.error : "") << ::std::endl;
+    } else {
+        ::std::cout << (first ? "[" : ",") << ::std::endl;
+        ::std::cout << "  {\"library\": ";
+        print_json_string(record.library);
+        ::std::cout << ", \"workload\": ";
+        print_json_string(record.workload);
+        ::std::cout << ", \"threads\": " << record.nbworkers << ", \"txs_per_thread\": " << record.nbtxperwrk << ", \"accounts\": " << record.nbaccounts << ", \"prob_long\": " << record.prob_long << ", \"prob_alloc\": " << record.prob_alloc << ", \"repeats\": " << record.nbrepeats << ", ";
+        if (record.error) {
+            ::std::cout << "\"error\": ";
+            print_json_string(record.error);
+            ::std::cout << "}";
+        } else {
+            ::std::cout << "\"median_ms\": " << ms(record.median) << ", \"min_ms\": " << ms(record.fastest) << ", \"max_ms\": " << ms(record.slowest) << ", \"throughput_tps\": " << throughput << ", \"speedup\": " << record.speedup;
+            if (record.profile) {
+                ::std::cout << ", \"latency\": {";
+                for (size_t k = 0; k < static_cast<size_t>(TxKind::count); ++k) {
+                    auto const& stats = record.profile->get(static_cast<TxKind>(k));
+                    ::std::cout << (k > 0 ? ", " : "") << "\"" << tx_kind_name(static_cast<TxKind>(k)) << "\": {\"txs\": " << stats.latency.get_count();
+                    for (size_t i = 0; i < ::std::size(percentiles); ++i)
+                        ::std::cout << ", \"" << percentile_names[i] << "_ns\": " << stats.latency.percentile(percentiles[i]);
+                    ::std::cout << ", \"retries_p99\": " << stats.retries.percentile(0.99) << ", \"retries_max\": " << stats.retries.get_max() << "}";
+                }
+                ::std::cout << "}";
+            }
+            if (record.perf) {
+                ::std::cout << ", \"perf\": {";
+                for (size_t e = 0; e < static_cast<size_t>(PerfEvent::count); ++e) {
+                    auto const event = static_cast<PerfEvent>(e);
+                    ::std::cout << (e > 0 ? ", " : "") << "\"" << perf_event_name(event) << "\": ";
+                    if (record.perf->has(event)) {
+                        ::std::cout << record.perf->get(event);
+                    } else {
+                        ::std::cout << "null";
+                    }
+                }
+                ::std::cout << "}";
+            }
+            ::std::cout << "}";
+        }
+    }
+}
+
 /** Program entry point.
  * @param argc Arguments count
  * @param argv Arguments values
@@ -257,97 +631,181 @@ static auto measure(Workload& workload, unsigned int const nbthreads, unsigned i
 int main(int argc, char** argv) {
     try {
         // Parse command line option(s)
-        if (argc < 3) {
-            ::std::cout << "Usage: " << (argc > 0 ? argv[0] : "grading") << " <seed> <reference library path> <tested library path>..." << ::std::endl;
+        Parameters params;
+        auto argi = 1;
+        auto const usage = [&]() {
+            ::std::cout << "Usage: " << (argc > 0 ? argv[0] : "grading") << " [--workload=<bank|map|list|skiplist|queue,...>] [--threads=<n,...>] [--long=<p,...>] [--txs=<n>] [--accounts=<n>] [--alloc=<p>] [--repeats=<n>] [--format=text|csv|json] [--latency] [--perf] [--pin=none|cores|sockets] <seed> <reference library path> <tested library path>..." << ::std::endl;
+            ::std::cout << "Thread, transaction and repetition counts must be positive, with at least one transaction per thread, and probabilities lie in [0, 1]" << ::std::endl;
             return 1;
+        };
+        for (; argi < argc && ::std::strncmp(argv[argi], "--", 2) == 0; ++argi) {
+            if (!parse_option(params, argv[argi] + 2)) {
+                ::std::cout << "Unknown or invalid option '" << argv[argi] << "'" << ::std::endl;
+                return usage();
+            }
         }
+        if (argc - argi < 2)
+            return usage();
         // Get/set/compute run parameters
-        auto const nbworkers = []() {
-            auto res = ::std::thread::hardware_concurrency();
-            if (unlikely(res == 0))
-                res = 16;
-            return static_cast<size_t>(res);
-        }();
-        auto const nbtxperwrk    = 200000ul / nbworkers;
-        auto const nbaccounts    = 32 * nbworkers;
-        auto const expnbaccounts = 256 * nbworkers;
+        if (params.threads.empty()) {
+            // GRADING_WORKERS overrides the number of worker threads, e.g. for scaling benchmarks
+            auto env = ::std::getenv("GRADING_WORKERS");
+            if (env) {
+                if (!parse_option(params, ::std::string{"threads="} + env)) {
+                    ::std::cout << "Invalid GRADING_WORKERS '" << env << "'" << ::std::endl;
+                    return usage();
+                }
+            } else {
+                auto res = ::std::thread::hardware_concurrency();
+                if (unlikely(res == 0))
+                    res = 16;
+                params.threads.push_back(static_cast<size_t>(res));
+            }
+        }
+        // Every worker runs its share of the transactions, so that the throughput is defined
+        for (auto const nbworkers: params.threads) {
+            if (params.nbtxs < nbworkers) {
+                ::std::cout << "Fewer transactions (" << params.nbtxs << ") than threads (" << nbworkers << ")" << ::std::endl;
+                return usage();
+            }
+        }
+        if (params.workloads.empty())
+            params.workloads.push_back("bank");
+        if (params.prob_longs.empty())
+            params.prob_longs.push_back(0.5f);
         auto const init_balance  = 100ul;
-        auto const prob_long     = 0.5f;
-        auto const prob_alloc    = 0.01f;
-        auto const nbrepeats     = 7;
-        auto const seed          = static_cast<Seed>(::std::stoul(argv[1]));
+        auto const prob_alloc    = params.prob_alloc;
+        auto const nbrepeats     = params.nbrepeats;
+        auto const seed          = static_cast<Seed>(::std::stoul(argv[argi]));
         auto const clk_res       = Chrono::get_resolution();
         auto const slow_factor   = 16ul;
-        // Print run parameters
-        ::std::cout << "⎧ #worker threads:     " << nbworkers << ::std::endl;
-        ::std::cout << "⎪ #TX per worker:      " << nbtxperwrk << ::std::endl;
-        ::std::cout << "⎪ #repetitions:        " << nbrepeats << ::std::endl;
-        ::std::cout << "⎪ Initial #accounts:   " << nbaccounts << ::std::endl;
-        ::std::cout << "⎪ Expected #accounts:  " << expnbaccounts << ::std::endl;
-        ::std::cout << "⎪ Initial balance:     " << init_balance << ::std::endl;
-        ::std::cout << "⎪ Long TX probability: " << prob_long << ::std::endl;
-        ::std::cout << "⎪ Allocation TX prob.: " << prob_alloc << ::std::endl;
-        ::std::cout << "⎪ Slow trigger factor: " << slow_factor << ::std::endl;
-        ::std::cout << "⎪ Clock resolution:    ";
-        if (unlikely(clk_res == Chrono::invalid_tick)) {
-            ::std::cout << "<unknown>" << ::std::endl;
-        } else {
-            ::std::cout << clk_res << " ns" << ::std::endl;
-        }
-        ::std::cout << "⎩ Seed value:          " << seed << ::std::endl;
-        // Library evaluations
-        double reference = 0.; // Set to avoid irrelevant '-Wmaybe-uninitialized'
-        auto const pertxdiv = static_cast<double>(nbworkers) * static_cast<double>(nbtxperwrk);
-        auto maxtick_init = Chrono::invalid_tick;
-        auto maxtick_perf = Chrono::invalid_tick;
-        auto maxtick_chck = Chrono::invalid_tick;
-        for (auto i = 2; i < argc; ++i) {
-            ::std::cout << "⎧ Evaluating '" << argv[i] << "'" << (maxtick_init == Chrono::invalid_tick ? " (reference)" : "") << "..." << ::std::endl;
-            // Load TM library
-            TransactionalLibrary tl{argv[i]};
-            // Initialize workload (shared memory lifetime bound to workload: created and destroyed at the same time)
-            WorkloadBank bank{tl, nbworkers, nbtxperwrk, nbaccounts, expnbaccounts, init_balance, prob_long, prob_alloc};
-            try {
-                // Actual performance measurements and correctness check
-                auto res = measure(bank, nbworkers, nbrepeats, seed, maxtick_init, maxtick_perf, maxtick_chck);
-                // Check false negative-free correctness
-                auto error = ::std::get<0>(res);
-                if (unlikely(error)) {
-                    ::std::cout << "⎩ " << error << ::std::endl;
-                    return 1;
-                }
-                // Print results
-                auto tick_init = ::std::get<1>(res);
-                auto tick_perf = ::std::get<2>(res);
-                auto tick_chck = ::std::get<3>(res);
-                auto perfdbl = static_cast<double>(tick_perf);
-                ::std::cout << "⎪ Total user execution time: " << (perfdbl / 1000000.) << " ms";
-                if (maxtick_init == Chrono::invalid_tick) { // Set reference performance
-                    maxtick_init = slow_factor * tick_init;
-                    if (unlikely(maxtick_init == Chrono::invalid_tick)) // Bad luck...
-                        ++maxtick_init;
-                    maxtick_perf = slow_factor * tick_perf;
-                    if (unlikely(maxtick_perf == Chrono::invalid_tick)) // Bad luck...
-                        ++maxtick_perf;
-                    maxtick_chck = slow_factor * tick_chck;
-                    if (unlikely(maxtick_chck == Chrono::invalid_tick)) // Bad luck...
-                        ++maxtick_chck;
-                    reference = perfdbl;
-                } else { // Compare with reference performance
-                    ::std::cout << " -> " << (reference / perfdbl) << " speedup";
-                }
-                ::std::cout << ::std::endl;
-                ::std::cout << "⎩ Average TX execution time: " << (perfdbl / pertxdiv) << " ns" << ::std::endl;
-            } catch (::std::exception const& err) { // Special case: cannot unload library with running threads, so print error and quick-exit
-                ::std::cerr << "⎪ *** EXCEPTION ***" << ::std::endl;
-                ::std::cerr << "⎩ " << err.what() << ::std::endl;
+        auto const text          = params.format == Format::Text;
+        auto first_record = true;
+        for (auto const& workload_name: params.workloads) {
+            for (auto const nbworkers: params.threads) {
+                for (auto const prob_long: params.prob_longs) {
+                    auto const nbtxperwrk    = params.nbtxs / nbworkers;
+                    auto const nbaccounts    = params.nbaccounts * nbworkers;
+                    auto const expnbaccounts = 8 * nbaccounts;
+                    if (text) {
+                        // Print run parameters
+                        ::std::cout << "⎧ Workload:            " << workload_name << ::std::endl;
+                        ::std::cout << "⎪ #worker threads:     " << nbworkers << ::std::endl;
+                        ::std::cout << "⎪ #TX per worker:      " << nbtxperwrk << ::std::endl;
+                        ::std::cout << "⎪ #repetitions:        " << nbrepeats << ::std::endl;
+                        ::std::cout << "⎪ Initial #accounts:   " << nbaccounts << ::std::endl;
+                        ::std::cout << "⎪ Expected #accounts:  " << expnbaccounts << ::std::endl;
+                        ::std::cout << "⎪ Initial balance:     " << init_balance << ::std::endl;
+                        ::std::cout << "⎪ Long TX probability: " << prob_long << ::std::endl;
+                        ::std::cout << "⎪ Allocation TX prob.: " << prob_alloc << ::std::endl;
+                        ::std::cout << "⎪ Slow trigger factor: " << slow_factor << ::std::endl;
+                        ::std::cout << "⎪ Clock resolution:    ";
+                        if (unlikely(clk_res == Chrono::invalid_tick)) {
+                            ::std::cout << "<unknown>" << ::std::endl;
+                        } else {
+                            ::std::cout << clk_res << " ns" << ::std::endl;
+                        }
+                        ::std::cout << "⎩ Seed value:          " << seed << ::std::endl;
+                    }
+                    // Library evaluations
+                    double reference = 0.; // Set to avoid irrelevant '-Wmaybe-uninitialized'
+                    auto const pertxdiv = static_cast<double>(nbworkers) * static_cast<double>(nbtxperwrk);
+                    auto maxtick_init = Chrono::invalid_tick;
+                    auto maxtick_perf = Chrono::invalid_tick;
+                    auto maxtick_chck = Chrono::invalid_tick;
+                    for (auto i = argi + 1; i < argc; ++i) {
+                        if (text)
+                            ::std::cout << "⎧ Evaluating '" << argv[i] << "'" << (maxtick_init == Chrono::invalid_tick ? " (reference)" : "") << "..." << ::std::endl;
+                        // Load TM library
+                        TransactionalLibrary tl{argv[i]};
+                        // Initialize workload (shared memory lifetime bound to workload: created and destroyed at the same time)
+                        ::std::unique_ptr<TxProfile[]> profiles{params.latency ? new TxProfile[nbworkers] : nullptr}; // One per worker, merged after the run
+                        ::std::unique_ptr<PerfCounters[]> perfs{params.perf ? new PerfCounters[nbworkers] : nullptr}; // Likewise
+                        auto workload = make_workload(workload_name, tl, nbworkers, nbtxperwrk, nbaccounts, expnbaccounts, init_balance, prob_long, prob_alloc);
+                        try {
+                            // Actual performance measurements and correctness check
+                            auto res = measure(*workload, nbworkers, nbrepeats, seed, maxtick_init, maxtick_perf, maxtick_chck, profiles.get(), params.pinning, perfs.get());
+                            Record record{argv[i], workload_name.c_str(), nbworkers, nbtxperwrk, nbaccounts, prob_long, prob_alloc, nbrepeats, 0., 0., 0., 0., ::std::get<0>(res), nullptr, nullptr};
+                            // Check false negative-free correctness
+                            auto error = ::std::get<0>(res);
+                            if (unlikely(error)) {
+                                if (text) {
+                                    ::std::cout << "⎩ " << error << ::std::endl;
+                                } else {
+                                    print_record(params.format, record, first_record, params.latency, params.perf);
+                                    if (params.format == Format::Json)
+                                        ::std::cout << ::std::endl << "]" << ::std::endl;
+                                }
+                                return 1;
+                            }
+                            // Print results
+                            auto tick_init = ::std::get<1>(res);
+                            auto tick_perf = ::std::get<2>(res);
+                            auto tick_chck = ::std::get<3>(res);
+                            auto perfdbl = static_cast<double>(tick_perf);
+                            if (text)
+                                ::std::cout << "⎪ Total user execution time: " << (perfdbl / 1000000.) << " ms";
+                            if (maxtick_init == Chrono::invalid_tick) { // Set reference performance
+                                maxtick_init = slow_factor * tick_init;
+                                if (unlikely(maxtick_init == Chrono::invalid_tick)) // Bad luck...
+                                    ++maxtick_init;
+                                maxtick_perf = slow_factor * tick_perf;
+                                if (unlikely(maxtick_perf == Chrono::invalid_tick)) // Bad luck...
+                                    ++maxtick_perf;
+                                maxtick_chck = slow_factor * tick_chck;
+                                if (unlikely(maxtick_chck == Chrono::invalid_tick)) // Bad luck...
+                                    ++maxtick_chck;
+                                reference = perfdbl;
+                            } else { // Compare with reference performance
+                                record.speedup = reference / perfdbl;
+                                if (text)
+                                    ::std::cout << " -> " << record.speedup << " speedup";
+                            }
+                            TxProfile merged;
+                            if (profiles) {
+                                for (size_t w = 0; w < nbworkers; ++w)
+                                    merged.merge(profiles[w]);
+                                record.profile = &merged;
+                            }
+                            PerfSample perf;
+                            if (perfs) {
+                                for (size_t w = 0; w < nbworkers; ++w)
+                                    perf.merge(perfs[w].get(), w == 0);
+                                for (auto& value: perf.values) // Per repetition, like the reported execution time
+                                    value /= nbrepeats;
+                                record.perf = &perf;
+                            }
+                            if (text) {
+                                ::std::cout << ::std::endl;
+                                if (workload->get_backing())
+                                    ::std::cout << "⎪ Memory backing: " << workload->get_backing() << ::std::endl;
+                                if (record.profile)
+                                    print_profile(merged);
+                                if (record.perf)
+                                    print_perf(perf);
+                                ::std::cout << "⎩ Average TX execution time: " << (perfdbl / pertxdiv) << " ns" << ::std::endl;
+                            } else {
+                                record.median  = perfdbl;
+                                record.fastest = static_cast<double>(::std::get<4>(res));
+                                record.slowest = static_cast<double>(::std::get<5>(res));
+                                print_record(params.format, record, first_record, params.latency, params.perf);
+                                first_record = false;
+                            }
+                        } catch (::std::exception const& err) { // Special case: cannot unload library with running threads, so print error and quick-exit
+                            ::std::cerr << "⎪ *** EXCEPTION ***" << ::std::endl;
+                            ::std::cerr << "⎩ " << err.what() << ::std::endl;
 #ifdef __APPLE__
-                ::std::exit(2);
+                            ::std::exit(2);
 #else
-                ::std::quick_exit(2);
+                            ::std::quick_exit(2);
 #endif
+                        }
+                    }
+                }
             }
         }
+        if (params.format == Format::Json && !first_record)
+            ::std::cout << ::std::endl << "]" << ::std::endl;
         return 0;
     } catch (::std::exception const& err) {
         ::std::cerr << "⎧ *** EXCEPTION ***" << ::std::endl;
@@ -0,0 +1,250 @@
+/**
+ * @file   latency.hpp
+ * @author Ryan Maxin
+ *
+ * @section DESCRIPTION
+ *
+ * Per-thread latency and retry histograms of the transactions run by the workloads.
+**/
+
+#pragma once
+
+// External headers
+#include <cstdint>
+#include <cstring>
+#include <exception>
+
+// Internal headers
+#include "common.hpp"
+
+// -------------------------------------------------------------------------- //
+
+/** Kinds of transactions profiled separately.
+**/
+enum class TxKind {
+    long_tx,  // Long read-only transactions
+    alloc_tx, // Transactions that allocate or free memory
+    short_tx, // Other short transactions
+    count,    // Number of profiled kinds
+    none      // Not profiled (initialization and checks)
+};
+
+/** Name of a profiled kind of transaction.
+ * @param kind Profiled kind
+ * @return Constant null-terminated name
+**/
+constexpr static char const* tx_kind_name(TxKind kind) noexcept {
+    switch (kind) {
+    case TxKind::long_tx:
+        return "long";
+    case TxKind::alloc_tx:
+        return "alloc";
+    case TxKind::short_tx:
+        return "short";
+    default:
+        return "none";
+    }
+}
+
+/** HDR-style histogram: exact below 32, then 16 buckets per power of two, i.e. values are recorded within 1/16th of their magnitude.
+**/
+class Histogram final {
+public:
+    /** Value class alias.
+    **/
+    using Value = uint64_t;
+private:
+    constexpr static unsigned int sub_bits  = 5;                // Bits of a value kept by its bucket
+    constexpr static size_t       half      = 1 << (sub_bits - 1);
+    constexpr static size_t       nbbuckets = (64 - sub_bits + 2) * half;
+    Value counts[nbbuckets]; // Number of values recorded in each bucket
+    Value total;             // Number of values recorded
+    Value highest;           // Largest value recorded
+private:
+    /** Bucket of a value.
+     * @param value Value to record
+     * @return Bucket index
+    **/
+    constexpr static size_t bucket(Value value) noexcept {
+        if (value < 2 * half)
+            return value;
+        auto shift = 63 - __builtin_clzll(value) - (sub_bits - 1); // 'value >> shift' is in [half, 2 * half)
+        return (shift + 1) * half + ((value >> shift) - half);
+    }
+    /** Smallest value of a bucket.
+     * @param index Bucket index
+     * @return Smallest value recorded in that bucket
+    **/
+    constexpr static Value lower_bound(size_t index) noexcept {
+        if (index < 2 * half)
+            return index;
+        return static_cast<Value>(index % half + half) << (index / half - 1);
+    }
+public:
+    /** Empty histogram constructor.
+    **/
+    Histogram() noexcept {
+        reset();
+    }
+public:
+    /** Forget every recorded value.
+    **/
+    void reset() noexcept {
+        ::std::memset(counts, 0, sizeof(counts));
+        total   = 0;
+        highest = 0;
+    }
+    /** Record one value.
+     * @param value Value to record
+    **/
+    void record(Value value) noexcept {
+        ++counts[bucket(value)];
+        ++total;
+        if (value > highest)
+            highest = value;
+    }
+    /** Add the values recorded by another histogram.
+     * @param other Histogram to merge
+    **/
+    void merge(Histogram const& other) noexcept {
+        for (size_t i = 0; i < nbbuckets; ++i)
+            counts[i] += other.counts[i];
+        total += other.total;
+        if (other.highest > highest)
+            highest = other.highest;
+    }
+    /** Get the number of recorded values.
+     * @return Number of recorded values
+    **/
+    auto get_count() const noexcept {
+        return total;
+    }
+    /** Get the largest recorded value.
+     * @return Largest recorded value, 0 if none
+    **/
+    auto get_max() const noexcept {
+        return highest;
+    }
+    /** Get a percentile of the recorded values.
+     * @param ratio Percentile, between 0 and 1
+     * @return Largest value of the bucket holding that percentile, 0 if no value was recorded
+    **/
+    Value percentile(double ratio) const noexcept {
+        if (total == 0)
+            return 0;
+        auto rank = static_cast<Value>(ratio * static_cast<double>(total));
+        if (rank >= total)
+            rank = total - 1;
+        Value seen = 0;
+        for (size_t i = 0; i < nbbuckets; ++i) {
+            seen += counts[i];
+            if (seen > rank) {
+                auto upper = i + 1 < nbbuckets ? lower_bound(i + 1) - 1 : highest;
+                return upper < highest ? upper : highest;
+            }
+        }
+        return highest;
+    }
+};
+
+/** Latency (in ns) and retry histograms of one kind of transaction.
+**/
+struct TxStats final {
+    Histogram latency; // From the first attempt to the commit
+    Histogram retries; // Aborted attempts before the commit
+    /** Forget every recorded transaction.
+    **/
+    void reset() noexcept {
+        latency.reset();
+        retries.reset();
+    }
+    /** Add the transactions recorded by other statistics.
+     * @param other Statistics to merge
+    **/
+    void merge(TxStats const& other) noexcept {
+        latency.merge(other.latency);
+        retries.merge(other.retries);
+    }
+};
+
+/** Profile of one worker thread, one set of statistics per kind of transaction.
+**/
+class TxProfile final {
+public:
+    static inline thread_local TxProfile* current = nullptr; // Profile transactions of the calling thread are recorded in, 'nullptr' for none
+private:
+    TxStats stats[static_cast<size_t>(TxKind::count)];
+public:
+    /** Get the statistics of a kind of transaction.
+     * @param kind Profiled kind
+     * @return Statistics of that kind
+    **/
+    auto& get(TxKind kind) noexcept {
+        return stats[static_cast<size_t>(kind)];
+    }
+    auto const& get(TxKind kind) const noexcept {
+        return stats[static_cast<size_t>(kind)];
+    }
+    /** Forget every recorded transaction.
+    **/
+    void reset() noexcept {
+        for (auto& stat: stats)
+            stat.reset();
+    }
+    /** Add the transactions recorded by another profile.
+     * @param other Profile to merge
+    **/
+    void merge(TxProfile const& other) noexcept {
+        for (size_t i = 0; i < static_cast<size_t>(TxKind::count); ++i)
+            stats[i].merge(other.stats[i]);
+    }
+};
+
+/** Recorder of one transaction, from its first attempt to its commit, in the profile of the calling thread.
+**/
+class TxRecorder final {
+public:
+    /** Scope of one attempt, declared before the transaction so that it ends after the commit.
+     * The attempt committed if the scope ends without a new exception in flight.
+    **/
+    class Attempt final {
+    private:
+        TxRecorder& recorder;
+        int exceptions; // Exceptions in flight when the attempt started
+    public:
+        Attempt(TxRecorder& recorder) noexcept: recorder{recorder}, exceptions{::std::uncaught_exceptions()} {}
+        ~Attempt() {
+            if (::std::uncaught_exceptions() == exceptions)
+                recorder.commit();
+        }
+    };
+private:
+    TxStats* stats;          // Statistics to record into, 'nullptr' if not profiling
+    Chrono   chrono;         // Time since the first attempt
+    Histogram::Value nbretries; // Aborted attempts so far
+public:
+    /** First attempt constructor.
+     * @param kind Kind of the transaction
+    **/
+    TxRecorder(TxKind kind) noexcept: stats{nullptr}, nbretries{0} {
+        auto profile = TxProfile::current;
+        if (likely(!profile) || kind == TxKind::none)
+            return;
+        stats = &profile->get(kind);
+        chrono.start();
+    }
+public:
+    /** Note an aborted attempt.
+    **/
+    void retry() noexcept {
+        ++nbretries;
+    }
+    /** Record the committed transaction.
+    **/
+    void commit() noexcept {
+        if (likely(!stats))
+            return;
+        stats->latency.record(chrono.delta());
+        stats->retries.record(nbretries);
+    }
+};
@@ -0,0 +1,205 @@
+/**
+ * @file   perf.hpp
+ * @author Ryan Maxin
+ *
+ * @section DESCRIPTION
+ *
+ * Per-thread hardware performance counters of the measured runs, through perf_event_open on Linux.
+**/
+
+#pragma once
+
+// External headers
+#include <cstdint>
+#ifdef __linux__
+extern "C" {
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+}
+#endif
+
+// -------------------------------------------------------------------------- //
+
+/** Counted events.
+**/
+enum class PerfEvent {
+    cycles,           // CPU cycles in user mode
+    instructions,     // Instructions retired in user mode
+    llc_misses,       // Last-level cache misses in user mode
+    dtlb_misses,      // Data TLB read misses in user mode
+    context_switches, // Context switches of the worker, kernel included
+    count             // Number of counted events
+};
+
+/** Name of a counted event.
+ * @param event Counted event
+ * @return Constant null-terminated name
+**/
+constexpr static char const* perf_event_name(PerfEvent event) noexcept {
+    switch (event) {
+    case PerfEvent::cycles:
+        return "cycles";
+    case PerfEvent::instructions:
+        return "instructions";
+    case PerfEvent::llc_misses:
+        return "llc_misses";
+    case PerfEvent::dtlb_misses:
+        return "dtlb_misses";
+    case PerfEvent::context_switches:
+        return "context_switches";
+    default:
+        return "none";
+    }
+}
+
+/** Counts of the events, summed over the workers that could count them.
+**/
+struct PerfSample final {
+    uint64_t values[static_cast<size_t>(PerfEvent::count)] = {}; // Count of each event
+    bool available[static_cast<size_t>(PerfEvent::count)] = {}; // Whether every merged worker counted the event
+    /** Get the count of an event.
+     * @param event Counted event
+     * @return Count, meaningless if not available
+    **/
+    auto get(PerfEvent event) const noexcept {
+        return values[static_cast<size_t>(event)];
+    }
+    /** Tell whether an event was counted.
+     * @param event Counted event
+     * @return Whether the count is available
+    **/
+    auto has(PerfEvent event) const noexcept {
+        return available[static_cast<size_t>(event)];
+    }
+    /** Add the counts of another worker, an event stays available only if both counted it.
+     * @param other Sample to merge
+     * @param first Whether this sample is still empty, i.e. takes the availability of the other one
+    **/
+    void merge(PerfSample const& other, bool first) noexcept {
+        for (size_t i = 0; i < static_cast<size_t>(PerfEvent::count); ++i) {
+            values[i] += other.values[i];
+            available[i] = other.available[i] && (first || available[i]);
+        }
+    }
+};
+
+/** Counters of one worker thread, only counting while enabled.
+ * Opening them may fail for some or all events (no PMU in a VM, 'perf_event_paranoid', ...): those are reported as unavailable.
+**/
+class PerfCounters final {
+private:
+    int fds[static_cast<size_t>(PerfEvent::count)]; // Event file descriptors, -1 if not opened
+    PerfSample sample; // Counts read by 'collect'
+public:
+    /** Closed counters constructor.
+    **/
+    PerfCounters() noexcept {
+        for (auto& fd: fds)
+            fd = -1;
+    }
+    /** Deleted copy constructor/assignment.
+    **/
+    PerfCounters(PerfCounters const&) = delete;
+    PerfCounters& operator=(PerfCounters const&) = delete;
+    /** Close the counters, if still open.
+    **/
+    ~PerfCounters() noexcept {
+        close();
+    }
+public:
+    /** Open the counters of the calling thread, disabled.
+    **/
+    void open() noexcept {
+#ifdef __linux__
+        for (size_t i = 0; i < static_cast<size_t>(PerfEvent::count); ++i) {
+            ::perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.disabled = 1;
+            attr.exclude_hv = 1;
+            attr.exclude_kernel = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            switch (static_cast<PerfEvent>(i)) {
+            case PerfEvent::cycles:
+                attr.type   = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CPU_CYCLES;
+                break;
+            case PerfEvent::instructions:
+                attr.type   = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+                break;
+            case PerfEvent::llc_misses:
+                attr.type   = PERF_TYPE_HARDWARE;
+                attr.config = PERF_COUNT_HW_CACHE_MISSES;
+                break;
+            case PerfEvent::dtlb_misses:
+                attr.type   = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+            default: // Context switches happen in the kernel, they are not counted otherwise
+                attr.type   = PERF_TYPE_SOFTWARE;
+                attr.config = PERF_COUNT_SW_CONTEXT_SWITCHES;
+                attr.exclude_kernel = 0;
+                break;
+            }
+            fds[i] = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+#endif
+    }
+    /** Start counting.
+    **/
+    void start() noexcept {
+#ifdef __linux__
+        for (auto fd: fds) {
+            if (fd >= 0)
+                ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+    /** Stop counting, the counts accumulate over the successive starts.
+    **/
+    void stop() noexcept {
+#ifdef __linux__
+        for (auto fd: fds) {
+            if (fd >= 0)
+                ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+#endif
+    }
+    /** Read the counts and close the counters.
+    **/
+    void collect() noexcept {
+#ifdef __linux__
+        for (size_t i = 0; i < static_cast<size_t>(PerfEvent::count); ++i) {
+            uint64_t data[3]; // Value, time enabled, time running
+            if (fds[i] < 0 || ::read(fds[i], data, sizeof(data)) != sizeof(data))
+                continue;
+            // The kernel multiplexes the hardware counters when there are too few of them, scale the count to the whole enabled time
+            if (data[2] > 0 && data[2] < data[1])
+                data[0] = static_cast<uint64_t>(static_cast<double>(data[0]) * static_cast<double>(data[1]) / static_cast<double>(data[2]));
+            sample.values[i] = data[0];
+            sample.available[i] = data[2] > 0 || data[1] == 0;
+        }
+#endif
+        close();
+    }
+    /** Get the counts read by 'collect'.
+     * @return Counts of the worker
+    **/
+    auto const& get() const noexcept {
+        return sample;
+    }
+private:
+    /** Close every opened counter.
+    **/
+    void close() noexcept {
+#ifdef __linux__
+        for (auto& fd: fds) {
+            if (fd >= 0)
+                ::close(fd);
+            fd = -1;
+        }
+#endif
+    }
+};
@@ -28,12 +28,14 @@ extern "C" {
 #include <dlfcn.h>
 #include <limits.h>
 }
+#include <type_traits>
 
 // Internal headers
 namespace STM {
 #include <tm.hpp>
 }
 #include "common.hpp"
+#include "latency.hpp"
 
 // -------------------------------------------------------------------------- //
 namespace Exception {
@@ -52,6 +54,7 @@ EXCEPTION(Transaction, Any, "transaction manager exception");
     EXCEPTION(TransactionBegin, Transaction, "transaction begin failed");
     EXCEPTION(TransactionAlloc, Transaction, "memory allocation failed (insufficient memory)");
     EXCEPTION(TransactionRetry, Transaction, "transaction aborted and can be retried");
+    EXCEPTION(TransactionRollback, Transaction, "transaction failed after its savepoint and can be rolled back to it");
     EXCEPTION(TransactionNotLastSegment, Transaction, "trying to deallocate the first segment");
 EXCEPTION(Shared, Any, "operation in shared memory exception");
     EXCEPTION(SharedAlign, Shared, "address in shared memory is not properly aligned for the specified type");
@@ -80,6 +83,8 @@ private:
     using FnWrite   = decltype(&STM::tm_write);
     using FnAlloc   = decltype(&STM::tm_alloc);
     using FnFree    = decltype(&STM::tm_free);
+    using FnBacking = char const* (*)(STM::shared_t) noexcept; // Optional extensions (see tm-ext.hpp)
+    using FnSavepoint = bool (*)(STM::shared_t, STM::tx_t) noexcept;
 private:
     void*     module;     // Module opaque handler
     FnCreate  tm_create;  // Module's initialization function
@@ -93,6 +98,9 @@ private:
     FnWrite   tm_write;   // Module's shared memory write function
     FnAlloc   tm_alloc;   // Module's shared memory allocation function
     FnFree    tm_free;    // Module's shared memory freeing function
+    FnBacking tm_backing; // Module's memory backing query function, 'nullptr' if not exported
+    FnSavepoint tm_savepoint; // Module's savepoint functions, both 'nullptr' unless both are exported
+    FnSavepoint tm_rollback;
 private:
     /** Solve a symbol from its name, and bind it to the given function.
      * @param name Name of the symbol to resolve
@@ -132,6 +140,11 @@ public:
             solve("tm_write", tm_write);
             solve("tm_alloc", tm_alloc);
             solve("tm_free", tm_free);
+            tm_backing = reinterpret_cast<FnBacking>(::dlsym(module, "tm_backing"));
+            tm_savepoint = reinterpret_cast<FnSavepoint>(::dlsym(module, "tm_savepoint"));
+            tm_rollback = reinterpret_cast<FnSavepoint>(::dlsym(module, "tm_rollback"));
+            if (!tm_savepoint || !tm_rollback)
+                tm_savepoint = tm_rollback = nullptr;
         }
     }
     /** Unloader destructor.
@@ -205,6 +218,12 @@ public:
     auto get_align() const noexcept {
         return alignment;
     }
+    /** [thread-safe] Get the memory backing the shared memory region, if the library tells.
+     * @return Constant null-terminated backing name, 'nullptr' if the library does not export 'tm_backing'
+    **/
+    char const* get_backing() const noexcept {
+        return tl.tm_backing ? tl.tm_backing(shared) : nullptr;
+    }
 public:
     /** [thread-safe] Begin a new transaction on the shared memory region.
      * @param ro Whether the transaction is read-only
@@ -257,6 +276,20 @@ public:
     auto free(TX tx, void* target) const noexcept {
         return tl.tm_free(shared, tx, target);
     }
+    /** [thread-safe] Take a savepoint in the given transaction, if the library supports it.
+     * @param tx Transaction to use
+     * @return Whether the savepoint was taken, the failed operations of the transaction must then be followed by 'rollback'
+    **/
+    bool savepoint(TX tx) const noexcept {
+        return tl.tm_savepoint && tl.tm_savepoint(shared, tx);
+    }
+    /** [thread-safe] Roll the given transaction back to its savepoint, after one of its operations failed.
+     * @param tx Transaction to roll back
+     * @return Whether the transaction goes on from the savepoint, otherwise it aborted
+    **/
+    bool rollback(TX tx) const noexcept {
+        return tl.tm_rollback(shared, tx);
+    }
 };
 
 /** One transaction over a shared memory region management class.
@@ -272,8 +305,9 @@ public:
 private:
     TransactionalMemory const& tm; // Bound transactional memory
     STM::tx_t tx; // Opaque transaction handle
-    bool aborted; // Transaction was aborted
+    bool aborted; // Transaction was aborted, or ended already
     bool is_ro;   // Whether the transaction is read-only (solely for assertion)
+    bool has_savepoint; // Whether a failed operation leaves the transaction alive, for 'rollback'
 public:
     /** Deleted copy constructor/assignment.
     **/
@@ -283,7 +317,7 @@ public:
      * @param tm Transactional memory to bind
      * @param ro Whether the transaction is read-only
     **/
-    Transaction(TransactionalMemory const& tm, Mode ro): tm{tm}, tx{tm.begin(static_cast<bool>(ro))}, aborted{false}, is_ro{static_cast<bool>(ro)} {
+    Transaction(TransactionalMemory const& tm, Mode ro): tm{tm}, tx{tm.begin(static_cast<bool>(ro))}, aborted{false}, is_ro{static_cast<bool>(ro)}, has_savepoint{false} {
         if (unlikely(tx == STM::invalid_tx))
             throw Exception::TransactionBegin{};
     }
@@ -295,6 +329,15 @@ public:
                 throw Exception::TransactionRetry{};
         }
     }
+private:
+    /** Report a failed operation: the transaction aborted, unless it can be rolled back to its savepoint.
+    **/
+    [[noreturn]] void failed() {
+        if (has_savepoint)
+            throw Exception::TransactionRollback{};
+        aborted = true;
+        throw Exception::TransactionRetry{};
+    }
 public:
     /** [thread-safe] Return the bound transactional memory instance.
      * @return Bound transactional memory instance
@@ -302,6 +345,39 @@ public:
     auto const& get_tm() const noexcept {
         return tm;
     }
+    /** [thread-safe] Run the rest of the transaction, and its commit, from a savepoint: when one of them fails, only that part runs again,
+     * for as long as what the transaction read before still holds. Without savepoints in the library, it just runs once.
+     * @param func Rest of the transaction (-> ...), run again from the start after each failure
+     * @return Returned value (or void) when the transaction committed
+    **/
+    template<class Func> auto from_savepoint(Func&& func) {
+        has_savepoint = tm.savepoint(tx);
+        while (true) {
+            try {
+                if constexpr (::std::is_void_v<decltype(func())>) {
+                    func();
+                    commit();
+                    return;
+                } else {
+                    auto res = func();
+                    commit();
+                    return res;
+                }
+            } catch (Exception::TransactionRollback const&) {
+                if (unlikely(!tm.rollback(tx))) {
+                    aborted = true;
+                    throw Exception::TransactionRetry{};
+                }
+            }
+        }
+    }
+    /** [thread-safe] Commit the bound transaction now, rather than on destruction.
+    **/
+    void commit() {
+        if (unlikely(!tm.end(tx)))
+            failed();
+        aborted = true;
+    }
 public:
     /** [thread-safe] Read operation in the bound transaction, source in the shared region and target in a private region.
      * @param source Source start address
@@ -309,10 +385,8 @@ public:
      * @param target Target start address
     **/
     void read(void const* source, size_t size, void* target) {
-        if (unlikely(!tm.read(tx, source, size, target))) {
-            aborted = true;
-            throw Exception::TransactionRetry{};
-        }
+        if (unlikely(!tm.read(tx, source, size, target)))
+            failed();
     }
     /** [thread-safe] Write operation in the bound transaction, source in a private region and target in the shared region.
      * @param source Source start address
@@ -322,10 +396,8 @@ public:
     void write(void const* source, size_t size, void* target) {
         if (unlikely(assert_mode && is_ro))
             throw Exception::TransactionReadOnly{};
-        if (unlikely(!tm.write(tx, source, size, target))) {
-            aborted = true;
-            throw Exception::TransactionRetry{};
-        }
+        if (unlikely(!tm.write(tx, source, size, target)))
+            failed();
     }
     /** [thread-safe] Memory allocation operation in the bound transaction, throw if no memory available.
      * @param size Size to allocate
@@ -341,8 +413,7 @@ public:
         case STM::Alloc::nomem:
             throw Exception::TransactionAlloc{};
         default: // STM::Alloc::abort
-            aborted = true;
-            throw Exception::TransactionRetry{};
+            failed();
         }
     }
     /** [thread-safe] Memory freeing operation in the bound transaction.
@@ -351,10 +422,8 @@ public:
     void free(void* target) {
         if (unlikely(assert_mode && is_ro))
             throw Exception::TransactionReadOnly{};
-        if (unlikely(!tm.free(tx, target))) {
-            aborted = true;
-            throw Exception::TransactionRetry{};
-        }
+        if (unlikely(!tm.free(tx, target)))
+            failed();
     }
 };
 
@@ -605,16 +674,23 @@ public:
 /** Repeat a given transaction until it commits.
  * @param tm   Transactional memory
  * @param mode Transactional mode
+ * @param kind Kind of the transaction, its latency and retries are recorded in the profile of the calling thread if it has one
  * @param func Transaction closure (Transaction& -> ...)
  * @return Returned value (or void) when the transaction committed
 **/
-template<class Func> static auto transactional(TransactionalMemory const& tm, Transaction::Mode mode, Func&& func) {
+template<class Func> static auto transactional(TransactionalMemory const& tm, Transaction::Mode mode, TxKind kind, Func&& func) {
+    TxRecorder recorder{kind};
     do {
         try {
+            TxRecorder::Attempt attempt{recorder}; // Destroyed after 'tx', i.e. after the commit
             Transaction tx{tm, mode};
             return func(tx);
         } catch (Exception::TransactionRetry const&) {
+            recorder.retry();
             continue;
         }
     } while (true);
 }
+template<class Func> static auto transactional(TransactionalMemory const& tm, Transaction::Mode mode, Func&& func) {
+    return transactional(tm, mode, TxKind::none, ::std::forward<Func>(func));
+}
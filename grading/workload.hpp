@@ -25,7 +25,9 @@
 
 // External headers
 #include <cstdint>
+#include <memory>
 #include <random>
+#include <vector>
 
 // Internal headers
 #include "common.hpp"
@@ -60,6 +62,13 @@ public:
     /** Virtual destructor.
     **/
     virtual ~Workload() {};
+public:
+    /** Get the memory backing the shared memory region, if the library tells.
+     * @return Constant null-terminated backing name, 'nullptr' if unknown
+    **/
+    char const* get_backing() const noexcept {
+        return tm.get_backing();
+    }
 public:
     /** Shared memory (re)initialization.
      * @return Constant null-terminated error message, 'nullptr' for none
@@ -159,7 +168,7 @@ private:
      * @return Whether no inconsistency has been found
     **/
     bool long_tx(size_t& nbaccounts) const {
-        return transactional(tm, Transaction::Mode::read_only, [&](Transaction& tx) {
+        return transactional(tm, Transaction::Mode::read_only, TxKind::long_tx, [&](Transaction& tx) {
             auto count = 0ul; // Total number of accounts seen.
             auto sum   = Balance{0}; // Total balance on all seen accounts + parity ammount.
             auto start = tm.get_start(); // The list of accounts starts at the first word of the shared memory region.
@@ -184,7 +193,7 @@ private:
      * @param trigger Trigger level that will decide whether to allocate or deallocate
     **/
     void alloc_tx(size_t trigger) const {
-        return transactional(tm, Transaction::Mode::read_write, [&](Transaction& tx) {
+        return transactional(tm, Transaction::Mode::read_write, TxKind::alloc_tx, [&](Transaction& tx) {
             auto count = 0ul; // Total number of accounts seen.
             void* prev = nullptr;
             auto start = tm.get_start();
@@ -194,30 +203,33 @@ private:
                 count += segment_count;
                 decltype(start) segment_next = segment.next;
                 if (!segment_next) { // Currently at the last segment
-                    if (count > trigger && likely(count > 2)) { // If we have seen "too many" accounts, we will destroy one.
-                        --segment_count; // Let's remove the last account from the last segment.
-                        auto new_parity = segment.parity.read() + segment.accounts[segment_count] - init_balance; // We remove 1x the initial balance but don't break parity.
-                        if (segment_count > 0) { // Just remove one account from the (last) segment without deallocating memory.
-                            segment.count = segment_count;
-                            segment.parity = new_parity;
-                        } else { // If there's no one in the last segment anymore, we deallocate it.
-                            if (unlikely(assert_mode && prev == nullptr))
-                                throw Exception::TransactionNotLastSegment{};
-                            AccountSegment prev_segment{tx, prev};
-                            prev_segment.next.free();
-                            prev_segment.parity = prev_segment.parity.read() + new_parity;
+                    // The walk to the last segment is kept if the update conflicts, as long as the segment counts walked through did not change
+                    return tx.from_savepoint([&]() {
+                        auto last_count = segment_count; // A copy, so that running again after a rollback starts from the same count
+                        if (count > trigger && likely(count > 2)) { // If we have seen "too many" accounts, we will destroy one.
+                            --last_count; // Let's remove the last account from the last segment.
+                            auto new_parity = segment.parity.read() + segment.accounts[last_count] - init_balance; // We remove 1x the initial balance but don't break parity.
+                            if (last_count > 0) { // Just remove one account from the (last) segment without deallocating memory.
+                                segment.count = last_count;
+                                segment.parity = new_parity;
+                            } else { // If there's no one in the last segment anymore, we deallocate it.
+                                if (unlikely(assert_mode && prev == nullptr))
+                                    throw Exception::TransactionNotLastSegment{};
+                                AccountSegment prev_segment{tx, prev};
+                                prev_segment.next.free();
+                                prev_segment.parity = prev_segment.parity.read() + new_parity;
+                            }
+                        } else { // If we don't destroy any account, then let's create a new one.
+                            if (last_count < nbaccounts) { // If there's room in the last segment, then let's create the account in it without allocating memory.
+                                segment.accounts[last_count] = init_balance;
+                                segment.count = last_count + 1;
+                            } else { // Otherwise, we really need to allocate memory for the new account.
+                                AccountSegment next_segment{tx, segment.next.alloc(AccountSegment::size(nbaccounts))};
+                                next_segment.count = 1;
+                                next_segment.accounts[0] = init_balance;
+                            }
                         }
-                    } else { // If we don't destroy any account, then let's create a new one.
-                        if (segment_count < nbaccounts) { // If there's room in the last segment, then let's create the account in it without allocating memory.
-                            segment.accounts[segment_count] = init_balance;
-                            segment.count = segment_count + 1;
-                        } else { // Otherwise, we really need to allocate memory for the new account.
-                            AccountSegment next_segment{tx, segment.next.alloc(AccountSegment::size(nbaccounts))};
-                            next_segment.count = 1;
-                            next_segment.accounts[0] = init_balance;
-                        }
-                    }
-                    return;
+                    });
                 }
                 prev  = start;
                 start = segment_next;
@@ -230,7 +242,7 @@ private:
      * @return Whether the parameters were satisfying and the transaction committed on useful work
     **/
     bool short_tx(size_t send_id, size_t recv_id) const {
-        return transactional(tm, Transaction::Mode::read_write, [&](Transaction& tx) {
+        return transactional(tm, Transaction::Mode::read_write, TxKind::short_tx, [&](Transaction& tx) {
             void* send_ptr = nullptr;
             void* recv_ptr = nullptr;
 
@@ -263,14 +275,17 @@ private:
             }
 
             // Transfer the money if enough fund
+            // A conflict on the accounts only runs the transfer again, not the walk that found them
             Shared<Balance> sender{tx, send_ptr}; // Shared is a template that overloads copy to use tm_read/tm_write.
             Shared<Balance> recver{tx, recv_ptr};
-            auto send_val = sender.read();
-            if (send_val > 0) {
-                sender = send_val - 1;
-                recver = recver.read() + 1;
-            }
-            return true;
+            return tx.from_savepoint([&]() {
+                auto send_val = sender.read();
+                if (send_val > 0) {
+                    sender = send_val - 1;
+                    recver = recver.read() + 1;
+                }
+                return true;
+            });
         });
     }
 public:
@@ -387,3 +402,794 @@ public:
         return nullptr;
     }
 };
+
+// -------------------------------------------------------------------------- //
+
+/** Set workload base class: random lookups, insertions and removals of keys in a shared set structure.
+ * A structure only has to implement the three operations and a consistency scan, all within a given transaction.
+ * The first word of the shared memory region tells whether the structure was populated, the structure header follows it.
+**/
+class WorkloadSet: public Workload {
+public:
+    /** Key class alias.
+    **/
+    using Key = size_t;
+private:
+    constexpr static size_t nbcheck = 100; // Number of keys inserted and removed by each worker during 'check'
+protected:
+    size_t  nbworkers;  // Number of concurrent workers
+    size_t  nbtxperwrk; // Number of transactions per worker
+    size_t  nbkeys;     // Keys drawn by 'run' are in [0, nbkeys), half of them are initially in the set
+    float   prob_long;  // Probability of running a long, read-only consistency scan
+    Barrier barrier;    // Barrier for thread synchronization during 'check'
+public:
+    /** Set workload constructor.
+     * @param library    Transactional library to use
+     * @param size       Size of the structure header
+     * @param nbworkers  Total number of concurrent threads (for both 'run' and 'check')
+     * @param nbtxperwrk Number of transactions per worker
+     * @param nbkeys     Number of keys drawn by 'run', half of them are initially in the set
+     * @param prob_long  Probability of running a long, read-only consistency scan
+    **/
+    WorkloadSet(TransactionalLibrary const& library, size_t size, size_t nbworkers, size_t nbtxperwrk, size_t nbkeys, float prob_long): Workload{library, alignof(void*), sizeof(size_t) + size}, nbworkers{nbworkers}, nbtxperwrk{nbtxperwrk}, nbkeys{nbkeys}, prob_long{prob_long}, barrier{static_cast<Barrier::Counter>(nbworkers)} {}
+protected:
+    /** Get the address of the structure header.
+     * @return Structure header address
+    **/
+    void* header() const noexcept {
+        return reinterpret_cast<size_t*>(tm.get_start()) + 1;
+    }
+    /** Lookup operation.
+     * @param tx  Associated pending transaction
+     * @param key Key to look up
+     * @return Whether the key is in the set
+    **/
+    virtual bool contains(Transaction& tx, Key key) const = 0;
+    /** Insertion operation.
+     * @param tx     Associated pending transaction
+     * @param key    Key to insert
+     * @param random Random bits the structure may use (e.g. to pick the height of a node)
+     * @return Whether the key was not already in the set
+    **/
+    virtual bool insert(Transaction& tx, Key key, size_t random) const = 0;
+    /** Removal operation.
+     * @param tx  Associated pending transaction
+     * @param key Key to remove
+     * @return Whether the key was in the set
+    **/
+    virtual bool remove(Transaction& tx, Key key) const = 0;
+    /** Consistency scan, counting the keys.
+     * @param tx    Associated pending (read-only) transaction
+     * @param count Number of keys in the set
+     * @return Whether no inconsistency has been found
+    **/
+    virtual bool scan(Transaction& tx, size_t& count) const = 0;
+private:
+    /** Long read-only transaction, scanning the whole structure.
+     * @param count Number of keys in the set
+     * @return Whether no inconsistency has been found
+    **/
+    bool long_tx(size_t& count) const {
+        return transactional(tm, Transaction::Mode::read_only, TxKind::long_tx, [&](Transaction& tx) {
+            return scan(tx, count);
+        });
+    }
+    bool contains_tx(Key key) const {
+        return transactional(tm, Transaction::Mode::read_only, TxKind::short_tx, [&](Transaction& tx) {
+            return contains(tx, key);
+        });
+    }
+    bool insert_tx(Key key, size_t random) const {
+        return transactional(tm, Transaction::Mode::read_write, TxKind::alloc_tx, [&](Transaction& tx) {
+            return insert(tx, key, random);
+        });
+    }
+    bool remove_tx(Key key) const {
+        return transactional(tm, Transaction::Mode::read_write, TxKind::alloc_tx, [&](Transaction& tx) {
+            return remove(tx, key);
+        });
+    }
+public:
+    /**
+     * Populate the set with every even key, once for all the workers, and check its size.
+    **/
+    virtual char const* init() const {
+        transactional(tm, Transaction::Mode::read_write, [&](Transaction& tx) {
+            Shared<size_t> populated{tx, tm.get_start()};
+            if (populated)
+                return;
+            for (auto key = nbkeys; key-- > 0;) { // Descending order, so that sorted structures insert at their head
+                if (key % 2 == 0)
+                    insert(tx, key, key + 1);
+            }
+            populated = 1;
+        });
+        size_t count;
+        if (unlikely(!long_tx(count) || count != (nbkeys + 1) / 2))
+            return "Violated consistency (check that committed writes in shared memory get visible to the following transactions' reads)";
+        return nullptr;
+    }
+    /**
+     * Run nbtxperwrk random lookups, insertions and removals, with a few long scans.
+     * @param seed Randomness source
+    **/
+    virtual char const* run(Uid uid [[gnu::unused]], Seed seed) const {
+        ::std::minstd_rand engine{seed};
+        ::std::bernoulli_distribution long_dist{prob_long};
+        ::std::uniform_int_distribution<Key> key_dist{0, nbkeys - 1};
+        ::std::uniform_int_distribution<int> op_dist{0, 2};
+        for (size_t cntr = 0; cntr < nbtxperwrk; ++cntr) {
+            if (long_dist(engine)) {
+                size_t count;
+                if (unlikely(!long_tx(count)))
+                    return "Violated isolation or atomicity";
+                continue;
+            }
+            auto key = key_dist(engine);
+            switch (op_dist(engine)) {
+            case 0:
+                contains_tx(key);
+                break;
+            case 1:
+                insert_tx(key, engine());
+                break;
+            default:
+                remove_tx(key);
+                break;
+            }
+        }
+        { // Last long transaction
+            size_t count;
+            if (!long_tx(count))
+                return "Violated isolation or atomicity";
+        }
+        return nullptr;
+    }
+    /**
+     * Test in which every worker inserts then removes its own keys, while checking the keys of another worker and the size of the set.
+     * @param uid Id of the thread to run the check
+    **/
+    virtual char const* check(Uid uid, Seed seed) const {
+        ::std::minstd_rand engine{seed};
+        char const* error = nullptr; // Workers stop checking on an error, but still go through every barrier
+        auto const first = [&](Uid id) { return nbkeys + id * nbcheck; }; // Keys of a worker, never drawn by 'run'
+        auto const other = static_cast<Uid>((uid + 1) % nbworkers);
+        size_t base;
+        size_t count;
+
+        barrier.sync();
+        if (unlikely(!long_tx(base)))
+            error = "Violated consistency";
+
+        barrier.sync();
+        for (size_t i = 0; i < nbcheck && !error; ++i) {
+            if (unlikely(!insert_tx(first(uid) + i, engine())))
+                error = "Violated consistency (key inserted twice)";
+        }
+
+        barrier.sync();
+        if (!error && unlikely(!long_tx(count) || count != base + nbworkers * nbcheck))
+            error = "Violated consistency, isolation or atomicity (wrong count after insertions)";
+        for (size_t i = 0; i < nbcheck && !error; ++i) {
+            if (unlikely(!contains_tx(first(other) + i)))
+                error = "Violated consistency, isolation or atomicity (inserted key missing)";
+        }
+
+        barrier.sync();
+        for (size_t i = 0; i < nbcheck && !error; ++i) {
+            if (unlikely(!remove_tx(first(uid) + i)))
+                error = "Violated consistency (key removed twice)";
+        }
+
+        barrier.sync();
+        if (!error && unlikely(!long_tx(count) || count != base))
+            error = "Violated consistency, isolation or atomicity (wrong count after removals)";
+        for (size_t i = 0; i < nbcheck && !error; ++i) {
+            if (unlikely(contains_tx(first(other) + i)))
+                error = "Violated consistency, isolation or atomicity (removed key still present)";
+        }
+        return error;
+    }
+};
+
+/** Hash map workload class: separate chaining, every insertion allocates a node and every removal frees one.
+**/
+class WorkloadHashMap final: public WorkloadSet {
+private:
+    /** Shared chained node class.
+    **/
+    class Node final {
+    public:
+        /** Get the node size.
+         * @return Node size (in bytes)
+        **/
+        constexpr static size_t size() noexcept {
+            return 2 * sizeof(Key) + sizeof(Node*);
+        }
+    public:
+        Shared<Key>   key;   // Key of the entry
+        Shared<Key>   value; // Value of the entry, always the complement of its key
+        Shared<Node*> next;  // Next node of the bucket
+    public:
+        /** Binding constructor.
+         * @param tx      Associated pending transaction
+         * @param address Node base address
+        **/
+        Node(Transaction& tx, void* address): key{tx, address}, value{tx, key.after()}, next{tx, value.after()} {}
+    };
+private:
+    size_t nbbuckets; // Number of buckets
+public:
+    /** Hash map workload constructor.
+     * @param library    Transactional library to use
+     * @param nbworkers  Total number of concurrent threads (for both 'run' and 'check')
+     * @param nbtxperwrk Number of transactions per worker
+     * @param nbkeys     Number of keys drawn by 'run', half of them are initially in the map
+     * @param prob_long  Probability of running a long, read-only consistency scan
+    **/
+    WorkloadHashMap(TransactionalLibrary const& library, size_t nbworkers, size_t nbtxperwrk, size_t nbkeys, float prob_long): WorkloadSet{library, buckets_for(nbkeys) * sizeof(Node*), nbworkers, nbtxperwrk, nbkeys, prob_long}, nbbuckets{buckets_for(nbkeys)} {}
+private:
+    /** Number of buckets for a number of keys, for about two entries per bucket once half of the keys are in the map.
+     * @param nbkeys Number of keys drawn by 'run'
+     * @return Number of buckets
+    **/
+    constexpr static size_t buckets_for(size_t nbkeys) noexcept {
+        return nbkeys / 4 + 1;
+    }
+    /** Bucket of a key.
+     * @param key Key to hash
+     * @return Bucket index
+    **/
+    size_t bucket(Key key) const noexcept {
+        return static_cast<size_t>((static_cast<uint64_t>(key) * 0x9e3779b97f4a7c15ull) >> 32) % nbbuckets;
+    }
+    /** Link cell of a bucket.
+     * @param key Key to hash
+     * @return Address of the head pointer of the key's bucket
+    **/
+    void* bucket_head(Key key) const noexcept {
+        return reinterpret_cast<Node**>(header()) + bucket(key);
+    }
+protected:
+    virtual bool contains(Transaction& tx, Key key) const {
+        for (Node* node = Shared<Node*>{tx, bucket_head(key)}; node;) {
+            Node entry{tx, node};
+            if (entry.key == key)
+                return true;
+            node = entry.next;
+        }
+        return false;
+    }
+    virtual bool insert(Transaction& tx, Key key, size_t random [[gnu::unused]]) const {
+        Shared<Node*> head{tx, bucket_head(key)};
+        Node* first = head;
+        for (Node* node = first; node;) {
+            Node entry{tx, node};
+            if (entry.key == key)
+                return false;
+            node = entry.next;
+        }
+        // New entries go at the head of their bucket
+        auto node = reinterpret_cast<Node*>(tx.alloc(Node::size()));
+        Node entry{tx, node};
+        entry.key = key;
+        entry.value = ~key;
+        entry.next = first;
+        head = node;
+        return true;
+    }
+    virtual bool remove(Transaction& tx, Key key) const {
+        void* link = bucket_head(key); // Pointer to the node, to update when unlinking it
+        while (true) {
+            Node* node = Shared<Node*>{tx, link};
+            if (!node)
+                return false;
+            Node entry{tx, node};
+            if (entry.key == key) {
+                Shared<Node*>{tx, link} = entry.next.read();
+                tx.free(node);
+                return true;
+            }
+            link = entry.next.get();
+        }
+    }
+    virtual bool scan(Transaction& tx, size_t& count) const {
+        count = 0;
+        Shared<Node*[]> buckets{tx, header()};
+        for (size_t i = 0; i < nbbuckets; ++i) {
+            for (Node* node = buckets[i]; node;) {
+                Node entry{tx, node};
+                Key key = entry.key;
+                if (unlikely(bucket(key) != i || entry.value != ~key)) // Every entry must be in its bucket, with its value intact
+                    return false;
+                ++count;
+                node = entry.next;
+            }
+        }
+        return true;
+    }
+};
+
+/** Sorted linked list workload class: every operation walks the list from its head.
+**/
+class WorkloadSortedList final: public WorkloadSet {
+private:
+    /** Shared list node class.
+    **/
+    class Node final {
+    public:
+        /** Get the node size.
+         * @return Node size (in bytes)
+        **/
+        constexpr static size_t size() noexcept {
+            return sizeof(Key) + sizeof(Node*);
+        }
+    public:
+        Shared<Key>   key;  // Key of the node, the list is sorted in strictly increasing order
+        Shared<Node*> next; // Next node
+    public:
+        /** Binding constructor.
+         * @param tx      Associated pending transaction
+         * @param address Node base address
+        **/
+        Node(Transaction& tx, void* address): key{tx, address}, next{tx, key.after()} {}
+    };
+public:
+    /** Sorted linked list workload constructor.
+     * @param library    Transactional library to use
+     * @param nbworkers  Total number of concurrent threads (for both 'run' and 'check')
+     * @param nbtxperwrk Number of transactions per worker
+     * @param nbkeys     Number of keys drawn by 'run', half of them are initially in the list
+     * @param prob_long  Probability of running a long, read-only consistency scan
+    **/
+    WorkloadSortedList(TransactionalLibrary const& library, size_t nbworkers, size_t nbtxperwrk, size_t nbkeys, float prob_long): WorkloadSet{library, sizeof(Node*), nbworkers, nbtxperwrk, nbkeys, prob_long} {}
+private:
+    /** Find the link to the first node with a key not less than the given one.
+     * @param tx   Associated pending transaction
+     * @param key  Key to look for
+     * @param node Set to that node, 'nullptr' if there is none
+     * @return Address of the pointer to that node
+    **/
+    void* find(Transaction& tx, Key key, Node*& node) const {
+        void* link = header();
+        while (true) {
+            node = Shared<Node*>{tx, link};
+            if (!node)
+                return link;
+            Node entry{tx, node};
+            if (entry.key >= key)
+                return link;
+            link = entry.next.get();
+        }
+    }
+protected:
+    virtual bool contains(Transaction& tx, Key key) const {
+        Node* node;
+        find(tx, key, node);
+        return node && Node{tx, node}.key == key;
+    }
+    virtual bool insert(Transaction& tx, Key key, size_t random [[gnu::unused]]) const {
+        Node* next;
+        auto link = find(tx, key, next);
+        if (next && Node{tx, next}.key == key)
+            return false;
+        auto node = reinterpret_cast<Node*>(tx.alloc(Node::size()));
+        Node entry{tx, node};
+        entry.key = key;
+        entry.next = next;
+        Shared<Node*>{tx, link} = node;
+        return true;
+    }
+    virtual bool remove(Transaction& tx, Key key) const {
+        Node* node;
+        auto link = find(tx, key, node);
+        if (!node)
+            return false;
+        Node entry{tx, node};
+        if (entry.key != key)
+            return false;
+        Shared<Node*>{tx, link} = entry.next.read();
+        tx.free(node);
+        return true;
+    }
+    virtual bool scan(Transaction& tx, size_t& count) const {
+        count = 0;
+        Key last = 0;
+        for (Node* node = Shared<Node*>{tx, header()}; node;) {
+            Node entry{tx, node};
+            Key key = entry.key;
+            if (unlikely(count > 0 && key <= last)) // The keys must be strictly increasing
+                return false;
+            last = key;
+            ++count;
+            node = entry.next;
+        }
+        return true;
+    }
+};
+
+/** Skip list workload class: a sorted list with express lanes, nodes have random heights.
+**/
+class WorkloadSkipList final: public WorkloadSet {
+private:
+    constexpr static size_t nblevels = 12; // Maximum height of a node
+    /** Shared variable-height node class.
+    **/
+    class Node final {
+    public:
+        /** Get the size of a node.
+         * @param height Height of the node
+         * @return Node size (in bytes)
+        **/
+        constexpr static size_t size(size_t height) noexcept {
+            return sizeof(Key) + sizeof(size_t) + height * sizeof(Node*);
+        }
+    public:
+        Shared<Key>     key;    // Key of the node
+        Shared<size_t>  height; // Number of levels the node is linked in
+        Shared<Node*[]> next;   // Next node on each of these levels
+    public:
+        /** Binding constructor.
+         * @param tx      Associated pending transaction
+         * @param address Node base address
+        **/
+        Node(Transaction& tx, void* address): key{tx, address}, height{tx, key.after()}, next{tx, height.after()} {}
+    };
+public:
+    /** Skip list workload constructor.
+     * @param library    Transactional library to use
+     * @param nbworkers  Total number of concurrent threads (for both 'run' and 'check')
+     * @param nbtxperwrk Number of transactions per worker
+     * @param nbkeys     Number of keys drawn by 'run', half of them are initially in the list
+     * @param prob_long  Probability of running a long, read-only consistency scan
+    **/
+    WorkloadSkipList(TransactionalLibrary const& library, size_t nbworkers, size_t nbtxperwrk, size_t nbkeys, float prob_long): WorkloadSet{library, nblevels * sizeof(Node*), nbworkers, nbtxperwrk, nbkeys, prob_long} {}
+private:
+    /** Link cell of a node on a level.
+     * @param tx    Associated pending transaction
+     * @param node  Node, 'nullptr' for the head of the list
+     * @param level Level of the link
+     * @return Address of the pointer to the next node on that level
+    **/
+    void* link(Transaction& tx, Node* node, size_t level) const {
+        if (!node)
+            return reinterpret_cast<Node**>(header()) + level;
+        return Node{tx, node}.next[level].get();
+    }
+    /** Find the links to the first node with a key not less than the given one, on every level.
+     * @param tx    Associated pending transaction
+     * @param key   Key to look for
+     * @param preds Set to the address of the pointer to that node on each level
+     * @param succs Set to that node on each level, 'nullptr' if there is none
+    **/
+    void find(Transaction& tx, Key key, void* (&preds)[nblevels], Node* (&succs)[nblevels]) const {
+        Node* pred = nullptr;
+        for (auto level = nblevels; level-- > 0;) {
+            while (true) {
+                auto cell = link(tx, pred, level);
+                Node* next = Shared<Node*>{tx, cell};
+                if (next && Node{tx, next}.key < key) {
+                    pred = next;
+                    continue;
+                }
+                preds[level] = cell;
+                succs[level] = next;
+                break;
+            }
+        }
+    }
+protected:
+    virtual bool contains(Transaction& tx, Key key) const {
+        void* preds[nblevels];
+        Node* succs[nblevels];
+        find(tx, key, preds, succs);
+        return succs[0] && Node{tx, succs[0]}.key == key;
+    }
+    virtual bool insert(Transaction& tx, Key key, size_t random) const {
+        void* preds[nblevels];
+        Node* succs[nblevels];
+        find(tx, key, preds, succs);
+        if (succs[0] && Node{tx, succs[0]}.key == key)
+            return false;
+        // Each level holds about half the nodes of the one below
+        size_t height = 1;
+        while (height < nblevels && (random & 1)) {
+            ++height;
+            random >>= 1;
+        }
+        auto node = reinterpret_cast<Node*>(tx.alloc(Node::size(height)));
+        Node entry{tx, node};
+        entry.key = key;
+        entry.height = height;
+        for (size_t level = 0; level < height; ++level) {
+            entry.next[level] = succs[level];
+            Shared<Node*>{tx, preds[level]} = node;
+        }
+        return true;
+    }
+    virtual bool remove(Transaction& tx, Key key) const {
+        void* preds[nblevels];
+        Node* succs[nblevels];
+        find(tx, key, preds, succs);
+        auto node = succs[0];
+        if (!node)
+            return false;
+        Node entry{tx, node};
+        if (entry.key != key)
+            return false;
+        size_t height = entry.height;
+        for (size_t level = 0; level < height; ++level)
+            Shared<Node*>{tx, preds[level]} = entry.next[level].read();
+        tx.free(node);
+        return true;
+    }
+    virtual bool scan(Transaction& tx, size_t& count) const {
+        count = 0;
+        { // The bottom level holds every node, in strictly increasing order
+            Key last = 0;
+            for (Node* node = Shared<Node*>{tx, link(tx, nullptr, 0)}; node;) {
+                Node entry{tx, node};
+                Key key = entry.key;
+                size_t height = entry.height;
+                if (unlikely((count > 0 && key <= last) || height == 0 || height > nblevels))
+                    return false;
+                last = key;
+                ++count;
+                node = entry.next[0];
+            }
+        }
+        // Every upper level must be a subsequence of the bottom one, made of nodes tall enough
+        for (size_t level = 1; level < nblevels; ++level) {
+            Node* bottom = Shared<Node*>{tx, link(tx, nullptr, 0)};
+            for (Node* node = Shared<Node*>{tx, link(tx, nullptr, level)}; node;) {
+                Node entry{tx, node};
+                if (unlikely(entry.height <= level))
+                    return false;
+                while (bottom != node) {
+                    if (unlikely(!bottom))
+                        return false;
+                    bottom = Node{tx, bottom}.next[0];
+                }
+                node = entry.next[level];
+            }
+        }
+        return true;
+    }
+};
+
+/** FIFO queue workload class: every worker enqueues numbered values at the tail and dequeues them at the head.
+**/
+class WorkloadQueue final: public Workload {
+public:
+    /** Value class alias: producer tag in the upper half, sequence number in the lower half.
+    **/
+    using Value = uint64_t;
+private:
+    constexpr static size_t nbcheck = 100; // Number of values enqueued by each worker during 'check'
+    /** Shared queue node class.
+    **/
+    class Node final {
+    public:
+        /** Get the node size.
+         * @return Node size (in bytes)
+        **/
+        constexpr static size_t size() noexcept {
+            return sizeof(Value) + sizeof(Node*);
+        }
+    public:
+        Shared<Value> value; // Enqueued value
+        Shared<Node*> next;  // Node enqueued right after this one
+    public:
+        /** Binding constructor.
+         * @param tx      Associated pending transaction
+         * @param address Node base address
+        **/
+        Node(Transaction& tx, void* address): value{tx, address}, next{tx, value.after()} {}
+    };
+    /** Shared queue header class, at the start of the shared memory region.
+    **/
+    class Header final {
+    public:
+        /** Get the header size.
+         * @return Header size (in bytes)
+        **/
+        constexpr static size_t size() noexcept {
+            return sizeof(size_t) + 2 * sizeof(Node*);
+        }
+    public:
+        Shared<size_t> populated; // Whether the queue was populated
+        Shared<Node*>  head;      // Oldest node, 'nullptr' if the queue is empty
+        Shared<Node*>  tail;      // Newest node, 'nullptr' if the queue is empty
+    public:
+        /** Binding constructor.
+         * @param tx      Associated pending transaction
+         * @param address Header base address
+        **/
+        Header(Transaction& tx, void* address): populated{tx, address}, head{tx, populated.after()}, tail{tx, head.after()} {}
+    };
+private:
+    size_t  nbworkers;  // Number of concurrent workers
+    size_t  nbtxperwrk; // Number of transactions per worker
+    size_t  nbinit;     // Number of values initially in the queue
+    float   prob_long;  // Probability of running a long, read-only consistency scan
+    Barrier barrier;    // Barrier for thread synchronization during 'check'
+    ::std::unique_ptr<Value[]> mutable sequences; // Next sequence number of each worker, only accessed by that worker
+public:
+    /** Queue workload constructor.
+     * @param library    Transactional library to use
+     * @param nbworkers  Total number of concurrent threads (for both 'run' and 'check')
+     * @param nbtxperwrk Number of transactions per worker
+     * @param nbinit     Number of values initially in the queue
+     * @param prob_long  Probability of running a long, read-only consistency scan
+    **/
+    WorkloadQueue(TransactionalLibrary const& library, size_t nbworkers, size_t nbtxperwrk, size_t nbinit, float prob_long): Workload{library, alignof(void*), Header::size()}, nbworkers{nbworkers}, nbtxperwrk{nbtxperwrk}, nbinit{nbinit}, prob_long{prob_long}, barrier{static_cast<Barrier::Counter>(nbworkers)}, sequences{new Value[nbworkers]()} {}
+private:
+    /** Build a value.
+     * @param tag Producer tag, workers use their unique ID
+     * @param seq Sequence number of the value among the ones of its producer
+     * @return Value
+    **/
+    constexpr static Value make_value(size_t tag, Value seq) noexcept {
+        return (static_cast<Value>(tag) << 32) | seq;
+    }
+    /** Enqueue operation.
+     * @param value Value to enqueue
+    **/
+    void enqueue_tx(Value value) const {
+        transactional(tm, Transaction::Mode::read_write, TxKind::alloc_tx, [&](Transaction& tx) {
+            Header header{tx, tm.get_start()};
+            auto node = reinterpret_cast<Node*>(tx.alloc(Node::size()));
+            Node entry{tx, node};
+            entry.value = value; // 'next' is already null, allocated memory is zeroed
+            Node* tail = header.tail;
+            if (tail) {
+                Node{tx, tail}.next = node;
+            } else {
+                header.head = node;
+            }
+            header.tail = node;
+        });
+    }
+    /** Dequeue operation.
+     * @param value Set to the dequeued value, if any
+     * @return Whether the queue was not empty
+    **/
+    bool dequeue_tx(Value& value) const {
+        return transactional(tm, Transaction::Mode::read_write, TxKind::alloc_tx, [&](Transaction& tx) {
+            Header header{tx, tm.get_start()};
+            Node* head = header.head;
+            if (!head)
+                return false;
+            Node entry{tx, head};
+            value = entry.value;
+            Node* next = entry.next;
+            header.head = next;
+            if (!next)
+                header.tail = nullptr;
+            tx.free(head);
+            return true;
+        });
+    }
+    /** Long read-only transaction, walking the queue from head to tail.
+     * @param count Number of values in the queue
+     * @return Whether no inconsistency has been found
+    **/
+    bool long_tx(size_t& count) const {
+        return transactional(tm, Transaction::Mode::read_only, TxKind::long_tx, [&](Transaction& tx) {
+            Header header{tx, tm.get_start()};
+            ::std::vector<Value> last(nbworkers + 1, 0); // Last sequence number of each producer, plus one
+            count = 0;
+            Node* prev = nullptr;
+            for (Node* node = header.head; node;) {
+                Node entry{tx, node};
+                Value value = entry.value;
+                auto tag = static_cast<size_t>(value >> 32);
+                if (unlikely(tag > nbworkers || (value & 0xffffffff) + 1 <= last[tag])) // The values of a producer must be in the order it enqueued them
+                    return false;
+                last[tag] = (value & 0xffffffff) + 1;
+                ++count;
+                prev = node;
+                node = entry.next;
+            }
+            return header.tail == prev;
+        });
+    }
+public:
+    /**
+     * Populate the queue once for all the workers, and check its length.
+    **/
+    virtual char const* init() const {
+        transactional(tm, Transaction::Mode::read_write, [&](Transaction& tx) {
+            Header header{tx, tm.get_start()};
+            if (header.populated)
+                return;
+            Node* tail = nullptr;
+            for (size_t i = 0; i < nbinit; ++i) { // Tagged after the workers, the initial values are never produced again
+                auto node = reinterpret_cast<Node*>(tx.alloc(Node::size()));
+                Node{tx, node}.value = make_value(nbworkers, i);
+                if (tail) {
+                    Node{tx, tail}.next = node;
+                } else {
+                    header.head = node;
+                }
+                tail = node;
+            }
+            header.tail = tail;
+            header.populated = 1;
+        });
+        size_t count;
+        if (unlikely(!long_tx(count) || count != nbinit))
+            return "Violated consistency (check that committed writes in shared memory get visible to the following transactions' reads)";
+        return nullptr;
+    }
+    /**
+     * Run nbtxperwrk random enqueues and dequeues, checking that the values of each producer are dequeued in order.
+     * @param uid  Id of the thread, tagging the values it enqueues
+     * @param seed Randomness source
+    **/
+    virtual char const* run(Uid uid, Seed seed) const {
+        ::std::minstd_rand engine{seed};
+        ::std::bernoulli_distribution long_dist{prob_long};
+        ::std::bernoulli_distribution enqueue_dist{0.5};
+        ::std::vector<Value> last(nbworkers + 1, 0); // Last sequence number dequeued from each producer, plus one
+        for (size_t cntr = 0; cntr < nbtxperwrk; ++cntr) {
+            if (long_dist(engine)) {
+                size_t count;
+                if (unlikely(!long_tx(count)))
+                    return "Violated isolation or atomicity";
+            } else if (enqueue_dist(engine)) {
+                enqueue_tx(make_value(uid, sequences[uid]));
+                ++sequences[uid]; // Only once committed, the value is never enqueued twice
+            } else {
+                Value value;
+                if (!dequeue_tx(value))
+                    continue;
+                auto tag = static_cast<size_t>(value >> 32);
+                if (unlikely(tag > nbworkers || (value & 0xffffffff) + 1 <= last[tag]))
+                    return "Violated FIFO order, isolation or atomicity";
+                last[tag] = (value & 0xffffffff) + 1;
+            }
+        }
+        { // Last long transaction
+            size_t count;
+            if (!long_tx(count))
+                return "Violated isolation or atomicity";
+        }
+        return nullptr;
+    }
+    /**
+     * Test in which every worker enqueues a known series of values, then the first worker drains the queue and checks that each came out once and in order.
+     * @param uid Id of the thread to run the check
+    **/
+    virtual char const* check(Uid uid, Seed seed [[gnu::unused]]) const {
+        barrier.sync();
+        auto const first = sequences[uid];
+        for (size_t i = 0; i < nbcheck; ++i)
+            enqueue_tx(make_value(uid, first + i));
+        sequences[uid] += nbcheck;
+
+        barrier.sync();
+        if (uid != 0)
+            return nullptr;
+        ::std::vector<Value> last(nbworkers + 1, 0); // Last sequence number dequeued from each producer, plus one
+        ::std::vector<size_t> seen(nbworkers, 0); // Number of values of the 'check' series dequeued from each worker
+        Value value;
+        while (dequeue_tx(value)) {
+            auto tag = static_cast<size_t>(value >> 32);
+            auto seq = value & 0xffffffff;
+            if (unlikely(tag > nbworkers || seq + 1 <= last[tag]))
+                return "Violated FIFO order, isolation or atomicity";
+            last[tag] = seq + 1;
+            if (tag < nbworkers && seq + nbcheck >= sequences[tag])
+                ++seen[tag];
+        }
+        for (size_t tag = 0; tag < nbworkers; ++tag) {
+            if (unlikely(seen[tag] != nbcheck))
+                return "Violated consistency, isolation or atomicity (enqueued value lost)";
+        }
+        size_t count;
+        if (unlikely(!long_tx(count) || count != 0))
+            return "Violated consistency";
+        return nullptr;
+    }
+};
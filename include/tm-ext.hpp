@@ -0,0 +1,32 @@
+/**
+ * @file   tm-ext.hpp
+ * @author Ryan Maxin
+ *
+ * @section DESCRIPTION
+ *
+ * Optional extensions to the transaction manager interface (C++ version).
+ * Libraries are not required to export these symbols, callers must resolve them at runtime and fall back to the base interface.
+**/
+
+#pragma once
+
+#include "tm.hpp"
+
+// -------------------------------------------------------------------------- //
+
+extern "C" {
+    // Same as tm_create, with the region tunables given as "key=value,..." (applied on top of the TM_OPTIONS environment variable)
+    shared_t tm_create_ext(size_t, size_t, char const*) noexcept;
+    // Read a named library counter summed over all threads, false if the build does not maintain it
+    bool     tm_counter(shared_t, char const*, uint64_t*) noexcept;
+    // Write every library counter as "name value" lines, snprintf-style: returns the full length, 0 if the build does not maintain them
+    size_t   tm_stats(shared_t, char*, size_t) noexcept;
+    // Begin a transaction that runs alone and in place, and always commits: tm_read, tm_write and tm_end never fail on it
+    tx_t     tm_begin_irrevocable(shared_t) noexcept;
+    // Take a savepoint in a transaction, false if it cannot have one: after it, a failing operation leaves the transaction alive for tm_rollback
+    bool     tm_savepoint(shared_t, tx_t) noexcept;
+    // Restart a transaction holding a savepoint after an operation failed, false if it aborted as a whole instead
+    bool     tm_rollback(shared_t, tx_t) noexcept;
+    // Weakest memory backing of the region so far: "heap", "pages", "thp" or "hugetlb"
+    char const* tm_backing(shared_t) noexcept;
+}
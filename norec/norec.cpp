@@ -0,0 +1,197 @@
+#include "norec.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <mutex>
+
+void SegmentList::push_back(SegmentHeader* seg) {
+    seg->prev = head.prev;
+    seg->next = &head;
+    head.prev->next = seg;
+    head.prev = seg;
+}
+
+void SegmentList::splice(SegmentList& other) {
+    if (other.empty()) return;
+    other.head.next->prev = head.prev;
+    head.prev->next = other.head.next;
+    other.head.prev->next = &head;
+    head.prev = other.head.prev;
+    other.clear();
+}
+
+void SegmentList::unlink(SegmentHeader* seg) {
+    seg->prev->next = seg->next;
+    seg->next->prev = seg->prev;
+}
+
+void SegmentList::free_all() {
+    SegmentHeader* seg = head.next;
+    while (seg != &head) {
+        SegmentHeader* next = seg->next;
+        free(seg);
+        seg = next;
+    }
+    clear();
+}
+
+char* WriteSet::find(char* addr) {
+    if (size() <= LINEAR_MAX) {
+        for (size_t i = 0; i < size(); i++) {
+            if (addrs[i] == addr) return value(i);
+        }
+        return nullptr;
+    }
+    auto it = index.find(addr);
+    return it == index.end() ? nullptr : value(it->second);
+}
+
+void WriteSet::insert(char* addr, char const* val) {
+    // Writing the same word twice only keeps the last value
+    char* existing = may_contain(addr) ? find(addr) : nullptr;
+    if (existing) {
+        copy_word(existing, val, word_size);
+        return;
+    }
+    push(addr, val);
+    filter |= bit(addr);
+    if (size() == LINEAR_MAX + 1) {
+        // Crossing over to the index, which covers every entry from then on
+        for (size_t i = 0; i < size(); i++) {
+            index.emplace(addrs[i], i);
+        }
+    } else if (size() > LINEAR_MAX + 1) {
+        index.emplace(addr, size() - 1);
+    }
+}
+
+void Transaction::reset(bool is_ro_, size_t word_size) {
+    is_ro = is_ro_;
+    reads.reset(word_size);
+    writes.reset(word_size);
+}
+
+void Transaction::clear() {
+    // Segments of an aborted transaction never became reachable, those of a committed one were moved to the region already
+    allocs.free_all();
+    frees.clear();
+    reads.clear();
+    writes.clear();
+}
+
+Transaction* DescriptorPool::acquire(bool is_ro, size_t word_size) {
+    Transaction* txn;
+    if (cached.empty()) {
+        txn = new(nothrow) Transaction();
+        if (!txn) return nullptr;
+    } else {
+        txn = cached.back();
+        cached.pop_back();
+    }
+    txn->reset(is_ro, word_size);
+    return txn;
+}
+
+void DescriptorPool::release(Transaction* txn) {
+    txn->clear();
+    // A thread normally runs one transaction at a time, so only keep a handful of descriptors around
+    if (cached.size() < MAX_CACHED) {
+        cached.push_back(txn);
+    } else {
+        delete txn;
+    }
+}
+
+DescriptorPool::~DescriptorPool() {
+    for (auto txn : cached) {
+        delete txn;
+    }
+}
+
+MemoryRegion::MemoryRegion(size_t size_, size_t align_): size{size_}, align{align_}, start{nullptr} {
+    // The header takes a whole number of words, so that the data behind it stays aligned
+    seg_header = (sizeof(SegmentHeader) + align - 1) & ~(align - 1);
+}
+
+bool MemoryRegion::init() {
+    slots.reset(new(nothrow) ThreadSlot[MAX_THREADS]);
+    if (unlikely(!slots)) return false;
+    // We allocate the shared memory buffer such that its words are correctly aligned, and zero it out as required
+    start = aligned_alloc(align, (size + align - 1) & ~(align - 1));
+    if (unlikely(!start)) return false;
+    memset(start, 0, size);
+    return true;
+}
+
+MemoryRegion::~MemoryRegion() {
+    // No transaction runs anymore, so every retired segment can go along with the live ones
+    segments.free_all();
+    if (slots) {
+        for (size_t i = 0; i < nb_slots.load(); i++) {
+            for (RetiredSegment& retired : slots[i].limbo) {
+                free(retired.seg);
+            }
+        }
+    }
+    free(start);
+}
+
+ThreadSlot* MemoryRegion::slot() {
+    size_t tag = thread_tag();
+    if (unlikely(tag == MAX_THREADS)) return nullptr;
+    // The high-water mark bounds the scans of oldest_active
+    size_t count = nb_slots.load(memory_order_relaxed);
+    while (count <= tag && !nb_slots.compare_exchange_weak(count, tag + 1)) {}
+    return &slots[tag];
+}
+
+version MemoryRegion::oldest_active() const {
+    version oldest = UINT64_MAX;
+    size_t count = nb_slots.load();
+    for (size_t i = 0; i < count; i++) {
+        version announced = slots[i].announce.load();
+        if (announced != 0) oldest = min(oldest, announced);
+    }
+    return oldest;
+}
+
+void MemoryRegion::reclaim(ThreadSlot* slot) {
+    version oldest = oldest_active();
+    vector<RetiredSegment>& limbo = slot->limbo;
+    // Sequence numbers are increasing along the limbo list, so the reclaimable segments form a prefix of it.
+    // A transaction that announced at least the release of the freeing commit began after it, and cannot reach the segment.
+    size_t count = 0;
+    while (count < limbo.size() && limbo[count].seq <= oldest) count++;
+    for (size_t i = 0; i < count; i++) {
+        free(limbo[i].seg);
+    }
+    limbo.erase(limbo.begin(), limbo.begin() + count);
+}
+
+// Tags of the threads that exited, handed out again before new ones
+static mutex thread_tags_lock;
+static vector<size_t> free_thread_tags;
+static size_t next_thread_tag = 0;
+
+// Holds the tag of a thread for its whole lifetime
+struct ThreadTag {
+    size_t tag;
+    ThreadTag(): tag{MAX_THREADS} {
+        lock_guard<mutex> guard{thread_tags_lock};
+        if (!free_thread_tags.empty()) {
+            tag = free_thread_tags.back();
+            free_thread_tags.pop_back();
+        } else if (next_thread_tag < MAX_THREADS) {
+            tag = next_thread_tag++;
+        }
+    }
+    ~ThreadTag() {
+        if (tag == MAX_THREADS) return;
+        lock_guard<mutex> guard{thread_tags_lock};
+        free_thread_tags.push_back(tag);
+    }
+};
+
+size_t thread_tag() {
+    static thread_local ThreadTag tag;
+    return tag.tag;
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+// External headers
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Internal headers
+#include <tm.hpp>
+#include "macros.hpp"
+
+using namespace std;
+
+using word = uintptr_t;
+using version = uint64_t;
+
+constexpr size_t CACHE_LINE = 64;
+
+// Threads that may run transactions at the same time, i.e. slots of every region (NOrec is meant for a handful of cores)
+constexpr size_t MAX_THREADS = 256;
+
+// Busy-wait hint for spin loops
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    this_thread::yield();
+#endif
+}
+
+// Copy one word, a plain load and store for the common sizes
+inline void copy_word(void* dst, void const* src, size_t word_size) {
+    switch (word_size) {
+        case 4: memcpy(dst, src, 4); break;
+        case 8: memcpy(dst, src, 8); break;
+        default: memcpy(dst, src, word_size); break;
+    }
+}
+
+// Header placed in front of every segment returned by tm_alloc, linking it in the list of its transaction or region
+struct SegmentHeader {
+    SegmentHeader* prev;
+    SegmentHeader* next;
+};
+
+// Intrusive doubly linked list of segments, so that a freed segment can be unlinked without searching for it
+struct SegmentList {
+    SegmentHeader head; // Sentinel, the list is circular
+    SegmentList() { clear(); }
+    SegmentList(SegmentList const&) = delete;
+    SegmentList& operator=(SegmentList const&) = delete;
+    bool empty() const { return head.next == &head; }
+    // Forget every segment of the list, without touching them
+    void clear() { head.prev = head.next = &head; }
+    void push_back(SegmentHeader* seg);
+    // Move every segment of the other list to the end of this one
+    void splice(SegmentList& other);
+    static void unlink(SegmentHeader* seg);
+    // free() every segment of the list
+    void free_all();
+};
+
+// A segment freed by a committed transaction, that may only be freed for good once the transactions that began before that commit are over
+struct RetiredSegment {
+    SegmentHeader* seg;
+    version seq; // Sequence number the freeing commit released the lock at
+};
+
+// Reclamation state of one thread in a region. Only the thread holding the tag of the slot writes to it, the other threads only read the announcement.
+struct alignas(CACHE_LINE) ThreadSlot {
+    atomic<version> announce{0}; // Sequence number seen before the running transaction began, 0 when it runs none
+    vector<RetiredSegment> limbo; // Segments freed by the thread and not freed for good yet, in retirement order
+    void leave() { announce.store(0, memory_order_release); }
+};
+
+// Slot index of the calling thread (the same in every region), MAX_THREADS if every slot is taken by a live thread
+size_t thread_tag();
+
+// Words and their values, stored inline in two contiguous buffers
+struct WordLog {
+    size_t word_size;
+    vector<char*> addrs;
+    vector<char> values;
+    WordLog(): word_size{0} {}
+    void reset(size_t word_size_) {
+        word_size = word_size_;
+        clear();
+    }
+    void clear() {
+        addrs.clear();
+        values.clear();
+    }
+    size_t size() const { return addrs.size(); }
+    bool empty() const { return addrs.empty(); }
+    char* value(size_t i) { return values.data() + i * word_size; }
+    void push(char* addr, char const* val) {
+        values.insert(values.end(), val, val + word_size);
+        addrs.push_back(addr);
+    }
+};
+
+// Redo log of a transaction. Small sets are searched linearly, larger ones get a hash index on top.
+// A one-word Bloom filter over the addresses lets reads of words that were never written skip the lookup entirely.
+struct WriteSet: WordLog {
+    static constexpr size_t LINEAR_MAX = 16;
+    unordered_map<char*, size_t> index; // Position of every entry, once there are more than LINEAR_MAX
+    uint64_t filter;
+    WriteSet(): filter{0} {}
+    void clear() {
+        WordLog::clear();
+        index.clear();
+        filter = 0;
+    }
+    // False if the address is certainly not in the set
+    bool may_contain(char* addr) const { return filter & bit(addr); }
+    // Value of the word in the set, nullptr if it is not in it
+    char* find(char* addr);
+    // Add a word to the set, or overwrite its value if it is already in it
+    void insert(char* addr, char const* val);
+private:
+    static uint64_t bit(char* addr) { return uint64_t{1} << (((word)addr * 0x9E3779B97F4A7C15ull) >> 58); }
+};
+
+struct Transaction {
+    version snapshot; // Even sequence number the reads are consistent with
+    bool is_ro;
+    ThreadSlot* slot;
+    WordLog reads; // Value-based read log: every word read, with the value it had
+    WriteSet writes;
+    SegmentList allocs; // Segments allocated by the transaction, freed if it aborts
+    vector<SegmentHeader*> frees; // Segments freed by the transaction, retired if it commits
+    Transaction(): snapshot{0}, is_ro{false}, slot{nullptr} {}
+    ~Transaction() { clear(); }
+    void reset(bool is_ro_, size_t word_size);
+    void clear();
+};
+
+// Per-thread cache of transaction descriptors, so that the steady state does not go through the allocator on every tm_begin/tm_end
+struct DescriptorPool {
+    static constexpr size_t MAX_CACHED = 8;
+    vector<Transaction*> cached;
+    Transaction* acquire(bool is_ro, size_t word_size);
+    void release(Transaction* txn);
+    ~DescriptorPool();
+};
+
+// Represents a shared memory region. There is no per-stripe metadata at all: one sequence lock orders every commit.
+struct MemoryRegion {
+    // Global sequence lock, odd while a writing transaction is committing. Readers check that it did not move since their snapshot.
+    alignas(CACHE_LINE) atomic<version> seq{2};
+    alignas(CACHE_LINE) size_t size;
+    size_t align;
+    size_t seg_header; // Bytes in front of a segment, a multiple of the alignment
+    void* start;
+    SegmentList segments; // Segments allocated by committed transactions, only changed by a committer (holding the sequence lock)
+    unique_ptr<ThreadSlot[]> slots;
+    atomic<size_t> nb_slots{0}; // One past the highest slot ever used
+    // Retired segments a thread lets pile up before trying to free them
+    static constexpr size_t BATCH = 32;
+    MemoryRegion(size_t size, size_t align);
+    ~MemoryRegion();
+    bool init();
+    // Slot of the calling thread, nullptr if it has none
+    ThreadSlot* slot();
+    // Oldest sequence number announced by a running transaction, UINT64_MAX if none runs
+    version oldest_active() const;
+    // Free the retired segments of a thread that no running transaction can access anymore
+    void reclaim(ThreadSlot* slot);
+    void* data(SegmentHeader* seg) const { return reinterpret_cast<char*>(seg) + seg_header; }
+    SegmentHeader* header(void* data) const { return reinterpret_cast<SegmentHeader*>(static_cast<char*>(data) - seg_header); }
+};
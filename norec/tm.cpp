@@ -0,0 +1,287 @@
+/**
+ * @file   tm.cpp
+ * @author Ryan Maxin
+ *
+ * @section LICENSE
+ *
+ * [...]
+ *
+ * @section DESCRIPTION
+ *
+ * NOrec transaction manager (Dalessandro, Spear and Scott, PPoPP 2010).
+ * A single global sequence lock orders the commits, and transactions validate the values they read instead of per-stripe versions,
+ * so there is no lock table at all. Meant for a handful of cores and small regions, where the metadata of TL2 costs more than it saves.
+**/
+
+// Requested features
+#ifndef _GNU_SOURCE
+    #define _GNU_SOURCE
+#endif
+#define _POSIX_C_SOURCE   200809L
+#ifdef __STDC_NO_ATOMICS__
+    #error Current C11 compiler does not support atomic operations
+#endif
+
+// External headers
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+
+// Internal headers
+#include <tm.hpp>
+#include "macros.hpp"
+#include "norec.hpp"
+
+// Global variables
+// Recycled transaction descriptors of the calling thread
+static thread_local DescriptorPool pool;
+
+// Wait for the sequence lock to be free, and return its value
+static version wait_unlocked(MemoryRegion* region) {
+    version time = region->seq.load(memory_order_acquire);
+    while (unlikely(time & 1)) {
+        cpu_relax();
+        time = region->seq.load(memory_order_acquire);
+    }
+    return time;
+}
+
+// Value-based validation: wait for a moment when no commit is running and every word read still has the value we read.
+// On success the transaction carries on with that moment as its snapshot.
+static bool txn_validate(MemoryRegion* region, Transaction* txn) {
+    WordLog& reads = txn->reads;
+    for (;;) {
+        version time = wait_unlocked(region);
+        for (size_t i = 0; i < reads.size(); i++) {
+            if (memcmp(reads.addrs[i], reads.value(i), reads.word_size) != 0) return false;
+        }
+        // The values must have been read before we check the lock again
+        atomic_thread_fence(memory_order_acquire);
+        if (likely(region->seq.load(memory_order_relaxed) == time)) {
+            txn->snapshot = time;
+            return true;
+        }
+    }
+}
+
+// Give the descriptor of an aborted transaction back, so the caller can just 'return txn_abort(region, txn);'
+static bool txn_abort(Transaction* txn) {
+    txn->slot->leave();
+    pool.release(txn);
+    return false;
+}
+
+/** Create (i.e. allocate + init) a new shared memory region, with one first non-free-able allocated segment of the requested size and alignment.
+ * @param size  Size of the first shared segment of memory to allocate (in bytes), must be a positive multiple of the alignment
+ * @param align Alignment (in bytes, must be a power of 2) that the shared memory region must support
+ * @return Opaque shared memory region handle, 'invalid_shared' on failure
+**/
+shared_t tm_create(size_t size, size_t align) noexcept {
+    MemoryRegion* region = new(std::nothrow) MemoryRegion(size, align);
+    if (unlikely(!region)) return invalid_shared;
+    if (unlikely(!region->init())) {
+        delete region;
+        return invalid_shared;
+    }
+    return region;
+}
+
+/** Destroy (i.e. clean-up + free) a given shared memory region.
+ * @param shared Shared memory region to destroy, with no running transaction
+**/
+void tm_destroy(shared_t shared) noexcept {
+    delete reinterpret_cast<MemoryRegion*>(shared);
+}
+
+/** [thread-safe] Return the start address of the first allocated segment in the shared memory region.
+ * @param shared Shared memory region to query
+ * @return Start address of the first allocated segment
+**/
+void* tm_start(shared_t shared) noexcept {
+    return reinterpret_cast<MemoryRegion*>(shared)->start;
+}
+
+/** [thread-safe] Return the size (in bytes) of the first allocated segment of the shared memory region.
+ * @param shared Shared memory region to query
+ * @return First allocated segment size
+**/
+size_t tm_size(shared_t shared) noexcept {
+    return reinterpret_cast<MemoryRegion*>(shared)->size;
+}
+
+/** [thread-safe] Return the alignment (in bytes) of the memory accesses on the given shared memory region.
+ * @param shared Shared memory region to query
+ * @return Alignment used globally
+**/
+size_t tm_align(shared_t shared) noexcept {
+    return reinterpret_cast<MemoryRegion*>(shared)->align;
+}
+
+/** [thread-safe] Begin a new transaction on the given shared memory region.
+ * @param shared Shared memory region to start a transaction on
+ * @param is_ro  Whether the transaction is read-only
+ * @return Opaque transaction ID, 'invalid_tx' on failure
+**/
+tx_t tm_begin(shared_t shared, bool is_ro) noexcept {
+    MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
+    ThreadSlot* slot = region->slot();
+    if (unlikely(!slot)) return invalid_tx;
+    Transaction* txn = pool.acquire(is_ro, region->align);
+    if (unlikely(!txn)) return invalid_tx;
+    txn->slot = slot;
+    // Announce the transaction before taking its snapshot, so that nothing it can reach gets freed under it
+    slot->announce.store(region->seq.load());
+    txn->snapshot = wait_unlocked(region);
+    return reinterpret_cast<tx_t>(txn);
+}
+
+/** [thread-safe] End the given transaction.
+ * @param shared Shared memory region associated with the transaction
+ * @param tx     Transaction to end
+ * @return Whether the whole transaction committed
+**/
+bool tm_end(shared_t shared, tx_t tx) noexcept {
+    MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
+    Transaction* txn = reinterpret_cast<Transaction*>(tx);
+
+    // Read-only transactions, and writing ones that did not write, were consistent at their last snapshot: nothing to do
+    if (txn->writes.empty() && txn->allocs.empty() && txn->frees.empty()) {
+        txn->slot->leave();
+        pool.release(txn);
+        return true;
+    }
+
+    // Take the sequence lock, which is only possible if no one committed since our snapshot
+    version time = txn->snapshot;
+    while (!region->seq.compare_exchange_weak(time, time + 1, memory_order_acquire)) {
+        if (!txn_validate(region, txn)) return txn_abort(txn);
+        time = txn->snapshot;
+    }
+
+    // Write back, and publish the allocations and the frees while nobody else can commit
+    WriteSet& writes = txn->writes;
+    for (size_t i = 0; i < writes.size(); i++) {
+        copy_word(writes.addrs[i], writes.value(i), writes.word_size);
+    }
+    region->segments.splice(txn->allocs);
+    for (SegmentHeader* seg : txn->frees) {
+        SegmentList::unlink(seg);
+        txn->slot->limbo.push_back({seg, time + 2});
+    }
+    // Sequentially consistent, so that a transaction that announced too late to be seen by reclaim() takes a snapshot after this commit
+    region->seq.store(time + 2);
+
+    txn->slot->leave();
+    // Segments freed by the transaction can only be freed for good once the transactions that may still read them are over
+    if (txn->slot->limbo.size() >= MemoryRegion::BATCH) region->reclaim(txn->slot);
+    pool.release(txn);
+    return true;
+}
+
+/** [thread-safe] Read operation in the given transaction, source in the shared region and target in a private region.
+ * @param shared Shared memory region associated with the transaction
+ * @param tx     Transaction to use
+ * @param source Source start address (in the shared region)
+ * @param size   Length to copy (in bytes), must be a positive multiple of the alignment
+ * @param target Target start address (in a private region)
+ * @return Whether the whole transaction can continue
+**/
+bool tm_read(shared_t shared, tx_t tx, void const* source, size_t size, void* target) noexcept {
+    MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
+    Transaction* txn = reinterpret_cast<Transaction*>(tx);
+    char* source_start = (char*)(source);
+    char* target_start = (char*)(target);
+    size_t word_size = region->align;
+
+    // The whole range is copied at once, and the copy is valid if no commit happened meanwhile
+    memcpy(target_start, source_start, size);
+    atomic_thread_fence(memory_order_acquire);
+    while (unlikely(region->seq.load(memory_order_relaxed) != txn->snapshot)) {
+        if (!txn_validate(region, txn)) return txn_abort(txn);
+        memcpy(target_start, source_start, size);
+        atomic_thread_fence(memory_order_acquire);
+    }
+
+    WriteSet& writes = txn->writes;
+    WordLog& reads = txn->reads;
+    for (size_t i = 0; i < size; i += word_size) {
+        char* addr = source_start + i;
+        // Words written previously by the transaction must be read from the write set instead, and need no validation
+        if (unlikely(writes.may_contain(addr))) {
+            char* val = writes.find(addr);
+            if (val) {
+                copy_word(target_start + i, val, word_size);
+                continue;
+            }
+        }
+        reads.push(addr, target_start + i);
+    }
+    return true;
+}
+
+/** [thread-safe] Write operation in the given transaction, source in a private region and target in the shared region.
+ * @param shared Shared memory region associated with the transaction
+ * @param tx     Transaction to use
+ * @param source Source start address (in a private region)
+ * @param size   Length to copy (in bytes), must be a positive multiple of the alignment
+ * @param target Target start address (in the shared region)
+ * @return Whether the whole transaction can continue
+**/
+bool tm_write(shared_t shared, tx_t tx, void const* source, size_t size, void* target) noexcept {
+    MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
+    Transaction* txn = reinterpret_cast<Transaction*>(tx);
+    size_t word_size = region->align;
+    // Nothing reaches the shared memory before commit
+    for (size_t i = 0; i < size; i += word_size) {
+        txn->writes.insert((char*)(target) + i, (char const*)(source) + i);
+    }
+    return true;
+}
+
+/** [thread-safe] Memory allocation in the given transaction.
+ * @param shared Shared memory region associated with the transaction
+ * @param tx     Transaction to use
+ * @param size   Allocation requested size (in bytes), must be a positive multiple of the alignment
+ * @param target Pointer in private memory receiving the address of the first byte of the newly allocated, aligned segment
+ * @return Whether the whole transaction can continue (success/nomem), or not (abort_alloc)
+**/
+Alloc tm_alloc(shared_t shared, tx_t tx, size_t size, void** target) noexcept {
+    MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
+    Transaction* txn = reinterpret_cast<Transaction*>(tx);
+
+    // The segment comes zeroed, as required
+    size_t total = region->seg_header + size;
+    size_t seg_align = max(region->align, alignof(SegmentHeader));
+    SegmentHeader* seg;
+    if (seg_align <= alignof(max_align_t)) {
+        seg = static_cast<SegmentHeader*>(calloc(1, total));
+    } else {
+        // aligned_alloc wants a size that is a multiple of the alignment
+        seg = static_cast<SegmentHeader*>(aligned_alloc(seg_align, (total + seg_align - 1) & ~(seg_align - 1)));
+        if (seg) memset(region->data(seg), 0, size);
+    }
+    if (unlikely(!seg)) return Alloc::nomem;
+
+    // Other transactions only see the segment once we commit, and it goes away if we abort
+    txn->allocs.push_back(seg);
+    *target = region->data(seg);
+    return Alloc::success;
+}
+
+/** [thread-safe] Memory freeing in the given transaction.
+ * @param shared Shared memory region associated with the transaction
+ * @param tx     Transaction to use
+ * @param target Address of the first byte of the previously allocated segment to deallocate
+ * @return Whether the whole transaction can continue
+**/
+bool tm_free(shared_t shared, tx_t tx, void* target) noexcept {
+    MemoryRegion* region = reinterpret_cast<MemoryRegion*>(shared);
+    Transaction* txn = reinterpret_cast<Transaction*>(tx);
+
+    // The first segment is not free-able
+    if (unlikely(target == region->start)) return true;
+
+    // Nothing happens before commit, which retires the segment
+    txn->frees.push_back(region->header(target));
+    return true;
+}
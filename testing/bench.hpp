@@ -0,0 +1,277 @@
+/**
+ * @file   bench.hpp
+ * @author Ryan Maxin
+ *
+ * @section DESCRIPTION
+ *
+ * Runner shared by the microbenchmarks: a pool of worker threads released together for every repetition,
+ * calibrated repetitions of a fixed number of operations, and the median and median absolute deviation of the cost of one operation.
+**/
+
+#pragma once
+
+// External headers
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+extern "C" {
+#include <time.h>
+}
+
+// -------------------------------------------------------------------------- //
+
+/** Monotonic time, in ns.
+ * @return Current time
+**/
+static inline uint64_t bench_now() noexcept {
+    struct ::timespec buf;
+    ::clock_gettime(CLOCK_MONOTONIC, &buf);
+    return static_cast<uint64_t>(buf.tv_sec) * 1000000000ull + static_cast<uint64_t>(buf.tv_nsec);
+}
+
+/** Busy-wait hint for spin loops.
+**/
+static inline void bench_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    ::std::this_thread::yield();
+#endif
+}
+
+/** Wait step of the start lines and barriers: spin for a while, then let oversubscribed CPUs run the threads we wait for.
+ * @param spins Steps waited so far, updated
+**/
+static inline void bench_backoff(unsigned int& spins) noexcept {
+    if (++spins < 1024) {
+        bench_relax();
+    } else {
+        ::std::this_thread::yield();
+    }
+}
+
+/** Keep the compiler from optimizing a value away.
+ * @param value Value to keep
+**/
+template<class Type> static inline void bench_keep(Type const& value) noexcept {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/** Cost of one pair of 'bench_now' calls, subtracted from the timed sections of the benchmarks that time only part of an iteration.
+ * @return Median cost, in ns
+**/
+static inline uint64_t bench_timer_overhead() {
+    ::std::vector<uint64_t> samples(1001);
+    for (auto& sample: samples) {
+        auto start = bench_now();
+        sample = bench_now() - start;
+    }
+    ::std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    return samples[samples.size() / 2];
+}
+
+/** Run parameters, given as '--name=value' options before the positional arguments.
+**/
+struct BenchParameters {
+    ::std::vector<unsigned int> threads; // Worker thread counts, powers of two up to the number of CPUs by default
+    unsigned int nbrepeats = 9;          // Measured repetitions, after one discarded warm-up
+    uint64_t min_ns        = 20000000;   // Shortest repetition the calibration settles for (in ns)
+    bool csv               = false;      // One CSV line per measurement instead of the aligned text
+    ::std::string filter;                // Only run the benchmarks whose name contains this
+};
+
+/** Parse the '--name=value' options of a benchmark program.
+ * @param params Parameters to fill
+ * @param argc   Arguments count
+ * @param argv   Arguments values
+ * @return Index of the first positional argument, 0 on an unknown option
+**/
+static int bench_parse(BenchParameters& params, int argc, char** argv) {
+    auto argi = 1;
+    for (; argi < argc && ::std::strncmp(argv[argi], "--", 2) == 0; ++argi) {
+        ::std::string option{argv[argi] + 2};
+        auto equal = option.find('=');
+        auto name  = option.substr(0, equal);
+        auto value = equal == ::std::string::npos ? ::std::string{} : option.substr(equal + 1);
+        if (name == "threads") {
+            size_t pos = 0;
+            while (pos <= value.size()) {
+                auto end = value.find(',', pos);
+                params.threads.push_back(static_cast<unsigned int>(::std::stoul(value.substr(pos, end - pos))));
+                if (end == ::std::string::npos)
+                    break;
+                pos = end + 1;
+            }
+        } else if (name == "repeats") {
+            params.nbrepeats = static_cast<unsigned int>(::std::stoul(value));
+        } else if (name == "min-ms") {
+            params.min_ns = static_cast<uint64_t>(::std::stod(value) * 1000000.);
+        } else if (name == "format" && (value == "text" || value == "csv")) {
+            params.csv = value == "csv";
+        } else if (name == "filter") {
+            params.filter = value;
+        } else {
+            return 0;
+        }
+    }
+    if (params.threads.empty()) {
+        auto const nbcpus = ::std::max(1u, ::std::thread::hardware_concurrency());
+        for (unsigned int n = 1; n < nbcpus; n *= 2)
+            params.threads.push_back(n);
+        params.threads.push_back(nbcpus);
+    }
+    if (params.nbrepeats == 0)
+        params.nbrepeats = 1;
+    return argi;
+}
+
+/** Body of a benchmark, run by every worker: perform 'iters' iterations and return the time they took (in ns).
+ * Bodies that only time part of an iteration return the sum of the timed sections instead.
+**/
+using BenchBody = ::std::function<uint64_t(unsigned int thread, uint64_t iters)>;
+
+/** Per-operation cost of a benchmark.
+**/
+struct BenchResult {
+    double median;     // Median over the repetitions of the mean cost of an operation over the workers (in ns)
+    double mad;        // Median absolute deviation of the same (in ns)
+    uint64_t nbiters;  // Iterations per worker and repetition, as calibrated
+};
+
+/** Pool of worker threads, all released at once for every repetition.
+**/
+class BenchWorkers final {
+private:
+    ::std::vector<::std::thread> threads;
+    ::std::vector<uint64_t> times;        // Time of each worker in the last repetition
+    BenchBody const* body = nullptr;      // Body of the current benchmark
+    uint64_t nbiters = 0;                 // Iterations of the current repetition
+    ::std::atomic<uint64_t> generation{0}; // Bumped to release the workers, stays odd once they must quit
+    ::std::atomic<unsigned int> pending{0}; // Workers still running the current repetition
+    ::std::atomic<unsigned int> ready{0};   // Workers waiting at the start line
+private:
+    /** Loop of one worker.
+     * @param thread Worker index
+    **/
+    void work(unsigned int thread) {
+        uint64_t seen = 0;
+        while (true) {
+            ready.fetch_add(1);
+            uint64_t gen;
+            for (unsigned int spins = 0; (gen = generation.load()) == seen;)
+                bench_backoff(spins);
+            seen = gen;
+            if (gen & 1)
+                return;
+            times[thread] = (*body)(thread, nbiters);
+            pending.fetch_sub(1);
+        }
+    }
+public:
+    /** Start the workers.
+     * @param nbthreads Number of workers
+    **/
+    BenchWorkers(unsigned int nbthreads): times(nbthreads) {
+        for (unsigned int i = 0; i < nbthreads; ++i)
+            threads.emplace_back(&BenchWorkers::work, this, i);
+    }
+    /** Stop and join the workers.
+    **/
+    ~BenchWorkers() {
+        for (unsigned int spins = 0; ready.load() < threads.size();)
+            bench_backoff(spins);
+        generation.fetch_add(1);
+        for (auto& thread: threads)
+            thread.join();
+    }
+public:
+    /** Run one repetition on every worker.
+     * @param run   Body to run
+     * @param iters Iterations per worker
+     * @return Time of every worker (in ns)
+    **/
+    ::std::vector<uint64_t> const& run(BenchBody const& run, uint64_t iters) {
+        // Every worker is spinning at the start line before anyone is released, so that they start together
+        for (unsigned int spins = 0; ready.load() < threads.size();)
+            bench_backoff(spins);
+        ready.store(0);
+        body    = &run;
+        nbiters = iters;
+        pending.store(static_cast<unsigned int>(threads.size()));
+        generation.fetch_add(2);
+        for (unsigned int spins = 0; pending.load() > 0;)
+            bench_backoff(spins);
+        return times;
+    }
+    /** Measure a benchmark: one warm-up repetition, iterations doubled until a repetition lasts at least 'min_ns', then 'nbrepeats' repetitions.
+     * @param body      Body to run
+     * @param ops       Operations per iteration
+     * @param nbrepeats Measured repetitions
+     * @param min_ns    Shortest repetition (in ns)
+     * @return Per-operation cost
+    **/
+    BenchResult measure(BenchBody const& body, uint64_t ops, unsigned int nbrepeats, uint64_t min_ns) {
+        uint64_t iters = 1;
+        run(body, iters); // Warm-up: first touches, descriptor pools, lazy initializations
+        while (true) {
+            auto start = bench_now();
+            run(body, iters);
+            if (bench_now() - start >= min_ns || iters >= (uint64_t{1} << 40))
+                break;
+            iters *= 2;
+        }
+        ::std::vector<double> costs;
+        for (unsigned int r = 0; r < nbrepeats; ++r) {
+            auto const& times = run(body, iters);
+            double sum = 0.;
+            for (auto time: times)
+                sum += static_cast<double>(time);
+            costs.push_back(sum / static_cast<double>(times.size()) / static_cast<double>(iters * ops));
+        }
+        auto median = [](::std::vector<double> values) {
+            ::std::sort(values.begin(), values.end());
+            auto half = values.size() / 2;
+            return values.size() % 2 ? values[half] : (values[half - 1] + values[half]) / 2.;
+        };
+        BenchResult res;
+        res.median = median(costs);
+        for (auto& cost: costs)
+            cost = cost > res.median ? cost - res.median : res.median - cost;
+        res.mad = median(costs);
+        res.nbiters = iters;
+        return res;
+    }
+};
+
+/** Print the header of a result table.
+ * @param params Run parameters
+**/
+static void bench_header(BenchParameters const& params) {
+    if (params.csv)
+        ::std::cout << "library,benchmark,threads,ns_per_op,mad_ns,iters" << ::std::endl;
+}
+
+/** Print one measurement.
+ * @param params  Run parameters
+ * @param library Library measured
+ * @param name    Benchmark name
+ * @param threads Number of workers
+ * @param res     Per-operation cost
+**/
+static void bench_print(BenchParameters const& params, char const* library, char const* name, unsigned int threads, BenchResult const& res) {
+    if (params.csv) {
+        ::std::cout << library << "," << name << "," << threads << "," << res.median << "," << res.mad << "," << res.nbiters << ::std::endl;
+        return;
+    }
+    char line[160];
+    ::std::snprintf(line, sizeof(line), "⎪ %-20s %3u threads: %10.2f ns/op  ± %-8.2f (%llu iterations)", name, threads, res.median, res.mad, static_cast<unsigned long long>(res.nbiters));
+    ::std::cout << line << ::std::endl;
+}
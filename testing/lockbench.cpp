@@ -0,0 +1,100 @@
+/**
+ * @file   lockbench.cpp
+ * @author Ryan Maxin
+ *
+ * @section DESCRIPTION
+ *
+ * Per-operation cost of the versioned write locks of the 394984 library, alone and under contention.
+ * Linked against '../394984.so' rather than loaded, since the locks are not part of the transactional interface.
+**/
+
+// External headers
+#include <iostream>
+#include <memory>
+
+// Internal headers
+#include "../394984/data-structures.hpp"
+#include "bench.hpp"
+
+// -------------------------------------------------------------------------- //
+
+/** A lock alone on its cache line.
+**/
+struct alignas(CACHE_LINE) PaddedLock {
+    VersionedWriteLock lock;
+};
+
+/** Program entry point.
+ * @param argc Arguments count
+ * @param argv Arguments values
+ * @return Program return code
+**/
+int main(int argc, char** argv) {
+    BenchParameters params;
+    auto argi = bench_parse(params, argc, argv);
+    if (argi == 0 || argi != argc) {
+        ::std::cout << "Usage: " << (argc > 0 ? argv[0] : "lockbench") << " [--threads=<n,...>] [--repeats=<n>] [--min-ms=<ms>] [--format=text|csv] [--filter=<substring>]" << ::std::endl;
+        return 1;
+    }
+    auto const nbthreads = *::std::max_element(params.threads.begin(), params.threads.end());
+    ::std::unique_ptr<PaddedLock[]> locks{new PaddedLock[nbthreads + 1]}; // One per worker, then the one they share
+    auto& shared = locks[nbthreads].lock;
+
+    struct {
+        char const* name;
+        BenchBody body;
+    } const benchmarks[] = {
+        // lock and unlock of a lock only the worker takes
+        {"lock.private", [&](unsigned int thread, uint64_t iters) {
+            auto& lock = locks[thread].lock;
+            auto start = bench_now();
+            for (uint64_t i = 0; i < iters; ++i) {
+                lock.lock(thread + 1);
+                lock.unlock();
+            }
+            return bench_now() - start;
+        }},
+        // lock, retried until it succeeds, and unlock of the lock every worker takes
+        {"lock.shared", [&](unsigned int thread, uint64_t iters) {
+            auto start = bench_now();
+            for (uint64_t i = 0; i < iters; ++i) {
+                for (unsigned int spins = 0; !shared.lock(thread + 1);)
+                    bench_backoff(spins);
+                shared.unlock();
+            }
+            return bench_now() - start;
+        }},
+        // lock and release at a new version of the shared lock, i.e. the lock traffic of a commit
+        {"lock.commit", [&](unsigned int thread, uint64_t iters) {
+            auto start = bench_now();
+            for (uint64_t i = 0; i < iters; ++i) {
+                for (unsigned int spins = 0; !shared.lock(thread + 1);)
+                    bench_backoff(spins);
+                shared.setVersion(shared.getVersion() + 1);
+            }
+            return bench_now() - start;
+        }},
+        // getVersion of the shared lock, as every read validates
+        {"version.shared", [&](unsigned int, uint64_t iters) {
+            auto start = bench_now();
+            for (uint64_t i = 0; i < iters; ++i)
+                bench_keep(shared.getVersion());
+            return bench_now() - start;
+        }},
+    };
+
+    bench_header(params);
+    if (!params.csv)
+        ::std::cout << "⎧ Versioned write locks" << ::std::endl;
+    for (auto threads: params.threads) {
+        BenchWorkers workers{threads};
+        for (auto const& benchmark: benchmarks) {
+            if (::std::string{benchmark.name}.find(params.filter) == ::std::string::npos)
+                continue;
+            bench_print(params, "../394984.so", benchmark.name, threads, workers.measure(benchmark.body, 1, params.nbrepeats, params.min_ns));
+        }
+    }
+    if (!params.csv)
+        ::std::cout << "⎩ Done" << ::std::endl;
+    return 0;
+}
@@ -0,0 +1,179 @@
+/**
+ * @file   microbench.cpp
+ * @author Ryan Maxin
+ *
+ * @section DESCRIPTION
+ *
+ * Per-operation cost of the transactional primitives of any library, loaded like the grading program does:
+ * empty transactions, reads of read-only and writing transactions, writes into sets of growing sizes, and commits of growing read and write sets.
+ * Every worker writes to its own slice of the region, so that the costs measured are those of the primitives rather than of conflicts.
+**/
+
+// External headers
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Internal headers
+#include "../grading/transactional.hpp"
+#include "bench.hpp"
+
+// -------------------------------------------------------------------------- //
+
+constexpr static size_t slice_words = 4096; // Words of the slice of each worker, and of the area every worker reads
+constexpr static size_t read_words  = 64;   // Reads per transaction of the read benchmarks
+
+/** One microbenchmark.
+**/
+struct Benchmark {
+    ::std::string name;
+    uint64_t ops;   // Operations per iteration
+    BenchBody body;
+};
+
+/** Build the microbenchmarks over a shared memory region.
+ * @param tm       Transactional memory to run on (its first segment holds one slice per worker, then the shared read area)
+ * @param overhead Cost of one timed section, subtracted from every one
+ * @return Microbenchmarks
+**/
+static ::std::vector<Benchmark> make_benchmarks(TransactionalMemory const& tm, uint64_t overhead) {
+    auto const base   = static_cast<uint64_t*>(tm.get_start());
+    auto const nbwrks = tm.get_size() / sizeof(uint64_t) / slice_words - 1;
+    auto const shared = base + nbwrks * slice_words;
+    auto const timed  = [overhead](uint64_t delta) { return delta > overhead ? delta - overhead : 0; };
+    ::std::vector<Benchmark> res;
+
+    // tm_begin and tm_end of a transaction that does nothing
+    for (auto ro: {true, false}) {
+        res.push_back({ro ? "empty.ro" : "empty.rw", 1, [&tm, ro](unsigned int, uint64_t iters) {
+            auto start = bench_now();
+            for (uint64_t i = 0; i < iters; ++i)
+                tm.end(tm.begin(ro));
+            return bench_now() - start;
+        }});
+    }
+
+    // One tm_read per word, in the area every worker reads
+    for (auto ro: {true, false}) {
+        res.push_back({ro ? "read.ro" : "read.rw", read_words, [&tm, ro, shared, timed](unsigned int thread, uint64_t iters) {
+            uint64_t total = 0;
+            for (uint64_t i = 0; i < iters; ++i) {
+                auto first = shared + (thread * 977 + i * read_words) % (slice_words - read_words);
+                while (true) {
+                    auto tx = tm.begin(ro);
+                    uint64_t value;
+                    auto ok = true;
+                    auto start = bench_now();
+                    for (size_t k = 0; ok && k < read_words; ++k) {
+                        ok = tm.read(tx, first + k, sizeof(value), &value);
+                        bench_keep(value);
+                    }
+                    auto delta = bench_now() - start;
+                    if (ok && tm.end(tx)) {
+                        total += timed(delta);
+                        break;
+                    }
+                }
+            }
+            return total;
+        }});
+    }
+
+    // One tm_write per word, into write sets of growing sizes
+    for (size_t nbwrites: {1, 10, 100, 1000}) {
+        res.push_back({"write." + ::std::to_string(nbwrites), nbwrites, [&tm, nbwrites, base, timed](unsigned int thread, uint64_t iters) {
+            auto const slice = base + thread * slice_words;
+            uint64_t total = 0;
+            for (uint64_t i = 0; i < iters; ++i) {
+                while (true) {
+                    auto tx = tm.begin(false);
+                    auto ok = true;
+                    auto start = bench_now();
+                    for (size_t k = 0; ok && k < nbwrites; ++k)
+                        ok = tm.write(tx, &i, sizeof(i), slice + k);
+                    auto delta = bench_now() - start;
+                    if (ok && tm.end(tx)) {
+                        total += timed(delta);
+                        break;
+                    }
+                }
+            }
+            return total;
+        }});
+    }
+
+    // tm_end of a transaction that read and wrote sets of growing sizes
+    for (auto sizes: {::std::pair<size_t, size_t>{1, 1}, {10, 10}, {100, 1}, {1, 100}, {100, 100}, {1000, 1000}}) {
+        auto const nbreads  = sizes.first;
+        auto const nbwrites = sizes.second;
+        res.push_back({"commit.r" + ::std::to_string(nbreads) + "w" + ::std::to_string(nbwrites), 1, [&tm, nbreads, nbwrites, base, timed](unsigned int thread, uint64_t iters) {
+            auto const slice = base + thread * slice_words;
+            uint64_t total = 0;
+            for (uint64_t i = 0; i < iters; ++i) {
+                while (true) {
+                    auto tx = tm.begin(false);
+                    uint64_t value;
+                    auto ok = true;
+                    for (size_t k = 0; ok && k < nbreads; ++k) {
+                        ok = tm.read(tx, slice + slice_words / 2 + k, sizeof(value), &value);
+                        bench_keep(value);
+                    }
+                    for (size_t k = 0; ok && k < nbwrites; ++k)
+                        ok = tm.write(tx, &i, sizeof(i), slice + k);
+                    if (!ok)
+                        continue;
+                    auto start = bench_now();
+                    ok = tm.end(tx);
+                    auto delta = bench_now() - start;
+                    if (ok) {
+                        total += timed(delta);
+                        break;
+                    }
+                }
+            }
+            return total;
+        }});
+    }
+    return res;
+}
+
+/** Program entry point.
+ * @param argc Arguments count
+ * @param argv Arguments values
+ * @return Program return code
+**/
+int main(int argc, char** argv) {
+    BenchParameters params;
+    auto argi = bench_parse(params, argc, argv);
+    if (argi == 0 || argi >= argc) {
+        ::std::cout << "Usage: " << (argc > 0 ? argv[0] : "microbench") << " [--threads=<n,...>] [--repeats=<n>] [--min-ms=<ms>] [--format=text|csv] [--filter=<substring>] <library path>..." << ::std::endl;
+        return 1;
+    }
+    try {
+        auto const overhead = bench_timer_overhead();
+        auto const nbthreads = *::std::max_element(params.threads.begin(), params.threads.end());
+        bench_header(params);
+        for (auto i = argi; i < argc; ++i) {
+            if (!params.csv)
+                ::std::cout << "⎧ Microbenchmarks of '" << argv[i] << "' (timer overhead " << overhead << " ns)" << ::std::endl;
+            TransactionalLibrary tl{argv[i]};
+            TransactionalMemory tm{tl, sizeof(uint64_t), (nbthreads + 1) * slice_words * sizeof(uint64_t)};
+            auto const benchmarks = make_benchmarks(tm, overhead);
+            for (auto threads: params.threads) {
+                BenchWorkers workers{threads};
+                for (auto const& benchmark: benchmarks) {
+                    if (benchmark.name.find(params.filter) == ::std::string::npos)
+                        continue;
+                    bench_print(params, argv[i], benchmark.name.c_str(), threads, workers.measure(benchmark.body, benchmark.ops, params.nbrepeats, params.min_ns));
+                }
+            }
+            if (!params.csv)
+                ::std::cout << "⎩ Done" << ::std::endl;
+        }
+    } catch (::std::exception const& err) {
+        ::std::cerr << "⎧ *** EXCEPTION ***" << ::std::endl;
+        ::std::cerr << "⎩ " << err.what() << ::std::endl;
+        return 1;
+    }
+    return 0;
+}
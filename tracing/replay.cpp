@@ -0,0 +1,394 @@
+/**
+ * @file   replay.cpp
+ * @author Ryan Maxin
+ *
+ * @section DESCRIPTION
+ *
+ * Replay of the transaction traces recorded by 'trace.so' against any library, loaded like the grading program does.
+ *
+ * Every recorded thread gets a worker that runs the transactions its thread committed, in the same order, each one retried until it commits.
+ * Aborted attempts of the trace are only counted: replaying the commits lets every library find its own aborts.
+ * Reads and writes go to the same segments, offsets and sizes, with zeroed values since traces hold none.
+ *
+ * Segments must exist when they are used and must not be reclaimed under a user, so a transaction waits for the commit of the transactions that
+ * allocated the segments it uses, and a transaction freeing a segment waits for those that used it and committed before it in the trace.
+ * Both orders follow the commit times of the trace, so the waits cannot form a cycle. A free whose segment was used by a transaction that
+ * committed after it in the trace (it read the segment before the free committed) cannot be ordered that way, it is left out and counted.
+ *
+ * With '--speed=<factor>', transactions do not begin before their recorded time divided by the factor, so that the density of the interleaving
+ * of the threads is the recorded one (at 1) or a scaled one. By default they run back to back.
+**/
+
+// External headers
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Internal headers
+#include "../grading/transactional.hpp"
+#include "trace.hpp"
+
+// -------------------------------------------------------------------------- //
+
+/** Recorded region.
+**/
+struct Region final {
+    uint64_t first; // First segment
+    size_t size;
+    size_t align;
+};
+
+/** Recorded operation of a committed transaction.
+**/
+struct Access final {
+    Trace::Op op;
+    uint64_t segment; // Segment accessed, freed, or allocated (0 for an allocation that did not succeed)
+    uint64_t offset;
+    uint64_t size;
+    uint64_t count;   // Contiguous accesses of that size
+    bool skip;        // Left out of the replay
+};
+
+/** Recorded committed transaction.
+**/
+struct Txn final {
+    uint64_t region;
+    bool ro;
+    uint64_t begin;  // Times since the trace started (in ns)
+    uint64_t end;
+    ::std::vector<Access> ops;
+    ::std::vector<size_t> deps; // Transactions that must have committed before this one begins
+};
+
+/** Every recorded thread, with what the replay needs to order them.
+**/
+struct Recording final {
+    ::std::map<uint64_t, Region> regions;
+    ::std::vector<Txn> txns;
+    ::std::vector<::std::vector<size_t>> threads; // Transactions of every thread, in order
+    uint64_t nb_segments = 0; // One past the highest segment
+    uint64_t attempts = 0;    // Recorded transactions, aborted ones included
+    uint64_t frees_skipped = 0;
+    size_t max_access = 0;
+};
+
+/** Load and decode the trace file of one thread.
+ * @param trace Trace to add the thread to
+ * @param path  Path of the file
+ * @return Whether the file could be read and decoded
+**/
+static bool load_thread(Recording& trace, ::std::string const& path) {
+    ::std::ifstream file{path, ::std::ios::binary};
+    if (!file)
+        return false;
+    ::std::vector<uint8_t> buf{::std::istreambuf_iterator<char>{file}, ::std::istreambuf_iterator<char>{}};
+    if (buf.size() < sizeof(Trace::trace_magic) || ::std::memcmp(buf.data(), Trace::trace_magic, sizeof(Trace::trace_magic)) != 0)
+        return false;
+    uint8_t const* pos = buf.data() + sizeof(Trace::trace_magic);
+    uint8_t const* const end = buf.data() + buf.size();
+    auto& thread = trace.threads.emplace_back();
+    uint64_t now = 0;
+    bool open = false; // Whether 'txn' is a transaction in flight
+    Txn txn;
+    while (pos < end) {
+        auto head = *pos++;
+        auto op = static_cast<Trace::Op>(head & Trace::op_mask);
+        auto ok = (head & Trace::flag_ok) != 0;
+        uint64_t values[4] = {};
+        size_t count;
+        switch (op) {
+            case Trace::Op::create:  count = 4; break;
+            case Trace::Op::destroy: count = 1; break;
+            case Trace::Op::begin:   count = 2; break;
+            case Trace::Op::read:
+            case Trace::Op::write:   count = head & Trace::flag_run ? 4 : 3; break;
+            case Trace::Op::alloc:   count = (head >> Trace::alloc_shift) == static_cast<uint8_t>(STM::Alloc::success) ? 2 : 1; break;
+            case Trace::Op::free:
+            case Trace::Op::end:     count = 1; break;
+            default: return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (!Trace::get_varint(pos, end, values[i]))
+                return false;
+        }
+        switch (op) {
+            case Trace::Op::create:
+                trace.regions[values[0]] = Region{values[1], values[2], values[3]};
+                trace.nb_segments = ::std::max(trace.nb_segments, values[1] + 1);
+                break;
+            case Trace::Op::destroy:
+                // Regions live as long as the replay
+                break;
+            case Trace::Op::begin:
+                now += values[1];
+                txn = Txn{values[0], ok, now, now, {}, {}};
+                open = true;
+                ++trace.attempts;
+                break;
+            case Trace::Op::read:
+            case Trace::Op::write:
+            case Trace::Op::free:
+                if (!open)
+                    break;
+                txn.ops.push_back({op, values[0], op == Trace::Op::free ? 0 : values[1], op == Trace::Op::free ? 0 : values[2], count == 4 ? values[3] : 1, values[0] == 0});
+                trace.max_access = ::std::max<size_t>(trace.max_access, txn.ops.back().size);
+                // A false return aborted the transaction
+                if (!ok)
+                    open = false;
+                break;
+            case Trace::Op::alloc:
+                if (!open)
+                    break;
+                if ((head >> Trace::alloc_shift) == static_cast<uint8_t>(STM::Alloc::abort)) {
+                    open = false;
+                    break;
+                }
+                txn.ops.push_back({op, count == 2 ? values[1] : 0, 0, values[0], 1, false});
+                if (count == 2)
+                    trace.nb_segments = ::std::max(trace.nb_segments, values[1] + 1);
+                break;
+            case Trace::Op::end:
+                now += values[0];
+                if (open && ok) {
+                    txn.end = now;
+                    thread.push_back(trace.txns.size());
+                    trace.txns.push_back(::std::move(txn));
+                }
+                open = false;
+                break;
+        }
+    }
+    return true;
+}
+
+/** Compute the waits between the transactions of the trace.
+ * @param trace Trace to order
+**/
+static void order(Recording& trace) {
+    ::std::vector<size_t> alloc_by(trace.nb_segments, SIZE_MAX);
+    ::std::vector<::std::vector<size_t>> users(trace.nb_segments);
+    for (size_t i = 0; i < trace.txns.size(); ++i) {
+        for (auto& access: trace.txns[i].ops) {
+            // Segments of a truncated trace
+            if (access.segment >= trace.nb_segments)
+                access.skip = true;
+            if (access.op == Trace::Op::alloc) {
+                if (access.segment != 0)
+                    alloc_by[access.segment] = i;
+            } else if (!access.skip && (users[access.segment].empty() || users[access.segment].back() != i)) {
+                users[access.segment].push_back(i);
+            }
+        }
+    }
+    for (size_t i = 0; i < trace.txns.size(); ++i) {
+        auto& txn = trace.txns[i];
+        for (auto& access: txn.ops) {
+            if (access.op == Trace::Op::alloc || access.skip)
+                continue;
+            auto by = alloc_by[access.segment];
+            if (by != SIZE_MAX && by != i) {
+                if (trace.txns[by].end < txn.end) {
+                    txn.deps.push_back(by);
+                } else {
+                    // Used before its allocation committed, which only a racy program does
+                    access.skip = true;
+                    continue;
+                }
+            }
+            if (access.op != Trace::Op::free)
+                continue;
+            for (auto user: users[access.segment]) {
+                if (user == i)
+                    continue;
+                if (trace.txns[user].end < txn.end) {
+                    txn.deps.push_back(user);
+                } else if (trace.txns[user].begin < txn.end) {
+                    access.skip = true;
+                }
+            }
+            if (access.skip)
+                ++trace.frees_skipped;
+        }
+        ::std::sort(txn.deps.begin(), txn.deps.end());
+        txn.deps.erase(::std::unique(txn.deps.begin(), txn.deps.end()), txn.deps.end());
+    }
+}
+
+/** Outcome of the replay on one library.
+**/
+struct Outcome final {
+    uint64_t duration; // Wall time (in ns)
+    uint64_t attempts;
+    uint64_t commits;
+};
+
+/** Replay the trace against a library.
+ * @param trace Trace to replay
+ * @param tl    Library to run on
+ * @param speed Factor the recorded begin times are divided by, 0 to run the transactions back to back
+ * @return Outcome of the replay
+**/
+static Outcome replay(Recording const& trace, TransactionalLibrary const& tl, double speed) {
+    ::std::map<uint64_t, ::std::unique_ptr<TransactionalMemory>> regions;
+    ::std::unique_ptr<::std::atomic<char*>[]> segments{new ::std::atomic<char*>[trace.nb_segments]};
+    for (uint64_t i = 0; i < trace.nb_segments; ++i)
+        segments[i].store(nullptr, ::std::memory_order_relaxed);
+    for (auto const& [id, region]: trace.regions) {
+        auto& tm = regions[id] = ::std::make_unique<TransactionalMemory>(tl, region.align, region.size);
+        segments[region.first].store(static_cast<char*>(tm->get_start()), ::std::memory_order_relaxed);
+    }
+    ::std::unique_ptr<::std::atomic<bool>[]> done{new ::std::atomic<bool>[trace.txns.size()]};
+    for (size_t i = 0; i < trace.txns.size(); ++i)
+        done[i].store(false, ::std::memory_order_relaxed);
+
+    ::std::atomic<uint64_t> attempts{0};
+    ::std::atomic<size_t> ready{0};
+    auto const nbthreads = trace.threads.size();
+    ::std::chrono::steady_clock::time_point start;
+    auto work = [&](size_t thread) {
+        ::std::vector<char> buf(trace.max_access, 0);
+        ::std::vector<::std::pair<uint64_t, char*>> allocated; // Segments allocated by the transaction in flight
+        uint64_t tries = 0;
+        // Released together
+        ready.fetch_add(1);
+        while (ready.load() <= nbthreads)
+            ::std::this_thread::yield();
+        for (auto i: trace.threads[thread]) {
+            auto const& txn = trace.txns[i];
+            if (speed > 0) {
+                auto until = start + ::std::chrono::nanoseconds{static_cast<uint64_t>(txn.begin / speed)};
+                ::std::this_thread::sleep_until(until);
+            }
+            for (auto dep: txn.deps) {
+                while (!done[dep].load(::std::memory_order_acquire))
+                    ::std::this_thread::yield();
+            }
+            auto const& tm = *regions.at(txn.region);
+            auto resolve = [&](uint64_t segment) -> char* {
+                for (auto const& [id, addr]: allocated) {
+                    if (id == segment)
+                        return addr;
+                }
+                return segments[segment].load(::std::memory_order_acquire);
+            };
+            while (true) {
+                ++tries;
+                allocated.clear();
+                auto tx = tm.begin(txn.ro);
+                if (unlikely(tx == STM::invalid_tx))
+                    continue;
+                auto ok = true;
+                for (auto const& access: txn.ops) {
+                    if (!ok)
+                        break;
+                    if (access.skip)
+                        continue;
+                    switch (access.op) {
+                        case Trace::Op::read:
+                        case Trace::Op::write: {
+                            auto addr = resolve(access.segment);
+                            if (!addr)
+                                break;
+                            addr += access.offset;
+                            for (uint64_t k = 0; ok && k < access.count; ++k, addr += access.size)
+                                ok = access.op == Trace::Op::read ? tm.read(tx, addr, access.size, buf.data()) : tm.write(tx, buf.data(), access.size, addr);
+                        } break;
+                        case Trace::Op::alloc: {
+                            void* addr;
+                            auto res = tm.alloc(tx, access.size, &addr);
+                            if (res == STM::Alloc::abort) {
+                                ok = false;
+                            } else if (res == STM::Alloc::success && access.segment != 0) {
+                                allocated.emplace_back(access.segment, static_cast<char*>(addr));
+                            }
+                        } break;
+                        case Trace::Op::free: {
+                            auto addr = resolve(access.segment);
+                            if (addr)
+                                ok = tm.free(tx, addr);
+                        } break;
+                        default:
+                            break;
+                    }
+                }
+                if (ok && tm.end(tx))
+                    break;
+            }
+            for (auto const& [id, addr]: allocated)
+                segments[id].store(addr, ::std::memory_order_release);
+            done[i].store(true, ::std::memory_order_release);
+        }
+        attempts.fetch_add(tries);
+    };
+    ::std::vector<::std::thread> workers;
+    for (size_t i = 0; i < nbthreads; ++i)
+        workers.emplace_back(work, i);
+    while (ready.load() < nbthreads)
+        ::std::this_thread::yield();
+    start = ::std::chrono::steady_clock::now();
+    ready.fetch_add(1);
+    for (auto& worker: workers)
+        worker.join();
+    auto duration = ::std::chrono::duration_cast<::std::chrono::nanoseconds>(::std::chrono::steady_clock::now() - start).count();
+    return Outcome{static_cast<uint64_t>(duration), attempts.load(), trace.txns.size()};
+}
+
+/** Program entry point.
+ * @param argc Arguments count
+ * @param argv Arguments values
+ * @return Program return code
+**/
+int main(int argc, char** argv) {
+    double speed = 0;
+    int argi = 1;
+    for (; argi < argc && ::std::strncmp(argv[argi], "--", 2) == 0; ++argi) {
+        if (::std::strncmp(argv[argi], "--speed=", 8) == 0) {
+            speed = ::std::strtod(argv[argi] + 8, nullptr);
+        } else {
+            argi = argc;
+        }
+    }
+    if (argi + 2 > argc) {
+        ::std::cout << "Usage: " << (argc > 0 ? argv[0] : "replay") << " [--speed=<factor>] <trace prefix> <library path>..." << ::std::endl;
+        return 1;
+    }
+    try {
+        Recording trace;
+        ::std::string const prefix = argv[argi++];
+        for (size_t n = 0; load_thread(trace, prefix + "." + ::std::to_string(n)); ++n) {}
+        if (trace.threads.empty() || trace.regions.empty()) {
+            ::std::cerr << "⎧ *** NO TRACE ***" << ::std::endl;
+            ::std::cerr << "⎩ No region was created in '" << prefix << ".<n>'" << ::std::endl;
+            return 1;
+        }
+        order(trace);
+        ::std::cout << "⎧ Trace '" << prefix << "': " << trace.threads.size() << " threads, " << trace.txns.size() << " commits out of " << trace.attempts << " attempts";
+        if (trace.frees_skipped > 0)
+            ::std::cout << ", " << trace.frees_skipped << " frees left out";
+        ::std::cout << ::std::endl;
+        for (; argi < argc; ++argi) {
+            ::std::cout << "⎪ Replaying on '" << argv[argi] << "'..." << ::std::endl;
+            TransactionalLibrary tl{argv[argi]};
+            auto res = replay(trace, tl, speed);
+            ::std::cout << "⎪ ⎧ Total execution time: " << res.duration / 1e6 << " ms" << ::std::endl;
+            ::std::cout << "⎪ ⎪ Average TX execution time: " << (res.commits > 0 ? res.duration / static_cast<double>(res.commits) : 0) << " ns" << ::std::endl;
+            ::std::cout << "⎪ ⎩ Aborts: " << res.attempts - res.commits << " (" << (res.attempts > 0 ? 100.0 * (res.attempts - res.commits) / res.attempts : 0) << "% of the attempts, "
+                        << (trace.attempts > 0 ? 100.0 * (trace.attempts - trace.txns.size()) / trace.attempts : 0) << "% recorded)" << ::std::endl;
+        }
+        ::std::cout << "⎩ Done" << ::std::endl;
+    } catch (::std::exception const& err) {
+        ::std::cerr << "⎧ *** EXCEPTION ***" << ::std::endl;
+        ::std::cerr << "⎩ " << err.what() << ::std::endl;
+        return 1;
+    }
+    return 0;
+}
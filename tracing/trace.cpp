@@ -0,0 +1,469 @@
+/**
+ * @file   trace.cpp
+ * @author Ryan Maxin
+ *
+ * @section DESCRIPTION
+ *
+ * Tracing layer over the transactional library interface, built as 'trace.so'.
+ * Every 'tm_*' call is forwarded to the traced library, and the calling thread appends what it did to its own trace file (see trace.hpp).
+ *
+ * The traced library is the one at TM_TRACE_LIB when it is set, which is how a program that loads its library at runtime gets traced,
+ * otherwise the next definition of the symbols, i.e. the library the program is linked against when 'trace.so' is preloaded.
+ * Trace files are '<prefix>.<n>', the prefix being TM_TRACE ("tm.trace" if unset). Each thread buffers its records and writes them out
+ * every MiB and when it exits.
+**/
+
+// External headers
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+extern "C" {
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+}
+
+// Internal headers
+#include <tm.hpp>
+#include "trace.hpp"
+
+// -------------------------------------------------------------------------- //
+
+namespace {
+
+/** Functions of the traced library.
+**/
+struct Target final {
+    decltype(&::tm_create)  create;
+    decltype(&::tm_destroy) destroy;
+    decltype(&::tm_start)   start;
+    decltype(&::tm_size)    size;
+    decltype(&::tm_align)   align;
+    decltype(&::tm_begin)   begin;
+    decltype(&::tm_end)     end;
+    decltype(&::tm_read)    read;
+    decltype(&::tm_write)   write;
+    decltype(&::tm_alloc)   alloc;
+    decltype(&::tm_free)    free;
+};
+
+/** Resolve the functions of the traced library, once.
+ * @return Traced library
+**/
+Target const& target() {
+    static Target const res = [] {
+        Target res;
+        void* module = RTLD_NEXT;
+        auto path = ::getenv("TM_TRACE_LIB");
+        if (path) {
+            module = ::dlopen(path, RTLD_NOW | RTLD_LOCAL);
+            if (!module) {
+                ::fprintf(stderr, "trace.so: unable to load '%s': %s\n", path, ::dlerror());
+                ::abort();
+            }
+        }
+        auto solve = [&](char const* name, auto& fn) {
+            auto sym = ::dlsym(module, name);
+            if (!sym) {
+                ::fprintf(stderr, "trace.so: symbol '%s' not found, set TM_TRACE_LIB to the library to trace\n", name);
+                ::abort();
+            }
+            fn = reinterpret_cast<::std::remove_reference_t<decltype(fn)>>(sym);
+        };
+        solve("tm_create", res.create);
+        solve("tm_destroy", res.destroy);
+        solve("tm_start", res.start);
+        solve("tm_size", res.size);
+        solve("tm_align", res.align);
+        solve("tm_begin", res.begin);
+        solve("tm_end", res.end);
+        solve("tm_read", res.read);
+        solve("tm_write", res.write);
+        solve("tm_alloc", res.alloc);
+        solve("tm_free", res.free);
+        return res;
+    }();
+    return res;
+}
+
+/** Time since the trace started, in ns.
+ * @return Current time
+**/
+uint64_t trace_now() {
+    static auto const origin = ::std::chrono::steady_clock::now();
+    return ::std::chrono::duration_cast<::std::chrono::nanoseconds>(::std::chrono::steady_clock::now() - origin).count();
+}
+
+/** Segment of a region, by start address.
+**/
+struct Segment final {
+    size_t   size;
+    uint64_t id;
+};
+
+/** Segments of a traced region.
+**/
+struct Region final {
+    uint64_t id;
+    ::std::shared_mutex lock; // Lookups share it, allocations and the end of transactions that freed segments take it
+    ::std::map<uintptr_t, Segment> segments;
+    ::std::atomic<uint64_t> generation{0}; // Bumped on every removal, so that threads know when their cached segment may be gone
+};
+
+::std::atomic<uint64_t> next_region{1};
+::std::atomic<uint64_t> next_segment{1};
+::std::atomic<uint64_t> next_thread{0};
+
+// Regions are never deleted, so that a thread holding one never holds a dangling pointer. 'regions_epoch' is bumped on every creation and destruction.
+::std::mutex regions_lock;
+::std::unordered_map<shared_t, Region*> regions;
+::std::atomic<uint64_t> regions_epoch{0};
+
+/** Trace and transaction of the calling thread.
+**/
+class Thread final {
+private:
+    constexpr static size_t flush_size = size_t{1} << 20;
+    int fd = -1;
+    ::std::vector<uint8_t> buf;
+    uint64_t last = 0; // Time of the last begin or end
+    // Last region and segment found
+    shared_t region_shared = invalid_shared;
+    Region*  region_cached = nullptr;
+    uint64_t region_epoch = 0;
+    Region*  seg_region = nullptr;
+    uint64_t seg_generation = 0;
+    uintptr_t seg_start = 0;
+    Segment   seg;
+    // Run of successful contiguous accesses not recorded yet, if 'run_count' is not 0
+    Trace::Op run_op;
+    uint64_t  run_seg;
+    uint64_t  run_offset;
+    uint64_t  run_size;
+    uint64_t  run_count = 0;
+    uintptr_t run_next; // Address the next access of the run would start at, and the end of the segment of the run
+    uintptr_t run_end;
+public:
+    // Transaction in flight, with its handle in the traced library and the segments it allocated and freed so far, by start address and id
+    tx_t tx = invalid_tx;
+    Region* region = nullptr;
+    ::std::vector<::std::pair<uintptr_t, uint64_t>> allocs;
+    ::std::vector<::std::pair<uintptr_t, uint64_t>> frees;
+public:
+    Thread() = default;
+    ~Thread() {
+        end_run();
+        flush();
+        if (fd >= 0)
+            ::close(fd);
+    }
+public:
+    /** Append a record.
+     * @param op     Operation
+     * @param flags  Flags of the operation
+     * @param values Integers of the record
+    **/
+    void record(Trace::Op op, uint8_t flags, ::std::initializer_list<uint64_t> values) {
+        if (run_count > 0)
+            end_run();
+        append(op, flags, values);
+    }
+    /** Extend the run in progress with a successful access, if it continues it, without looking its segment up.
+     * @param op   Operation
+     * @param addr Address accessed
+     * @param size Size of the access
+     * @return Whether the access was merged into the run
+    **/
+    bool extends(Trace::Op op, void const* addr, uint64_t size) {
+        auto target = reinterpret_cast<uintptr_t>(addr);
+        if (run_count == 0 || op != run_op || size != run_size || target != run_next || target + size > run_end)
+            return false;
+        run_next += size;
+        ++run_count;
+        return true;
+    }
+    /** Record a read or a write, just located, as the start of a new run.
+     * @param op      Operation
+     * @param ok      Whether it returned true
+     * @param segment Segment accessed, the one 'locate' just found
+     * @param offset  Offset in the segment
+     * @param size    Size of the access
+    **/
+    void access(Trace::Op op, bool ok, uint64_t segment, uint64_t offset, uint64_t size) {
+        if (run_count > 0)
+            end_run();
+        if (!ok) {
+            append(op, 0, {segment, offset, size});
+            return;
+        }
+        run_op = op;
+        run_seg = segment;
+        run_offset = offset;
+        run_size = size;
+        run_count = 1;
+        // An address of no known segment starts no run
+        run_next = segment != 0 ? seg_start + offset + size : 0;
+        run_end = segment != 0 ? seg_start + seg.size : 0;
+    }
+    /** Record the run of accesses in progress.
+    **/
+    void end_run() {
+        if (run_count == 0)
+            return;
+        if (run_count == 1) {
+            append(run_op, Trace::flag_ok, {run_seg, run_offset, run_size});
+        } else {
+            append(run_op, Trace::flag_ok | Trace::flag_run, {run_seg, run_offset, run_size, run_count});
+        }
+        run_count = 0;
+    }
+private:
+    /** Append a record to the buffer.
+     * @param op     Operation
+     * @param flags  Flags of the operation
+     * @param values Integers of the record
+    **/
+    void append(Trace::Op op, uint8_t flags, ::std::initializer_list<uint64_t> values) {
+        if (fd == -1)
+            open();
+        buf.push_back(static_cast<uint8_t>(op) | flags);
+        for (auto value: values)
+            Trace::put_varint(buf, value);
+        if (buf.size() >= flush_size)
+            flush();
+    }
+public:
+    /** Time since the last begin or end, which becomes now.
+     * @return Elapsed time (in ns)
+    **/
+    uint64_t lap() {
+        auto now = trace_now();
+        auto res = now - last;
+        last = now;
+        return res;
+    }
+    /** Create the trace file of the thread, on its first record.
+    **/
+    void open() {
+        auto prefix = ::getenv("TM_TRACE");
+        auto path = ::std::string{prefix ? prefix : "tm.trace"} + "." + ::std::to_string(next_thread.fetch_add(1));
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            ::fprintf(stderr, "trace.so: unable to create '%s', dropping its records\n", path.c_str());
+            fd = -2;
+        }
+        buf.insert(buf.end(), Trace::trace_magic, Trace::trace_magic + sizeof(Trace::trace_magic));
+    }
+    /** Write the buffered records out.
+    **/
+    void flush() {
+        for (size_t done = 0; fd >= 0 && done < buf.size();) {
+            auto res = ::write(fd, buf.data() + done, buf.size() - done);
+            if (res <= 0)
+                break;
+            done += res;
+        }
+        buf.clear();
+    }
+    /** Traced region of a handle.
+     * @param shared Region handle
+     * @return Region, 'nullptr' if it is not traced
+    **/
+    Region* find(shared_t shared) {
+        auto epoch = regions_epoch.load(::std::memory_order_acquire);
+        if (shared != region_shared || epoch != region_epoch) {
+            ::std::lock_guard<::std::mutex> guard{regions_lock};
+            auto it = regions.find(shared);
+            region_cached = it == regions.end() ? nullptr : it->second;
+            region_shared = shared;
+            region_epoch = epoch;
+        }
+        return region_cached;
+    }
+    /** Segment holding an address.
+     * @param region Region of the address
+     * @param addr   Address
+     * @param offset Offset of the address in its segment
+     * @return Segment, 0 if none holds the address
+    **/
+    uint64_t locate(Region* region, void const* addr, uint64_t& offset) {
+        auto target = reinterpret_cast<uintptr_t>(addr);
+        offset = 0;
+        if (!region)
+            return 0;
+        auto generation = region->generation.load(::std::memory_order_acquire);
+        if (region != seg_region || generation != seg_generation || target < seg_start || target >= seg_start + seg.size) {
+            ::std::shared_lock<::std::shared_mutex> guard{region->lock};
+            auto it = region->segments.upper_bound(target);
+            if (it == region->segments.begin())
+                return 0;
+            --it;
+            if (target >= it->first + it->second.size)
+                return 0;
+            seg_region = region;
+            seg_generation = generation;
+            seg_start = it->first;
+            seg = it->second;
+        }
+        offset = target - seg_start;
+        return seg.id;
+    }
+    /** Forget the transaction in flight, dropping the segments it freed if it committed, or those it allocated otherwise.
+     * The traced library released them already, so another thread may have allocated a new segment at the same address meanwhile: only the entries that still carry our ids go.
+     * @param committed Whether it committed
+    **/
+    void finish(bool committed) {
+        auto& gone = committed ? frees : allocs;
+        if (region && !gone.empty()) {
+            ::std::unique_lock<::std::shared_mutex> guard{region->lock};
+            for (auto [start, id]: gone) {
+                auto it = region->segments.find(start);
+                if (it != region->segments.end() && it->second.id == id)
+                    region->segments.erase(it);
+            }
+            region->generation.fetch_add(1, ::std::memory_order_release);
+        }
+        region = nullptr;
+        allocs.clear();
+        frees.clear();
+    }
+};
+
+thread_local Thread self;
+
+}
+
+// -------------------------------------------------------------------------- //
+
+shared_t tm_create(size_t size, size_t align) noexcept {
+    auto& me = self;
+    auto shared = target().create(size, align);
+    if (shared == invalid_shared)
+        return shared;
+    auto region = new Region{};
+    region->id = next_region.fetch_add(1);
+    auto seg = next_segment.fetch_add(1);
+    region->segments.emplace(reinterpret_cast<uintptr_t>(target().start(shared)), Segment{size, seg});
+    {
+        ::std::lock_guard<::std::mutex> guard{regions_lock};
+        regions[shared] = region;
+        regions_epoch.fetch_add(1, ::std::memory_order_release);
+    }
+    me.record(Trace::Op::create, 0, {region->id, seg, size, align});
+    return shared;
+}
+
+void tm_destroy(shared_t shared) noexcept {
+    auto& me = self;
+    auto region = me.find(shared);
+    if (region) {
+        me.record(Trace::Op::destroy, 0, {region->id});
+        ::std::lock_guard<::std::mutex> guard{regions_lock};
+        regions.erase(shared);
+        regions_epoch.fetch_add(1, ::std::memory_order_release);
+    }
+    target().destroy(shared);
+}
+
+void* tm_start(shared_t shared) noexcept {
+    return target().start(shared);
+}
+
+size_t tm_size(shared_t shared) noexcept {
+    return target().size(shared);
+}
+
+size_t tm_align(shared_t shared) noexcept {
+    return target().align(shared);
+}
+
+tx_t tm_begin(shared_t shared, bool is_ro) noexcept {
+    auto& me = self;
+    auto wait = me.lap();
+    auto tx = target().begin(shared, is_ro);
+    if (tx == invalid_tx)
+        return tx;
+    me.tx = tx;
+    me.region = me.find(shared);
+    me.record(Trace::Op::begin, is_ro ? Trace::flag_ok : 0, {me.region ? me.region->id : 0, wait});
+    // The transaction handle is the record of the thread, so that the other calls need no thread-local lookup
+    return reinterpret_cast<tx_t>(&me);
+}
+
+bool tm_end(shared_t shared, tx_t tx) noexcept {
+    auto& me = *reinterpret_cast<Thread*>(tx);
+    auto res = target().end(shared, me.tx);
+    me.record(Trace::Op::end, res ? Trace::flag_ok : 0, {me.lap()});
+    me.finish(res);
+    return res;
+}
+
+bool tm_read(shared_t shared, tx_t tx, void const* source, size_t size, void* target_addr) noexcept {
+    auto& me = *reinterpret_cast<Thread*>(tx);
+    auto res = target().read(shared, me.tx, source, size, target_addr);
+    if (res && me.extends(Trace::Op::read, source, size))
+        return res;
+    uint64_t offset;
+    auto seg = me.locate(me.region, source, offset);
+    me.access(Trace::Op::read, res, seg, offset, size);
+    if (!res)
+        me.finish(false);
+    return res;
+}
+
+bool tm_write(shared_t shared, tx_t tx, void const* source, size_t size, void* target_addr) noexcept {
+    auto& me = *reinterpret_cast<Thread*>(tx);
+    auto res = target().write(shared, me.tx, source, size, target_addr);
+    if (res && me.extends(Trace::Op::write, target_addr, size))
+        return res;
+    uint64_t offset;
+    auto seg = me.locate(me.region, target_addr, offset);
+    me.access(Trace::Op::write, res, seg, offset, size);
+    if (!res)
+        me.finish(false);
+    return res;
+}
+
+Alloc tm_alloc(shared_t shared, tx_t tx, size_t size, void** target_addr) noexcept {
+    auto& me = *reinterpret_cast<Thread*>(tx);
+    auto res = target().alloc(shared, me.tx, size, target_addr);
+    auto flags = static_cast<uint8_t>(static_cast<uint8_t>(res) << Trace::alloc_shift);
+    if (res == Alloc::success && me.region) {
+        auto seg = next_segment.fetch_add(1);
+        auto start = reinterpret_cast<uintptr_t>(*target_addr);
+        {
+            ::std::unique_lock<::std::shared_mutex> guard{me.region->lock};
+            me.region->segments[start] = Segment{size, seg};
+        }
+        me.allocs.emplace_back(start, seg);
+        me.record(Trace::Op::alloc, flags, {size, seg});
+    } else {
+        me.record(Trace::Op::alloc, flags, {size});
+        if (res == Alloc::abort)
+            me.finish(false);
+    }
+    return res;
+}
+
+bool tm_free(shared_t shared, tx_t tx, void* target_addr) noexcept {
+    auto& me = *reinterpret_cast<Thread*>(tx);
+    uint64_t offset;
+    auto seg = me.locate(me.region, target_addr, offset);
+    auto res = target().free(shared, me.tx, target_addr);
+    me.record(Trace::Op::free, res ? Trace::flag_ok : 0, {seg});
+    if (res) {
+        me.frees.emplace_back(reinterpret_cast<uintptr_t>(target_addr), seg);
+    } else {
+        me.finish(false);
+    }
+    return res;
+}
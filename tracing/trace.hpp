@@ -0,0 +1,90 @@
+/**
+ * @file   trace.hpp
+ * @author Ryan Maxin
+ *
+ * @section DESCRIPTION
+ *
+ * Format of the transaction traces that 'trace.so' records and 'replay' runs again.
+ *
+ * Every thread that calls the library writes its own file, '<prefix>.<n>' with n counting the threads from 0 in the order they first called it.
+ * A file is the 8 bytes of 'trace_magic' followed by records, each of them one byte (the operation in the low nibble, flags in the high one)
+ * and then unsigned LEB128 integers. Only the shape of the traffic is recorded: which segments, offsets and sizes are accessed, never the values.
+ *
+ *   create   region, first segment, size, alignment
+ *   destroy  region
+ *   begin    region, ns since the previous begin or end of the thread   (flag_ok if read-only)
+ *            (its first begin counts from the start of the trace, so that the times of all the threads line up)
+ *   read     segment, offset, size, then a count with flag_run           (flag_ok if it returned true)
+ *   write    segment, offset, size, then a count with flag_run           (flag_ok if it returned true)
+ *   alloc    size, then the new segment on success                       (Alloc status in the flags)
+ *   free     segment                                                     (flag_ok if it returned true)
+ *   end      ns since the begin                                          (flag_ok if it committed)
+ *
+ * A record with flag_run stands for 'count' successful accesses of the same size, each one starting where the previous one ended, e.g. a scan.
+ *
+ * Segments are numbered from 1 across every region of the process, first segments included, in the order they were created.
+ * Segment 0 stands for an address of no known segment.
+**/
+
+#pragma once
+
+// External headers
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// -------------------------------------------------------------------------- //
+
+namespace Trace {
+
+constexpr static char trace_magic[8] = {'T', 'M', 'T', 'R', 'A', 'C', 'E', '1'};
+
+/** Operation of a record.
+**/
+enum class Op: uint8_t {
+    create = 1,
+    destroy,
+    begin,
+    read,
+    write,
+    alloc,
+    free,
+    end,
+};
+
+constexpr static uint8_t op_mask     = 0x0f;
+constexpr static uint8_t flag_ok     = 0x10;
+constexpr static uint8_t flag_run    = 0x20;
+constexpr static uint8_t alloc_shift = 4; // The Alloc status of an alloc record sits in the flags
+
+/** Append an unsigned LEB128 integer.
+ * @param buf   Buffer to append to
+ * @param value Value to append
+**/
+static inline void put_varint(::std::vector<uint8_t>& buf, uint64_t value) {
+    while (value >= 0x80) {
+        buf.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    buf.push_back(static_cast<uint8_t>(value));
+}
+
+/** Decode an unsigned LEB128 integer.
+ * @param pos   Position to decode at, moved past the integer
+ * @param end   End of the buffer
+ * @param value Decoded value
+ * @return Whether a whole integer was decoded
+**/
+static inline bool get_varint(uint8_t const*& pos, uint8_t const* end, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; pos < end && shift < 64; shift += 7) {
+        auto byte = *pos++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+}